@@ -0,0 +1,19 @@
+#!/bin/bash
+
+# the editor core without a window or gpu, runs anywhere with a c++17 compiler. built once
+# on each rope, bench on the avl one and bench_btree on the b-tree, to compare them
+mkdir -p build
+for btree in 0 1; do
+  name=bench
+  if [ $btree = 1 ]; then name=bench_btree; fi
+
+  ${CXX:-clang++} \
+    -std=c++17 -fno-exceptions \
+    -DHEADLESS=1 \
+    -DUSE_BTREE_ROPE=$btree \
+    src/bench_main.cpp \
+    -o ./build/$name \
+    -I ./src/ -I ./ \
+    -lpthread \
+    -O2 -g || exit 1
+done
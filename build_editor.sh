@@ -19,5 +19,6 @@ clang++ \
   -I ./third_party/freetype/include ./third_party/freetype/build/libfreetype.a \
   -g \
   # -O3 -DNDEBUG \
+  # -DUSE_BTREE_ROPE=1 \
   # -I "C:\Users\Asad\VulkanSdk\1.3.231.1\Include" "C:\Users\Asad\VulkanSdk\1.3.231.1\Lib\vulkan-1.lib"  \
   # -I ./third_party/assimp/include   ./third_party/assimp/lib/assimp-vc141-mt.lib \
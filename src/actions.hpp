@@ -24,6 +24,8 @@ enum struct Command {
   BUFFER_COPY,
   BUFFER_PASTE,
   BUFFER_PLACE_ANCHOR,
+  BUFFER_UNDO,
+  BUFFER_REDO,
 
   NAV_CHAR_LEFT,
   NAV_CHAR_RIGHT,
@@ -45,9 +47,19 @@ enum struct Command {
   MENU_QUICK_OPEN,
   TOGGLE_FIND,
   JUMP_TO_NEXT,
+  JUMP_TO_PREVIOUS,
+  TOGGLE_FIND_REGEX,
+  FIND_IN_FILES,
+
+  TOGGLE_LATENCY_OVERLAY,
+  DUMP_LATENCY,
+  TOGGLE_PROFILER_OVERLAY,
+  EXPORT_TRACE,
 
   ESCAPE,
 };
+const i32 COMMAND_COUNT = (i32)Command::ESCAPE + 1;
+
 String command_strings[] = {
   "NONE",
 
@@ -66,6 +78,8 @@ String command_strings[] = {
   "BUFFER_COPY",
   "BUFFER_PASTE",
   "BUFFER_PLACE_ANCHOR",
+  "BUFFER_UNDO",
+  "BUFFER_REDO",
 
   "NAV_CHAR_LEFT",
   "NAV_CHAR_RIGHT",
@@ -87,6 +101,14 @@ String command_strings[] = {
   "MENU_QUICK_OPEN",
   "TOGGLE_FIND",
   "JUMP_TO_NEXT",
+  "JUMP_TO_PREVIOUS",
+  "TOGGLE_FIND_REGEX",
+  "FIND_IN_FILES",
+
+  "TOGGLE_LATENCY_OVERLAY",
+  "DUMP_LATENCY",
+  "TOGGLE_PROFILER_OVERLAY",
+  "EXPORT_TRACE",
 
   "ESCAPE",
 };
@@ -124,6 +146,9 @@ Array<std::pair<Chord, Command>, 1024> bindings = {
     {Chord{{Key::A}}, Command::BUFFER_PLACE_ANCHOR},
     {Chord{{Key::Y}}, Command::BUFFER_COPY},
     {Chord{{Key::P}}, Command::BUFFER_PASTE},
+    {Chord{{Key::U}}, Command::BUFFER_UNDO},
+    {Chord{{Key::Z, Modifiers::with_super()}}, Command::BUFFER_UNDO},
+    {Chord{{Key::R, Modifiers::with_ctrl()}}, Command::BUFFER_REDO},
     {Chord{{Key::LALT}}, Command::BUFFER_CHANGE_MODE},
     {Chord{{Key::RALT}}, Command::BUFFER_CHANGE_MODE},
 
@@ -146,6 +171,14 @@ Array<std::pair<Chord, Command>, 1024> bindings = {
     {Chord{{Key::SPACE}, {Key::SPACE}}, Command::MENU_QUICK_OPEN},
     {Chord{{Key::F}}, Command::TOGGLE_FIND},
     {Chord{{Key::E}}, Command::JUMP_TO_NEXT},
+    {Chord{{Key::E, Modifiers::with_shift()}}, Command::JUMP_TO_PREVIOUS},
+    {Chord{{Key::SPACE}, {Key::F}, {Key::R}}, Command::TOGGLE_FIND_REGEX},
+    {Chord{{Key::SPACE}, {Key::F}, {Key::F}}, Command::FIND_IN_FILES},
+
+    {Chord{{Key::SPACE}, {Key::D}, {Key::L}}, Command::TOGGLE_LATENCY_OVERLAY},
+    {Chord{{Key::SPACE}, {Key::D}, {Key::D}}, Command::DUMP_LATENCY},
+    {Chord{{Key::SPACE}, {Key::D}, {Key::F}}, Command::TOGGLE_PROFILER_OVERLAY},
+    {Chord{{Key::SPACE}, {Key::D}, {Key::T}}, Command::EXPORT_TRACE},
 
     {Chord{{Key::G}}, Command::ESCAPE},
     {Chord{{Key::G, Modifiers::with_ctrl()}}, Command::ESCAPE},
@@ -0,0 +1,997 @@
+#include <regex>
+#include <thread>
+#include <unordered_map>
+
+#include "buffer.hpp"
+#include "containers/hash_map.hpp"
+#include "logging.hpp"
+#include "memory.hpp"
+#include "parallel_search.hpp"
+#include "profiler.hpp"
+#include "regex.hpp"
+#include "rope_buffer.hpp"
+#include "rope_editor.hpp"
+#include "search_session.hpp"
+#include "tester.hpp"
+#include "timer.hpp"
+#include "types.hpp"
+
+// Headless benchmarks of the buffer, rope and editor core. Build with build_bench.sh and
+// run
+//
+//   bench [benchmark...] [--size MB] [--ops N] [--seed N] [--script FILE] [--file PATH]
+//         [--trace PATH]
+//
+// with no benchmark named they all run. Editor benchmarks report latency per Command
+// along with the heap allocations each one made. --trace writes the profiler's zones as a
+// Chrome trace.
+
+// allocations made with new count too. new can't throw without exceptions, so a size
+// that can't be allocated stops the bench. new[] asks for SIZE_MAX when its element
+// count overflows
+void *checked_new(size_t size)
+{
+  if (size > PTRDIFF_MAX) abort();
+  void *data = sys_alloc(size);
+  if (!data) abort();
+  return data;
+}
+void *operator new(size_t size) { return checked_new(size); }
+void *operator new[](size_t size) { return checked_new(size); }
+void operator delete(void *data) noexcept { sys_free(data); }
+void operator delete[](void *data) noexcept { sys_free(data); }
+void operator delete(void *data, size_t) noexcept { sys_free(data); }
+void operator delete[](void *data, size_t) noexcept { sys_free(data); }
+
+// there's no status bar to show chords on
+void show_partial_chord(Chord *chord) {}
+void show_completed_chord(Chord *chord, Command command) {}
+
+struct BenchOptions {
+  i64 size          = 64 * MB;
+  i64 ops           = 100000;
+  u64 seed          = 1;
+  String script     = "resources/test/tiny.txt";
+  String file       = "build/bench.txt";
+  const char *trace = nullptr;
+};
+
+u64 next_random(u64 *state)
+{
+  *state = *state * 6364136223846793005ull + 1442695040888963407ull;
+  return *state >> 33;
+}
+
+// latencies of one kind of operation and the allocations they made
+struct Samples {
+  DynamicArray<u64> nanos = DynamicArray<u64>(&system_allocator);
+  i64 allocations         = 0;
+  i64 bytes               = 0;
+};
+
+struct Measure {
+  u64 start;
+  AllocationCounts counts;
+};
+
+Measure begin_measure() { return {now_ns(), current_allocation_counts()}; }
+
+void end_measure(Measure measure, Samples *samples)
+{
+  u64 end                 = now_ns();
+  AllocationCounts counts = current_allocation_counts();
+  samples->nanos.push_back(end - measure.start);
+  samples->allocations += counts.allocations - measure.counts.allocations;
+  samples->bytes += counts.bytes - measure.counts.bytes;
+}
+
+f64 percentile_us(Samples *samples, f64 p)
+{
+  i64 index = std::min((i64)(samples->nanos.size * p), samples->nanos.size - 1);
+  return samples->nanos.data[index] / 1000.0;
+}
+
+void print_samples(const char *name, Samples *samples)
+{
+  i64 count = samples->nanos.size;
+  if (count == 0) return;
+
+  std::sort(samples->nanos.data, samples->nanos.data + count);
+  printf("  %-22s %8lld  p50 %9.2f us  p99 %9.2f us  max %10.1f us  %7.3f allocs/op  "
+         "%9.0f B/op\n",
+         name, (long long)count, percentile_us(samples, 0.5), percentile_us(samples, 0.99),
+         percentile_us(samples, 1), (f64)samples->allocations / count,
+         (f64)samples->bytes / count);
+}
+
+struct CommandStats {
+  Samples commands[COMMAND_COUNT];
+};
+
+void print_command_stats(CommandStats *stats)
+{
+  for (i32 i = 0; i < COMMAND_COUNT; i++) {
+    String name = command_strings[i];
+    char name_string[64];
+    snprintf(name_string, sizeof(name_string), "%.*s", (i32)name.size, name.data);
+    print_samples(name_string, &stats->commands[i]);
+  }
+}
+
+// runs one action through the editor the way a frame would and records how long it took
+void run_action(RopeEditor *editor, Action action, CommandStats *stats)
+{
+  Actions actions;
+  actions.push_back(action);
+
+  Measure measure = begin_measure();
+  if (action.command == Command::BUFFER_SAVE) {
+    // the window handles saving, not the editor
+    write_to_disk(editor->buffer);
+  } else {
+    process(editor, &actions);
+  }
+  end_measure(measure, &stats->commands[(i32)action.command]);
+}
+
+// the upkeep the main loop does between frames
+void end_frame(RopeEditor *editor, bool idle)
+{
+  continue_loading(&editor->buffer);
+  if (idle) {
+    continue_compaction(editor->buffer);
+  }
+  tmp_allocator.reset();
+}
+
+// text that looks like code, lines of words of varying length
+void generate_text(DynamicArray<u8> *text, i64 size, u64 seed)
+{
+  const char *words[] = {"i64", "index", "=", "buffer", "->", "size;", "if", "(", ")",
+                         "{", "}", "return", "cursor", "line", "+", "1", "//", "the"};
+  i64 word_count      = sizeof(words) / sizeof(words[0]);
+
+  text->resize(size);
+  i64 written = 0;
+  while (written < size) {
+    i64 indent = next_random(&seed) % 4 * 2;
+    i64 length = next_random(&seed) % 12;
+    for (i64 i = 0; i < indent && written < size; i++) text->data[written++] = ' ';
+    for (i64 i = 0; i < length && written < size; i++) {
+      const char *word = words[next_random(&seed) % word_count];
+      for (i64 c = 0; word[c] && written < size; c++) text->data[written++] = word[c];
+      if (written < size) text->data[written++] = ' ';
+    }
+    if (written < size) text->data[written++] = '\n';
+  }
+}
+
+RopeEditor open_generated_file(BenchOptions options)
+{
+  DynamicArray<u8> text(&system_allocator);
+  generate_text(&text, options.size, options.seed);
+  write_file(options.file, {text.data, text.size}, true);
+  system_allocator.free(text.allocation);
+
+  RopeEditor editor;
+  editor.buffer = load_rope_buffer(options.file);
+  while (continue_loading(&editor.buffer)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return editor;
+}
+
+// replays a file as typed actions with the Tester, the way the main loop can
+void bench_replay(BenchOptions options)
+{
+  srand(options.seed);
+  Tester tester = create_tester(options.script);
+
+  RopeEditor editor;
+  editor.buffer = create_rope_buffer();
+  fill_rope(&editor.buffer, "");
+
+  CommandStats *stats = new CommandStats();
+  u64 start           = now_ns();
+  i64 frames          = 0;
+  while (tester.spans.size() > 0) {
+    Actions actions;
+    add_actions(&tester, &editor, &actions);
+    for (i32 i = 0; i < actions.size; i++) {
+      run_action(&editor, actions[i], stats);
+    }
+    end_frame(&editor, actions.size == 0);
+    frames++;
+  }
+  f64 total_ms = (now_ns() - start) / 1e6;
+
+  DynamicArray<u8> contents(&system_allocator);
+  String typed = buffer_to_string(editor.buffer, &contents);
+  printf("replay %.*s: %lld frames in %.1f ms, text %s\n", (i32)options.script.size,
+         options.script.data, (long long)frames, total_ms,
+         typed == tester.file ? "matches" : "DOES NOT MATCH");
+  print_command_stats(stats);
+  delete stats;
+}
+
+// random edits, navigation and saves on a generated file
+void bench_synthetic(BenchOptions options)
+{
+  RopeEditor editor = open_generated_file(options);
+  i64 line_count    = count_lines(editor.buffer);
+
+  Platform::set_clipboard("pasted(line, 1);\nand another line\n");
+
+  CommandStats *stats = new CommandStats();
+  u64 random          = options.seed;
+  for (i64 op = 0; op < options.ops; op++) {
+    u64 roll = next_random(&random) % 1000;
+
+    Action action;
+    if (roll < 400) {
+      action = Action((u32)('a' + next_random(&random) % 26));
+    } else if (roll < 450) {
+      action = Action(Command::INPUT_NEWLINE);
+    } else if (roll < 550) {
+      action = Action(Command::INPUT_BACKSPACE);
+    } else if (roll < 630) {
+      action = Action(Command::NAV_CHAR_LEFT);
+    } else if (roll < 710) {
+      action = Action(Command::NAV_CHAR_RIGHT);
+    } else if (roll < 790) {
+      action = Action(Command::NAV_LINE_UP);
+    } else if (roll < 870) {
+      action = Action(Command::NAV_LINE_DOWN);
+    } else if (roll < 910) {
+      action = Action(Command::BUFFER_UNDO);
+    } else if (roll < 930) {
+      action = Action(Command::BUFFER_REDO);
+    } else if (roll < 950) {
+      action = Action(Command::BUFFER_PASTE);
+    } else if (roll < 999) {
+      // a click somewhere else in the file, the window turns it into a cursor
+      i64 line   = next_random(&random) % line_count;
+      i64 column = next_random(&random) % 40;
+
+      Measure measure    = begin_measure();
+      editor.cursor      = cursor_at_point(editor.buffer, line, column);
+      editor.want_column = editor.cursor.column();
+      end_measure(measure, &stats->commands[(i32)Command::MOUSE_LEFT_CLICK]);
+      continue;
+    } else {
+      action = Action(Command::BUFFER_SAVE);
+    }
+
+    run_action(&editor, action, stats);
+    if (op % Actions::MAX_SIZE == 0) {
+      end_frame(&editor, true);
+    }
+  }
+
+  printf("synthetic: %lld ops on %lld MB\n", (long long)options.ops,
+         (long long)(options.size / MB));
+  print_command_stats(stats);
+  delete stats;
+}
+
+// how fill_rope built a rope before it went bottom up, one leaf at a time onto the right
+// edge with a commit and a release each
+BufferRope rope_by_appending_leaves(Summarizer summarizer, String text)
+{
+#if USE_BTREE_ROPE
+  BufferRope rope = create_btree_rope(summarizer);
+#else
+  BufferRope rope = create_rope(summarizer);
+#endif
+  i64 start = summarizer.data->append(text.data, text.size);
+  for (i64 at = 0; at < text.size; at += BUFFER_CHUNK_MAX_SIZE) {
+    Chunk chunk  = {start + at, std::min(text.size - at, BUFFER_CHUNK_MAX_SIZE)};
+    NodeRef leaf = new_leaf(rope, chunk);
+    if (!rope.root.is_valid()) {
+      rope.root = leaf;
+      rope      = commit_builder(rope);
+    } else {
+      BufferRope appended = insert_right(rope, leaf);
+      release(rope);
+      rope = appended;
+    }
+  }
+  return rope;
+}
+
+// fill_rope against appending leaves, at 1 MB, 100 MB and 1 GB as far as --size goes
+void bench_fill_rope(BenchOptions options)
+{
+  DynamicArray<u8> text(&system_allocator);
+  generate_text(&text, std::max(options.size, (i64)MB), options.seed);
+  RopeBuffer buffer = create_rope_buffer();
+
+  printf("fill_rope:\n");
+  for (i64 size : {1 * MB, 100 * MB, 1024 * MB}) {
+    if (size > text.size) break;
+    String contents = {text.data, size};
+
+    u64 start = now_ns();
+    fill_rope(&buffer, contents);
+    f64 balanced    = (now_ns() - start) / 1e9;
+    Summary summary = buffer.rope.get_summary_or_empty();
+    release(buffer.rope);
+
+    buffer.text->clear();
+    start               = now_ns();
+    BufferRope appended = rope_by_appending_leaves(buffer.summarizer, contents);
+    f64 appending       = (now_ns() - start) / 1e9;
+    Summary old_summary = appended.get_summary_or_empty();
+    release(appended);
+    buffer.text->clear();
+
+    assert(summary.size == old_summary.size && summary.newlines == old_summary.newlines);
+    printf("  %5lld MB  bottom up %9.2f ms  appending leaves %9.2f ms  %6.1fx\n",
+           (long long)(size / MB), balanced * 1000, appending * 1000, appending / balanced);
+  }
+  system_allocator.free(text.allocation);
+}
+
+// streaming the text out leaf by leaf, against a cursor_at for every byte on a sample
+void bench_leaf_iter(BenchOptions options)
+{
+  DynamicArray<u8> text(&system_allocator);
+  generate_text(&text, options.size, options.seed);
+  RopeBuffer buffer = create_rope_buffer();
+  fill_rope(&buffer, {text.data, text.size});
+
+  u64 start             = now_ns();
+  u64 sum               = 0;
+  BufferLeafIterator it = leaf_iterator_at(buffer.rope, 0);
+  while (it.is_valid()) {
+    String leaf = leaf_string(buffer, it);
+    for (i64 i = 0; i < leaf.size; i++) sum += leaf.data[i];
+    if (!next_leaf(&it)) break;
+  }
+  f64 leaves = (now_ns() - start) / 1e9;
+
+  DynamicArray<u8> builder(&system_allocator);
+  start           = now_ns();
+  String contents = buffer_to_string(buffer, &builder);
+  f64 flatten     = (now_ns() - start) / 1e9;
+  assert(contents.size == text.size && memcmp(contents.data, text.data, text.size) == 0);
+
+  i64 sample = std::min(text.size, (i64)(2 * MB));
+  u64 check  = 0;
+  start      = now_ns();
+  for (i64 i = 0; i < sample; i++) check += char_at(buffer, cursor_at(buffer, i));
+  f64 per_byte = (now_ns() - start) / 1e9;
+
+  u64 expected = 0;
+  for (i64 i = 0; i < text.size; i++) expected += text.data[i];
+  assert(sum == expected && check > 0);
+
+  printf("leaf iteration over %lld MB:\n", (long long)(text.size / MB));
+  printf("  next_leaf          %6.2f GB/s\n", text.size / leaves / GB);
+  printf("  buffer_to_string   %6.2f GB/s\n", text.size / flatten / GB);
+  printf("  cursor_at per byte %6.3f GB/s  on %lld MB\n", sample / per_byte / GB,
+         (long long)(sample / MB));
+  system_allocator.free(builder.allocation);
+  system_allocator.free(text.allocation);
+}
+
+// the newline kernels and Summarizer::summarize over leaf-sized chunks of the test data,
+// repeated to 16 MB so the timing means something
+void bench_summarize(BenchOptions options)
+{
+  File file;
+  if (!read_file("resources/test/tiny.txt", &system_allocator, &file)) {
+    printf("summarize: couldn't read resources/test/tiny.txt\n");
+    return;
+  }
+  if (file.data.size == 0) {
+    printf("summarize: resources/test/tiny.txt is empty\n");
+    system_allocator.free(file.mem);
+    return;
+  }
+  DynamicArray<u8> text(&system_allocator);
+  while (text.size < 16 * MB) {
+    text.resize(text.size + file.data.size);
+    memcpy(text.data + text.size - file.data.size, file.data.data, file.data.size);
+  }
+  i64 size = text.size;
+
+  struct Kernel {
+    const char *name;
+    CountNewlinesFn count;
+  };
+  Array<Kernel, 4> kernels = {{"scalar", count_newlines_scalar}};
+#if TEXT_X86
+  kernels.push_back({"sse2", count_newlines_sse2});
+  if (__builtin_cpu_supports("avx2")) kernels.push_back({"avx2", count_newlines_avx2});
+#endif
+#if TEXT_NEON
+  kernels.push_back({"neon", count_newlines_neon});
+#endif
+
+  printf("summarize %lld MB of tiny.txt in %lld byte chunks:\n", (long long)(size / MB),
+         (long long)BUFFER_CHUNK_MAX_SIZE);
+  i64 expected = -1;
+  for (u32 k = 0; k < kernels.size; k++) {
+    u64 start    = now_ns();
+    i64 newlines = 0;
+    for (i64 at = 0; at < size; at += BUFFER_CHUNK_MAX_SIZE) {
+      i64 chunk = std::min(BUFFER_CHUNK_MAX_SIZE, size - at);
+      i64 last_newline;
+      newlines += kernels[k].count(text.data + at, chunk, &last_newline);
+    }
+    f64 seconds = (now_ns() - start) / 1e9;
+    if (expected == -1) expected = newlines;
+    assert(newlines == expected);
+    printf("  %-10s %6.2f GB/s\n", kernels[k].name, size / seconds / GB);
+  }
+
+  // the way a mapped file's leaves are summarized, straight out of the original
+  Summarizer summarizer = {};
+  summarizer.original   = {text.data, text.size};
+  u64 start             = now_ns();
+  i64 newlines          = 0;
+  for (i64 at = 0; at < size; at += BUFFER_CHUNK_MAX_SIZE) {
+    Chunk chunk = {ORIGINAL_TEXT_BIT + at, std::min(BUFFER_CHUNK_MAX_SIZE, size - at)};
+    newlines += summarizer.summarize(chunk).newlines;
+  }
+  f64 seconds = (now_ns() - start) / 1e9;
+  assert(newlines == expected);
+  printf("  %-10s %6.2f GB/s\n", "summarize", size / seconds / GB);
+  system_allocator.free(file.mem);
+  system_allocator.free(text.allocation);
+}
+
+// one big paste and many small ones
+void bench_paste(BenchOptions options)
+{
+  DynamicArray<u8> text(&system_allocator);
+  generate_text(&text, options.size, options.seed);
+  DynamicArray<u8> paste(&system_allocator);
+  generate_text(&paste, 10 * MB, options.seed + 1);
+
+  RopeBuffer buffer = create_rope_buffer();
+  fill_rope(&buffer, {text.data, text.size});
+
+  Samples big;
+  Measure measure           = begin_measure();
+  RopeBuffer::Cursor cursor = cursor_at(buffer, text.size / 2);
+  buffer_insert(buffer, cursor, String(paste.data, paste.size));
+  end_measure(measure, &big);
+
+  Samples small;
+  u64 random = options.seed;
+  for (i64 i = 0; i < 1000; i++) {
+    i64 size = buffer.rope.get_summary_or_empty().size;
+    measure  = begin_measure();
+    cursor   = cursor_at(buffer, next_random(&random) % size);
+    buffer_insert(buffer, cursor, "hello world\n");
+    end_measure(measure, &small);
+  }
+
+  printf("paste into %lld MB:\n", (long long)(text.size / MB));
+  print_samples("10 MB paste", &big);
+  print_samples("12 byte paste", &small);
+}
+
+void bench_backspace(BenchOptions options)
+{
+  DynamicArray<u8> text(&system_allocator);
+  generate_text(&text, options.size, options.seed);
+  RopeBuffer buffer = create_rope_buffer();
+  fill_rope(&buffer, {text.data, text.size});
+
+  Samples backspaces;
+  RopeBuffer::Cursor cursor = cursor_at(buffer, text.size / 2 + options.ops / 2);
+  for (i64 i = 0; i < options.ops; i++) {
+    Measure measure = begin_measure();
+    cursor          = buffer_remove(buffer, cursor);
+    end_measure(measure, &backspaces);
+  }
+
+  Samples range;
+  Measure measure = begin_measure();
+  buffer_remove_range(buffer, KB, text.size / 2 - KB);
+  end_measure(measure, &range);
+
+  printf("backspace in %lld MB:\n", (long long)(text.size / MB));
+  print_samples("backspace", &backspaces);
+  print_samples("remove half", &range);
+}
+
+// 64 KB pastes at random places while the buffer grows to 8 times its size. a paste that
+// adds a segment to the text store or the node pool shouldn't take longer than a frame
+void bench_growth(BenchOptions options)
+{
+  DynamicArray<u8> text(&system_allocator);
+  generate_text(&text, options.size, options.seed);
+  DynamicArray<u8> paste(&system_allocator);
+  generate_text(&paste, 64 * KB, options.seed + 1);
+
+  RopeBuffer buffer = create_rope_buffer();
+  fill_rope(&buffer, {text.data, text.size});
+
+  Samples pastes;
+  u64 random             = options.seed;
+  i64 frames_over_budget = 0;
+  while (buffer.rope.get_summary_or_empty().size < 8 * options.size) {
+    i64 size                  = buffer.rope.get_summary_or_empty().size;
+    Measure measure           = begin_measure();
+    RopeBuffer::Cursor cursor = cursor_at(buffer, next_random(&random) % size);
+    buffer_insert(buffer, cursor, String(paste.data, paste.size));
+    end_measure(measure, &pastes);
+
+    if (pastes.nanos.data[pastes.nanos.size - 1] > 16600000) frames_over_budget++;
+  }
+
+  printf("64 KB pastes growing %lld MB to %lld MB, %lld over 16.6 ms:\n",
+         (long long)(options.size / MB), (long long)(8 * options.size / MB),
+         (long long)frames_over_budget);
+  print_samples("64 KB paste", &pastes);
+}
+
+// keys typed at random places, each one cutting up a leaf. how much text the b-tree's
+// copies of the leaves it merges leave behind per key, and what a compaction pass takes
+// to give it back. build_bench.sh builds a bench for each rope to compare them
+void bench_scattered_keys(BenchOptions options)
+{
+  DynamicArray<u8> text(&system_allocator);
+  generate_text(&text, options.size, options.seed);
+  RopeBuffer buffer = create_rope_buffer();
+  fill_rope(&buffer, {text.data, text.size});
+
+  Samples keys;
+  u64 random    = options.seed;
+  i64 text_size = buffer.text->size;
+  for (i64 i = 0; i < options.ops; i++) {
+    i64 size                  = buffer.rope.get_summary_or_empty().size;
+    RopeBuffer::Cursor cursor = cursor_at(buffer, next_random(&random) % size);
+    Measure measure           = begin_measure();
+    buffer_insert(buffer, cursor, 'x');
+    end_measure(measure, &keys);
+  }
+  f64 written = (f64)(buffer.text->size - text_size) / options.ops;
+
+  i64 leaves            = 0;
+  BufferLeafIterator it = leaf_iterator_at(buffer.rope, 0);
+  while (it.is_valid()) {
+    leaves++;
+    if (!next_leaf(&it)) break;
+  }
+
+  // a pass right away, however little there is to give back
+  Samples compaction;
+  buffer.compaction->next_size = 0;
+  Measure measure              = begin_measure();
+  while (continue_compaction(buffer)) continue;
+  end_measure(measure, &compaction);
+
+  printf("%s rope, %lld keys at random places in %lld MB:\n",
+         USE_BTREE_ROPE ? "b-tree" : "avl", (long long)options.ops,
+         (long long)(text.size / MB));
+  print_samples("key", &keys);
+  printf("  %.1f bytes of text written per key, %lld leaves\n", written,
+         (long long)leaves);
+  print_samples("compaction", &compaction);
+  printf("  %lld passes gave back %lld MB\n", (long long)text_stats(buffer).passes,
+         (long long)(text_stats(buffer).reclaimed_bytes / MB));
+}
+
+void bench_hash_map(BenchOptions options)
+{
+  for (i64 count : {1000, 1000000}) {
+    DynamicArray<u64> keys(&system_allocator);
+    keys.resize(count);
+    u64 random = options.seed;
+    for (i64 i = 0; i < count; i++) keys.data[i] = next_random(&random) << 20 | i;
+
+    i64 rounds = std::max(2000000 / count, (i64)2);
+    Samples put, get, miss, remove;
+    Samples std_put, std_get, std_miss, std_remove;
+    for (i64 round = 0; round < rounds; round++) {
+      HashMap<u64, i64> map(&system_allocator);
+      std::unordered_map<u64, i64> std_map;
+      i64 found = 0;
+
+      Measure measure = begin_measure();
+      for (i64 i = 0; i < count; i++) map.put(keys.data[i], i);
+      end_measure(measure, &put);
+      measure = begin_measure();
+      for (i64 i = 0; i < count; i++) found += *map.get(keys.data[i]);
+      end_measure(measure, &get);
+      measure = begin_measure();
+      for (i64 i = 0; i < count; i++) found += map.get(~keys.data[i]) != nullptr;
+      end_measure(measure, &miss);
+      measure = begin_measure();
+      for (i64 i = 0; i < count; i++) map.remove(keys.data[i]);
+      end_measure(measure, &remove);
+
+      measure = begin_measure();
+      for (i64 i = 0; i < count; i++) std_map[keys.data[i]] = i;
+      end_measure(measure, &std_put);
+      measure = begin_measure();
+      for (i64 i = 0; i < count; i++) found += std_map.find(keys.data[i])->second;
+      end_measure(measure, &std_get);
+      measure = begin_measure();
+      for (i64 i = 0; i < count; i++) found += std_map.find(~keys.data[i]) != std_map.end();
+      end_measure(measure, &std_miss);
+      measure = begin_measure();
+      for (i64 i = 0; i < count; i++) std_map.erase(keys.data[i]);
+      end_measure(measure, &std_remove);
+
+      system_allocator.free(map.allocation);
+      assert(found > 0);
+    }
+
+    // each sample is a whole pass, so the percentiles are of passes over count keys
+    printf("hash map, %lld keys, %lld passes:\n", (long long)count, (long long)rounds);
+    print_samples("HashMap put", &put);
+    print_samples("HashMap get", &get);
+    print_samples("HashMap miss", &miss);
+    print_samples("HashMap remove", &remove);
+    print_samples("unordered_map put", &std_put);
+    print_samples("unordered_map get", &std_get);
+    print_samples("unordered_map miss", &std_miss);
+    print_samples("unordered_map remove", &std_remove);
+  }
+}
+
+// extracting a 60 line by 200 column view at the top, middle and end of the file
+void bench_viewport(BenchOptions options)
+{
+  DynamicArray<u8> text(&system_allocator);
+  generate_text(&text, options.size, options.seed);
+
+  RopeBuffer rope = create_rope_buffer();
+  fill_rope(&rope, {text.data, text.size});
+  BasicBuffer basic = create_buffer();
+  fill_buffer(&basic, {text.data, text.size});
+
+  i64 line_count         = count_lines(rope);
+  i64 tops[]             = {0, line_count / 2, std::max(line_count - 60, (i64)0)};
+  const char *names[][2] = {{"rope top", "basic top"},
+                            {"rope middle", "basic middle"},
+                            {"rope end", "basic end"}};
+
+  printf("viewport of %lld MB:\n", (long long)(text.size / MB));
+  for (i32 i = 0; i < 3; i++) {
+    Samples rope_samples, basic_samples;
+    for (i64 frame = 0; frame < 1000; frame++) {
+      Temp tmp;
+      DynamicArray<LineSpan> spans(&tmp);
+
+      Measure measure = begin_measure();
+      visible_lines(rope, tops[i], tops[i] + 60, 200, &spans);
+      end_measure(measure, &rope_samples);
+
+      spans.clear();
+      measure = begin_measure();
+      visible_lines(&basic, tops[i], tops[i] + 60, 200, &spans);
+      end_measure(measure, &basic_samples);
+    }
+    print_samples(names[i][0], &rope_samples);
+    print_samples(names[i][1], &basic_samples);
+  }
+}
+
+// keystrokes and line lookups in the gap buffer, typing in one place and with a jump to
+// a random line every 20 keys
+void bench_basic_buffer(BenchOptions options)
+{
+  DynamicArray<u8> text(&system_allocator);
+  generate_text(&text, std::min(options.size, (i64)(16 * MB)), options.seed);
+
+  printf("basic buffer of %lld MB:\n", (long long)(text.size / MB));
+  for (bool jumping : {false, true}) {
+    BasicBuffer buffer = create_buffer();
+    fill_buffer(&buffer, {text.data, text.size});
+    i64 line_count = count_lines(&buffer);
+
+    Samples keys, lookups;
+    u64 random      = options.seed;
+    TextPoint point = find_position(&buffer, line_count / 2, 10);
+    for (i64 i = 0; i < 20000; i++) {
+      if (jumping && i % 20 == 0) {
+        Measure measure = begin_measure();
+        point           = find_position(&buffer, next_random(&random) % line_count, 10);
+        end_measure(measure, &lookups);
+      }
+
+      Measure measure = begin_measure();
+      if (i % 10 == 9) {
+        point = buffer_remove(&buffer, point);
+      } else {
+        point = buffer_insert(&buffer, point, (u8)'x');
+      }
+      end_measure(measure, &keys);
+    }
+
+    print_samples(jumping ? "keystroke, jumping" : "keystroke, typing", &keys);
+    print_samples("find_position", &lookups);
+  }
+}
+
+// scanning the whole buffer for text that isn't there, with the vector kernels and with
+// the naive byte loop behind the same leaf streaming, then jumping between matches
+void bench_find(BenchOptions options)
+{
+  DynamicArray<u8> text(&system_allocator);
+  generate_text(&text, options.size, options.seed);
+  RopeBuffer buffer = create_rope_buffer();
+  fill_rope(&buffer, {text.data, text.size});
+
+  // a rare first byte, and common bytes that line up often
+  String rare   = "while (true)";
+  String common = "index = the line + 1 ) {";
+
+  printf("find in %lld MB:\n", (long long)(text.size / MB));
+  FindFn kernels[]            = {find_impl, find_scalar};
+  const char *kernel_names[] = {"vector", "naive"};
+  for (i32 k = 0; k < 2; k++) {
+    for (String needle : {rare, common}) {
+      u64 start = now_ns();
+      i64 found = kernels[k](text.data, text.size, needle.data, needle.size);
+      f64 flat  = (now_ns() - start) / 1e9;
+
+      FindFn saved = find_impl;
+      find_impl    = kernels[k];
+      start        = now_ns();
+      found += find_next(buffer, 0, needle);
+      f64 rope  = (now_ns() - start) / 1e9;
+      find_impl = saved;
+
+      assert(found == -2);
+      printf("  %-6s %-26.*s flat %6.2f GB/s  rope %6.2f GB/s\n", kernel_names[k],
+             (i32)needle.size, needle.data, text.size / flat / GB, text.size / rope / GB);
+    }
+  }
+
+  RopeEditor editor;
+  editor.buffer = buffer;
+  Samples next, previous;
+  for (i64 i = 0; i < 1000; i++) {
+    Measure measure = begin_measure();
+    jump_to_match(&editor, "return cursor", true);
+    end_measure(measure, &next);
+  }
+  for (i64 i = 0; i < 1000; i++) {
+    Measure measure = begin_measure();
+    jump_to_match(&editor, "return cursor", false);
+    end_measure(measure, &previous);
+  }
+  print_samples("JUMP_TO_NEXT", &next);
+  print_samples("JUMP_TO_PREVIOUS", &previous);
+}
+
+// counting every match with regex.hpp over the rope and with std::regex over the same
+// text laid out flat, which it needs. the patterns mean the same leftmost-longest and
+// leftmost-first, so the counts agree
+void bench_regex(BenchOptions options)
+{
+  DynamicArray<u8> text(&system_allocator);
+  generate_text(&text, options.size, options.seed);
+  RopeBuffer buffer = create_rope_buffer();
+  fill_rope(&buffer, {text.data, text.size});
+
+  const char *patterns[] = {"return cursor", "\\d+", "if \\( [a-z]+ \\)", "//[^\\n]*",
+                            "[a-z]+_[a-z]+"};
+  printf("regex over %lld MB:\n", (long long)(text.size / MB));
+  for (const char *pattern : patterns) {
+    Regex regex;
+    compile_regex(&regex, {(u8 *)pattern, (i64)strlen(pattern)});
+    u64 start   = now_ns();
+    i64 matches = 0;
+    for_each_regex_match(&regex, buffer, 0, [&](RegexMatch match) {
+      matches++;
+      return true;
+    });
+    f64 dfa = (now_ns() - start) / 1e9;
+    i64 states = regex.forward.states.size + regex.reverse.states.size;
+    free_regex(&regex);
+
+    std::regex std_regex(pattern);
+    start = now_ns();
+    i64 std_matches = std::distance(
+        std::cregex_iterator((char *)text.data, (char *)text.data + text.size, std_regex),
+        std::cregex_iterator());
+    f64 std = (now_ns() - start) / 1e9;
+
+    printf("  %-20s dfa %8.1f MB/s %9lld matches %4lld states  std::regex %6.1f MB/s "
+           "%9lld matches  %5.1fx\n",
+           pattern, text.size / dfa / MB, (long long)matches, (long long)states,
+           text.size / std / MB, (long long)std_matches, std / dfa);
+  }
+
+  // the same count on a snapshot in the background, while this thread waits on it
+  u64 start           = now_ns();
+  RegexSearch *search = start_regex_search(buffer, "\\d+");
+  while (!search->finished.load(std::memory_order_acquire)) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  printf("  background \\d+ %lld matches in %.1f ms\n",
+         (long long)search->match_count.load(), (now_ns() - start) / 1e6);
+  release_regex_search(search);
+}
+
+// typing a query into a search session one key at a time, then typing into the buffer
+// with it open, against searching from scratch on every key
+void bench_search_session(BenchOptions options)
+{
+  DynamicArray<u8> text(&system_allocator);
+  generate_text(&text, options.size, options.seed);
+  RopeEditor editor;
+  editor.buffer = create_rope_buffer();
+  fill_rope(&editor.buffer, {text.data, text.size});
+
+  String query = "return cursor";
+  printf("search session in %lld MB, typing \"%.*s\":\n", (long long)(text.size / MB),
+         (i32)query.size, query.data);
+  // a key only starts the search on the workers when the buffer is big, done is how long
+  // until the matches are in
+  Samples typed, done, scratch;
+  for (i64 i = 1; i <= query.size; i++) {
+    Measure measure = begin_measure();
+    Measure until   = begin_measure();
+    update_search(&editor.search, editor.buffer, query.sub(0, i));
+    end_measure(measure, &typed);
+    wait_for_search(&editor.search);
+    update_search(&editor.search, editor.buffer, query.sub(0, i));
+    end_measure(until, &done);
+
+    measure     = begin_measure();
+    i64 matches = 0;
+    i64 size    = editor.buffer.rope.get_summary_or_empty().size;
+    for_each_match(editor.buffer, 0, size, query.sub(0, i), [&](i64 at) { matches++; });
+    end_measure(measure, &scratch);
+    assert(matches == match_count(&editor.search));
+  }
+  print_samples("query key", &typed);
+  print_samples("query key until done", &done);
+  print_samples("query key from scratch", &scratch);
+
+  // keys typed at random places in the buffer, with the count kept up to date after each
+  Samples edits;
+  u64 random = options.seed;
+  for (i64 i = 0; i < 1000; i++) {
+    Actions actions;
+    actions.push_back(Action((u32)query.data[i % query.size]));
+    if (i % query.size == 0) {
+      i64 size      = editor.buffer.rope.get_summary_or_empty().size;
+      editor.cursor = cursor_at(editor.buffer, next_random(&random) % size);
+    }
+
+    Measure measure = begin_measure();
+    process(&editor, &actions);
+    update_search(&editor.search, editor.buffer, query);
+    end_measure(measure, &edits);
+  }
+  print_samples("INPUT_TEXT + update", &edits);
+
+  i64 matches = 0;
+  for_each_match(editor.buffer, 0, editor.buffer.rope.get_summary_or_empty().size, query,
+                 [&](i64 at) { matches++; });
+  printf("  %lld matches, %lld kept by the session\n", (long long)matches,
+         (long long)match_count(&editor.search));
+  assert(matches == match_count(&editor.search));
+  free_search(&editor.search);
+}
+
+// counting every match on more and more threads, and edits made while it runs
+void bench_parallel_search(BenchOptions options)
+{
+  DynamicArray<u8> text(&system_allocator);
+  generate_text(&text, options.size, options.seed);
+  RopeBuffer buffer = create_rope_buffer();
+  fill_rope(&buffer, {text.data, text.size});
+
+  String needle = "return";
+  i64 expected  = 0;
+  u64 start     = now_ns();
+  for_each_match(buffer, 0, text.size, needle, [&](i64 at) { expected++; });
+  f64 serial = (now_ns() - start) / 1e9;
+
+  printf("parallel search for \"%.*s\" in %lld MB, %d cores:\n", (i32)needle.size,
+         needle.data, (long long)(text.size / MB), worker_count());
+  printf("  serial      %6.2f GB/s\n", text.size / serial / GB);
+  for (i32 threads = 1; threads <= std::max(worker_count(), 4); threads *= 2) {
+    start                  = now_ns();
+    ParallelSearch *search = start_parallel_search(buffer, needle, threads);
+    wait_for_parallel_search(search);
+    f64 seconds = (now_ns() - start) / 1e9;
+    assert(search->match_count.load() == expected);
+    printf("  %2d threads  %6.2f GB/s  %5.2fx\n", threads, text.size / seconds / GB,
+           serial / seconds);
+    release_parallel_search(search);
+  }
+
+  // the editor goes on with newer roots while the snapshot is searched
+  RopeEditor editor;
+  editor.buffer          = buffer;
+  Samples edits;
+  u64 random             = options.seed;
+  ParallelSearch *search = start_parallel_search(buffer, needle);
+  for (i64 i = 0; !search->finished.load() || i < 1000; i++) {
+    Actions actions;
+    actions.push_back(Action((u32)'x'));
+    if (i % 16 == 0) {
+      i64 size      = editor.buffer.rope.get_summary_or_empty().size;
+      editor.cursor = cursor_at(editor.buffer, next_random(&random) % size);
+    }
+    Measure measure = begin_measure();
+    process(&editor, &actions);
+    end_measure(measure, &edits);
+  }
+  wait_for_parallel_search(search);
+  assert(search->match_count.load() == expected);
+  release_parallel_search(search);
+  print_samples("INPUT_TEXT during search", &edits);
+}
+
+struct Benchmark {
+  const char *name;
+  void (*run)(BenchOptions options);
+};
+
+Benchmark benchmarks[] = {
+    {"replay", bench_replay},     {"synthetic", bench_synthetic},
+    {"fill_rope", bench_fill_rope},
+    {"leaf_iter", bench_leaf_iter},
+    {"summarize", bench_summarize},
+    {"paste", bench_paste},       {"backspace", bench_backspace},
+    {"growth", bench_growth},
+    {"scattered_keys", bench_scattered_keys},
+    {"hash_map", bench_hash_map},
+    {"viewport", bench_viewport}, {"basic_buffer", bench_basic_buffer},
+    {"find", bench_find},         {"regex", bench_regex},
+    {"search_session", bench_search_session},
+    {"parallel_search", bench_parallel_search},
+};
+
+int main(i32 argc, char **argv)
+{
+  set_profile_thread_name("bench");
+
+  BenchOptions options;
+  DynamicArray<Benchmark *> selected(&system_allocator);
+  for (i32 i = 1; i < argc; i++) {
+    String arg   = {(u8 *)argv[i], (i64)strlen(argv[i])};
+    bool has_val = i + 1 < argc;
+    if (arg == "--size" && has_val) {
+      options.size = atoll(argv[++i]) * MB;
+    } else if (arg == "--ops" && has_val) {
+      options.ops = atoll(argv[++i]);
+    } else if (arg == "--seed" && has_val) {
+      options.seed = atoll(argv[++i]);
+    } else if (arg == "--script" && has_val) {
+      i++;
+      options.script = {(u8 *)argv[i], (i64)strlen(argv[i])};
+    } else if (arg == "--file" && has_val) {
+      i++;
+      options.file = {(u8 *)argv[i], (i64)strlen(argv[i])};
+    } else if (arg == "--trace" && has_val) {
+      options.trace = argv[++i];
+    } else {
+      Benchmark *found = nullptr;
+      for (Benchmark &benchmark : benchmarks) {
+        if (strcmp(benchmark.name, argv[i]) == 0) found = &benchmark;
+      }
+      if (!found) {
+        fatal("unknown benchmark or option: ", arg);
+      }
+      selected.push_back(found);
+    }
+  }
+  if (selected.size == 0) {
+    for (Benchmark &benchmark : benchmarks) selected.push_back(&benchmark);
+  }
+
+  for (i64 i = 0; i < selected.size; i++) {
+    PROFILE_ZONE(selected[i]->name);
+    selected[i]->run(options);
+  }
+
+  if (options.trace && !export_chrome_trace(options.trace)) {
+    fatal("couldn't write ", options.trace);
+  }
+  return 0;
+}
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <optional>
 
+#include "containers/dynamic_array.hpp"
+#include "containers/gap_buffer.hpp"
 #include "file.hpp"
 #include "memory.hpp"
 #include "string.hpp"
@@ -20,10 +23,23 @@ struct TextPoint {
 
 const TextPoint FILE_START = {0, 0, 0};
 
+// a piece of one visible line. a line is cut off after max_line_bytes and a line the
+// storage splits up comes in several spans, the last span of a line that isn't cut off
+// ends with its '\n'
+struct LineSpan {
+  String text;
+  i64 index;  // of text's first byte
+  i64 line;
+};
+
+// a gap buffer, typing moves the gap to the cursor once and then only fills it. the
+// newline index is split at the same place: newlines before the gap are stored as their
+// index and newlines after it as their distance from the end, so an edit at the gap
+// leaves every other entry alone
 struct BasicBuffer {
-  u8 *data                       = nullptr;
+  GapBuffer<u8> text             = GapBuffer<u8>(&system_allocator, 1024);
+  GapBuffer<i64> newlines        = GapBuffer<i64>(&system_allocator);
   i64 size                       = 0;
-  i64 capacity                   = 0;
   std::optional<String> filename = std::nullopt;
 };
 
@@ -41,6 +57,110 @@ void debug_validate_text_point(BasicBuffer *buffer, TextPoint point)
 #define VALIDATE_POINT(point) debug_validate_text_point(buffer, point)
 
 
+u8 char_at(BasicBuffer *buffer, i64 idx) { return buffer->text[idx]; }
+
+// the index of the nth newline
+i64 newline_at(BasicBuffer *buffer, i64 n)
+{
+  i64 stored = buffer->newlines[n];
+  return n < buffer->newlines.gap_start ? stored : buffer->size - stored;
+}
+
+// moves the gap of the text and of the newline index to idx
+void move_gap(BasicBuffer *buffer, i64 idx)
+{
+  GapBuffer<u8> &text      = buffer->text;
+  GapBuffer<i64> &newlines = buffer->newlines;
+
+  // the newlines the gap passes over switch between index and distance from the end,
+  // which is the same flip both ways
+  i64 split = newlines.gap_start;
+  if (idx < text.gap_start) {
+    while (split > 0 && newline_at(buffer, split - 1) >= idx) split--;
+  } else {
+    while (split < newlines.size() && newline_at(buffer, split) < idx) split++;
+  }
+
+  i64 from = std::min(split, newlines.gap_start);
+  i64 to   = std::max(split, newlines.gap_start);
+  for (i64 n = from; n < to; n++) {
+    newlines[n] = buffer->size - newlines[n];
+  }
+  newlines.move_gap(split);
+  text.move_gap(idx);
+}
+
+// the first newline at or after idx
+i64 newline_after(BasicBuffer *buffer, i64 idx)
+{
+  i64 low  = 0;
+  i64 high = buffer->newlines.size();
+  while (low < high) {
+    i64 mid = (low + high) / 2;
+    if (newline_at(buffer, mid) < idx) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+i64 line_of(BasicBuffer *buffer, i64 idx) { return newline_after(buffer, idx); }
+
+i64 line_count(BasicBuffer *buffer) { return buffer->newlines.size() + 1; }
+
+i64 line_start(BasicBuffer *buffer, i64 line)
+{
+  return line == 0 ? 0 : newline_at(buffer, line - 1) + 1;
+}
+
+// one past the last character of line, its '\n' or the end of the buffer
+i64 line_end(BasicBuffer *buffer, i64 line)
+{
+  return line < buffer->newlines.size() ? newline_at(buffer, line) : buffer->size;
+}
+
+// moves the gap out of [from, to) if it's in the way and returns the range
+String contiguous_range(BasicBuffer *buffer, i64 from, i64 to)
+{
+  VALIDATE_IDX(from);
+  VALIDATE_IDX(to);
+  GapBuffer<u8> &text = buffer->text;
+  if (from < text.gap_start && text.gap_start < to) {
+    move_gap(buffer, text.gap_start - from < to - text.gap_start ? from : to);
+  }
+  return {text.data + text.physical(from), to - from};
+}
+
+String buffer_string(BasicBuffer *buffer) { return contiguous_range(buffer, 0, buffer->size); }
+
+void clear_buffer(BasicBuffer *buffer)
+{
+  buffer->text.clear();
+  buffer->newlines.clear();
+  buffer->size = 0;
+}
+
+// replaces the contents and rebuilds the newline index
+void fill_buffer(BasicBuffer *buffer, String contents)
+{
+  clear_buffer(buffer);
+  buffer->text.insert(0, contents.data, contents.size);
+  buffer->size = contents.size;
+
+  u8 *at  = contents.data;
+  u8 *end = contents.data + contents.size;
+  while (at < end) {
+    u8 *newline = (u8 *)memchr(at, '\n', end - at);
+    if (!newline) break;
+
+    i64 index = newline - contents.data;
+    buffer->newlines.insert(buffer->newlines.gap_start, &index, 1);
+    at = newline + 1;
+  }
+}
+
 BasicBuffer create_buffer()
 {
   BasicBuffer buffer;
@@ -54,124 +174,91 @@ BasicBuffer load_buffer(std::optional<String> filename)
   if (filename) {
     buffer.filename = filename->copy(&system_allocator);
 
+    Temp tmp;
     File file;
-    if (read_file(filename.value(), &tmp_allocator, &file)) {
-      buffer.data = (u8 *)malloc(file.data.size);
-      memcpy(buffer.data, file.data.data, file.data.size);
-      buffer.size     = file.data.size;
-      buffer.capacity = file.data.size;
-
-      return buffer;
+    if (read_file(filename.value(), &tmp, &file)) {
+      fill_buffer(&buffer, file.data);
     }
   }
 
-  buffer.data     = (u8 *)system_allocator.alloc(1024).data;
-  buffer.size     = 0;
-  buffer.capacity = 1024;
   return buffer;
 }
 
 void write_to_disk(BasicBuffer *buffer)
 {
   if (buffer->filename) {
-    write_file(buffer->filename.value(), {buffer->data, buffer->size});
+    write_file(buffer->filename.value(), buffer_string(buffer));
   }
 }
 
 i64 count_lines(BasicBuffer *buffer)
 {
   if (buffer->size == 0) return 0;
-
-  i64 count = 1;
-  for (i64 i = 0; i < buffer->size; i++) {
-    if (buffer->data[i] == '\n') count++;
-  }
-  return count;
+  return line_count(buffer);
 }
 
 i64 count_column(BasicBuffer *buffer, i64 idx)
 {
   VALIDATE_IDX(idx);
-
-  if (idx == 0) return 0;
-
-  i64 column = 1;
-  idx--;
-  while (idx > 0 && buffer->data[idx] != '\n') {
-    column++;
-    idx--;
-  }
-
-  return column;
+  return idx - line_start(buffer, line_of(buffer, idx));
 }
 
 TextPoint get_point(BasicBuffer &buffer, i64 idx)
 {
   TextPoint point;
-
-  for (i64 p = 0; p < buffer.size && p < idx; p++) {
-    if (buffer.data[p] == '\n') {
-      point.line++;
-      point.column = 0;
-    } else {
-      point.column++;
-    }
-  }
-
+  point.index  = std::clamp(idx, (i64)0, buffer.size);
+  point.line   = line_of(&buffer, point.index);
+  point.column = point.index - line_start(&buffer, point.line);
   return point;
 }
 
 TextPoint find_position(BasicBuffer *buffer, i64 line, i64 column)
 {
   if (line < 0) return FILE_START;
+  if (line >= line_count(buffer)) return get_point(*buffer, buffer->size);
 
+  i64 start = line_start(buffer, line);
   TextPoint point;
-  while (point.index < buffer->size) {
-    if (point.line == line && point.column == column) {
-      break;
-    }
-
-    if (buffer->data[point.index] == '\n') {
-      if (point.line == line) {
-        break;
-      }
-
-      point.line++;
-      point.column = 0;
-    } else {
-      point.column++;
-    }
-
-    point.index++;
-  }
-
+  point.line   = line;
+  point.index  = std::min(start + column, line_end(buffer, line));
+  point.column = point.index - start;
   return point;
 }
 
-TextPoint buffer_insert(BasicBuffer *buffer, TextPoint point, u8 character)
+TextPoint buffer_insert(BasicBuffer *buffer, TextPoint point, String span)
 {
   VALIDATE_POINT(point);
 
   TextPoint new_point = point;
-  new_point.index++;
-  new_point.column++;
-  if (character == '\n') {
-    new_point.column = 0;
-    new_point.line++;
+  for (i64 i = 0; i < span.size; i++) {
+    new_point.index++;
+    new_point.column++;
+    if (span.data[i] == '\n') {
+      new_point.column = 0;
+      new_point.line++;
+    }
   }
 
-  if (buffer->size <= buffer->capacity) {
-    buffer->capacity += 128;
-    buffer->data = (u8 *)realloc(buffer->data, buffer->capacity);
+  // every newline after the gap keeps its distance from the end, the span's own go
+  // right before the newline index's gap
+  move_gap(buffer, point.index);
+  buffer->text.insert(point.index, span.data, span.size);
+  buffer->size += span.size;
+  for (i64 i = 0; i < span.size; i++) {
+    if (span.data[i] == '\n') {
+      i64 index = point.index + i;
+      buffer->newlines.insert(buffer->newlines.gap_start, &index, 1);
+    }
   }
-  memcpy(buffer->data + point.index + 1, buffer->data + point.index,
-         buffer->size - point.index);
-  buffer->data[point.index] = character;
-  buffer->size++;
 
   return new_point;
 }
 
+TextPoint buffer_insert(BasicBuffer *buffer, TextPoint point, u8 character)
+{
+  return buffer_insert(buffer, point, String(&character, 1));
+}
+
 TextPoint buffer_remove(BasicBuffer *buffer, TextPoint point)
 {
   VALIDATE_POINT(point);
@@ -179,19 +266,16 @@ TextPoint buffer_remove(BasicBuffer *buffer, TextPoint point)
     return point;
   }
 
-  TextPoint new_point = point;
-  new_point.index--;
-  new_point.column--;
-  if (buffer->data[point.index] == '\n') {
-    new_point.column = count_column(buffer, point.index - 1);
-    new_point.line--;
+  i64 removed = point.index - 1;
+  move_gap(buffer, point.index);
+  if (char_at(buffer, removed) == '\n') {
+    GapBuffer<i64> &newlines = buffer->newlines;
+    newlines.remove(newlines.gap_start - 1, newlines.gap_start);
   }
-
-  memcpy(buffer->data + point.index - 1, buffer->data + point.index,
-         buffer->size - point.index);
+  buffer->text.remove(removed, point.index);
   buffer->size--;
 
-  return new_point;
+  return get_point(*buffer, removed);
 }
 
 TextPoint shift_point_forward(BasicBuffer *buffer, TextPoint point)
@@ -204,7 +288,7 @@ TextPoint shift_point_forward(BasicBuffer *buffer, TextPoint point)
   }
 
   point.column++;
-  if (buffer->data[point.index] == '\n') {
+  if (char_at(buffer, point.index) == '\n') {
     point.column = 0;
     point.line++;
   }
@@ -224,7 +308,7 @@ TextPoint shift_point_backward(BasicBuffer *buffer, TextPoint point)
   }
 
   point.column--;
-  if (buffer->data[next_idx] == '\n') {
+  if (char_at(buffer, next_idx) == '\n') {
     point.column = count_column(buffer, next_idx);
     point.line--;
   }
@@ -234,21 +318,180 @@ TextPoint shift_point_backward(BasicBuffer *buffer, TextPoint point)
   return point;
 }
 
-String get_line_contents(BasicBuffer *buffer, i64 line) {
+String get_line_contents(BasicBuffer *buffer, i64 line)
+{
   assert(line >= 0);
+  if (line >= line_count(buffer)) return contiguous_range(buffer, buffer->size, buffer->size);
+
+  return contiguous_range(buffer, line_start(buffer, line), line_end(buffer, line));
+}
+
+// appends the spans of lines [first_line, last_line], returns the index just past the
+// last one. a line the gap splits comes in two spans
+i64 visible_lines(BasicBuffer *buffer, i64 first_line, i64 last_line, i64 max_line_bytes,
+                  DynamicArray<LineSpan> *spans)
+{
+  GapBuffer<u8> &text = buffer->text;
+
+  i64 end   = find_position(buffer, first_line, 0).index;
+  i64 lines = line_count(buffer);
+  for (i64 line = std::max(first_line, (i64)0); line <= last_line && line < lines; line++) {
+    i64 index = line_start(buffer, line);
+    i64 stop  = std::min(line < lines - 1 ? line_end(buffer, line) + 1 : buffer->size,
+                         index + max_line_bytes);
+    while (index < stop) {
+      i64 length = std::min(stop - index, text.contiguous_from(index));
+      spans->push_back({{text.data + text.physical(index), length}, index, line});
+      index += length;
+    }
+    end = index;
+  }
+  return end;
+}
+
+// the scans the line index replaced, kept to check it against
 
-  TextPoint point = FILE_START;
-  while (point.index < buffer->size && point.line < line) {
-    if (buffer->data[point.index] == '\n') {
+TextPoint scan_point(BasicBuffer *buffer, i64 idx)
+{
+  TextPoint point;
+  for (; point.index < buffer->size && point.index < idx; point.index++) {
+    if (char_at(buffer, point.index) == '\n') {
       point.line++;
+      point.column = 0;
+    } else {
+      point.column++;
     }
-    point.index++;
   }
+  return point;
+}
+
+TextPoint scan_position(BasicBuffer *buffer, i64 line, i64 column)
+{
+  if (line < 0) return FILE_START;
+
+  TextPoint point;
+  while (point.index < buffer->size) {
+    if (point.line == line && point.column == column) {
+      break;
+    }
+
+    if (char_at(buffer, point.index) == '\n') {
+      if (point.line == line) {
+        break;
+      }
+
+      point.line++;
+      point.column = 0;
+    } else {
+      point.column++;
+    }
 
-  String contents = {&buffer->data[point.index], 0};
-  while (point.index < buffer->size && buffer->data[point.index] != '\n') {
     point.index++;
-    contents.size++;
   }
-  return contents;
+
+  return point;
+}
+
+// the scans are linear, so only a sample of the indices and lines is checked against
+// them. the steps are odd so the samples land on different columns as the text changes
+void check_line_index(BasicBuffer *buffer)
+{
+  i64 lines = 1;
+  for (i64 i = 0; i < buffer->size; i++) {
+    if (char_at(buffer, i) == '\n') lines++;
+  }
+  assert(count_lines(buffer) == (buffer->size == 0 ? 0 : lines));
+
+  auto check_index = [&](i64 idx) {
+    TextPoint point = scan_point(buffer, idx);
+    assert(!(get_point(*buffer, idx) != point));
+    assert(count_column(buffer, idx) == point.column);
+  };
+  i64 index_step = buffer->size / 64 | 1;
+  for (i64 idx = 0; idx < buffer->size; idx += index_step) {
+    check_index(idx);
+  }
+  check_index(buffer->size);
+
+  auto check_line = [&](i64 line) {
+    for (i64 column : {0, 1, 5, 1000}) {
+      assert(!(find_position(buffer, line, column) != scan_position(buffer, line, column)));
+    }
+    if (line < 0) return;
+
+    TextPoint start = scan_position(buffer, line, 0);
+    i64 end         = start.index;
+    while (start.line == line && end < buffer->size && char_at(buffer, end) != '\n') end++;
+
+    String contents = get_line_contents(buffer, line);
+    assert(contents.size == end - start.index);
+    for (i64 i = 0; i < contents.size; i++) {
+      assert(contents.data[i] == char_at(buffer, start.index + i));
+    }
+  };
+  i64 line_step = lines / 32 | 1;
+  check_line(-1);
+  for (i64 line = 0; line < lines; line += line_step) {
+    check_line(line);
+  }
+  check_line(lines - 1);
+  check_line(lines);
+}
+
+void buffer_tests()
+{
+  // the same edits on a plain array, to check the gap buffer's contents against
+  DynamicArray<u8> expected(&system_allocator);
+
+  BasicBuffer buffer = create_buffer();
+  check_line_index(&buffer);
+
+  u64 seed = 1;
+  for (i64 i = 0; i < 400; i++) {
+    seed         = seed * 6364136223846793005ull + 1442695040888963407ull;
+    i64 at       = (seed >> 33) % (buffer.size + 1);
+    TextPoint to = get_point(buffer, at);
+
+    String span = "ab\n\ncd\ne";
+    if (seed % 4 == 1) {
+      span = "a";
+      if ((seed >> 20) % 3 == 0) span = "\n";
+    }
+
+    TextPoint moved;
+    if (seed % 4 == 0) {
+      moved = buffer_remove(&buffer, to);
+      if (at > 0) {
+        memmove(expected.data + at - 1, expected.data + at, expected.size - at);
+        expected.size--;
+      }
+    } else {
+      moved = buffer_insert(&buffer, to, span);
+      expected.resize(expected.size + span.size);
+      memmove(expected.data + at + span.size, expected.data + at,
+              expected.size - span.size - at);
+      memcpy(expected.data + at, span.data, span.size);
+    }
+    assert(!(moved != scan_point(&buffer, moved.index)));
+
+    if (i % 50 == 0) {
+      check_line_index(&buffer);
+    }
+  }
+  check_line_index(&buffer);
+
+  String contents = buffer_string(&buffer);
+  assert(contents.size == expected.size);
+  assert(memcmp(contents.data, expected.data, expected.size) == 0);
+
+  // an index built from scratch matches the one kept up to date
+  BasicBuffer filled = create_buffer();
+  fill_buffer(&filled, contents);
+  assert(filled.newlines.size() == buffer.newlines.size());
+  for (i64 n = 0; n < buffer.newlines.size(); n++) {
+    assert(newline_at(&filled, n) == newline_at(&buffer, n));
+  }
+
+  clear_buffer(&buffer);
+  check_line_index(&buffer);
 }
@@ -32,5 +32,14 @@ struct BufferManager {
     RopeBuffer new_buffer = ::create_rope_buffer();
     return &buffers[buffers.push_back(new_buffer)];
   }
+
+  // editors copy a buffer when they open it, so the one here goes on loading too. buffers
+  // are never removed, every slot up to fresh holds one
+  void continue_loading()
+  {
+    for (i64 i = 0; i < buffers.fresh; i++) {
+      ::continue_loading(&buffers[i]);
+    }
+  }
 };
 BufferManager buffer_manager;
\ No newline at end of file
@@ -0,0 +1,653 @@
+#pragma once
+
+#include "containers/dynamic_array.hpp"
+#include "containers/pool.hpp"
+#include "containers/rope.hpp"
+#include "containers/static_stack.hpp"
+
+// A wide-node alternative to the binary Rope. Every leaf sits at the same height, each
+// inner node holds up to BTREE_MAX_CHILDREN children and leaves cover up to
+// BTREE_CHUNK_MAX_SIZE bytes, so a big file has far fewer nodes and a much shallower
+// descent. Ownership works the same way: edits build new nodes in the builder, then
+// commit_builder copies whatever is reachable into the ref-counted pool.
+const i64 BTREE_MAX_CHILDREN   = 8;
+const i64 BTREE_MIN_CHILDREN   = BTREE_MAX_CHILDREN / 2;
+const i64 BTREE_CHUNK_MAX_SIZE = 1024;
+const i64 BTREE_CHUNK_MIN_SIZE = BTREE_CHUNK_MAX_SIZE / 2;
+
+struct BTreeNode {
+  Node::Type type;
+  i32 ref_count   = 0;
+  i32 height      = 0;
+  i32 child_count = 0;
+
+  Summary summary;
+
+  union {
+    NodeRef children[BTREE_MAX_CHILDREN];
+    Chunk data;
+  };
+};
+
+struct BTreeRope {
+  BTreeNode empty = {
+      .type    = Node::Type::LEAF,
+      .summary = {},
+      .data    = {0, 0},
+  };
+  NodeRef root;
+  Pool<BTreeNode> *node_pool;
+  DynamicArray<BTreeNode> *builder;
+  Summarizer summarizer;
+
+  BTreeNode *get_or_empty(NodeRef ref)
+  {
+    return ref.is_valid() ? &(*node_pool)[ref.index] : &empty;
+  }
+  const Summary &get_summary_or_empty() { return get_or_empty(root)->summary; };
+
+  BTreeNode *get(NodeRef ref) { return &(*node_pool)[ref.index]; }
+  BTreeNode *get_during_build(NodeRef ref)
+  {
+    if (ref.is_builder_ref()) {
+      return &(*builder)[ref.for_builder().index];
+    }
+
+    return &(*node_pool)[ref.index];
+  }
+};
+
+BTreeRope create_btree_rope(Summarizer summarizer)
+{
+  BTreeRope rope;
+  rope.root       = NodeRef::invalid();
+  rope.node_pool  = new Pool<BTreeNode>();
+  rope.builder    = new DynamicArray<BTreeNode>(&system_allocator);
+  rope.summarizer = summarizer;
+  return rope;
+}
+
+void fill_stats(BTreeRope rope, BTreeNode *node)
+{
+  Summary summary;
+  i32 height = 0;
+  for (i32 i = 0; i < node->child_count; i++) {
+    BTreeNode *child = rope.get_during_build(node->children[i]);
+    summary          = rope.summarizer.summarize(summary, child->summary);
+    height           = child->height + 1;
+  }
+  node->summary = summary;
+  node->height  = height;
+}
+
+// a copy of a node that stays put while the builder grows. the ref count is left out,
+// other threads releasing their snapshots can be changing it
+BTreeNode read_node(BTreeRope rope, NodeRef ref)
+{
+  BTreeNode *node = rope.get_during_build(ref);
+  BTreeNode copy;
+  copy.type        = node->type;
+  copy.height      = node->height;
+  copy.child_count = node->child_count;
+  copy.summary     = node->summary;
+  memcpy(copy.children, node->children, sizeof(copy.children));
+  return copy;
+}
+
+void increment_ref_count(BTreeRope rope, NodeRef ref)
+{
+  if (!ref.is_valid()) return;
+
+  __atomic_fetch_add(&rope.get(ref)->ref_count, 1, __ATOMIC_RELAXED);
+}
+void release(BTreeRope rope, NodeRef ref)
+{
+  if (!ref.is_valid()) return;
+
+  BTreeNode *node = rope.get(ref);
+  assert(__atomic_load_n(&node->ref_count, __ATOMIC_RELAXED) > 0);
+
+  // snapshots can be released from other threads, whoever drops the last reference frees
+  if (__atomic_sub_fetch(&node->ref_count, 1, __ATOMIC_ACQ_REL) == 0) {
+    if (node->type == Node::Type::NODE) {
+      for (i32 i = 0; i < node->child_count; i++) {
+        release(rope, node->children[i]);
+      }
+    }
+    rope.node_pool->remove(ref.index);
+  }
+}
+void release(BTreeRope rope) { release(rope, rope.root); }
+NodeRef commit_builder(BTreeRope rope, NodeRef ref)
+{
+  if (!ref.is_valid()) return ref;
+
+  if (ref.is_builder_ref()) {
+    BTreeNode node = read_node(rope, ref);
+    if (node.type == Node::Type::NODE) {
+      for (i32 i = 0; i < node.child_count; i++) {
+        node.children[i] = commit_builder(rope, node.children[i]);
+      }
+    }
+    ref = rope.node_pool->push_back(node);
+  }
+  increment_ref_count(rope, ref);
+  return ref;
+}
+BTreeRope commit_builder(BTreeRope rope)
+{
+  rope.root = commit_builder(rope, rope.root);
+  rope.builder->clear();
+  return rope;
+}
+
+NodeRef new_node(BTreeRope rope, NodeRef *children, i64 count)
+{
+  assert(count > 0 && count <= BTREE_MAX_CHILDREN);
+
+  BTreeNode node;
+  node.type        = Node::Type::NODE;
+  node.child_count = count;
+  for (i64 i = 0; i < count; i++) {
+    node.children[i] = children[i];
+  }
+  fill_stats(rope, &node);
+
+  i64 idx = rope.builder->push_back(node);
+  return NodeRef(idx).for_builder();
+}
+NodeRef new_leaf(BTreeRope rope, Chunk chunk)
+{
+  BTreeNode leaf;
+  leaf.type    = Node::Type::LEAF;
+  leaf.data    = chunk;
+  leaf.summary = rope.summarizer.summarize(chunk);
+
+  i64 idx = rope.builder->push_back(leaf);
+  return NodeRef(idx).for_builder();
+}
+
+// builds a tree in O(n) into the rope's pool over text that is already in place, [start,
+// end) in chunk index space, keeping every node at or above the minimum fill.
+// leaf_summaries, if given, holds the summary of each leaf in order, which only lines up
+// when the range is a whole number of chunks
+NodeRef build_over(BTreeRope rope, i64 start, i64 end, i64 chunk_size,
+                   const Summary *leaf_summaries = nullptr)
+{
+  if (end == start) {
+    return NodeRef::invalid();
+  }
+
+  DynamicArray<NodeRef> level(&system_allocator);
+  i64 size       = end - start;
+  i64 leaf_count = (size + chunk_size - 1) / chunk_size;
+  i64 position   = start;
+  for (i64 i = 0; i < leaf_count; i++) {
+    BTreeNode leaf;
+    leaf.type       = Node::Type::LEAF;
+    leaf.ref_count  = 1;
+    leaf.data.index = position;
+    leaf.data.size  = (size * (i + 1)) / leaf_count - (position - start);
+    leaf.summary =
+        leaf_summaries ? leaf_summaries[i] : rope.summarizer.summarize(leaf.data);
+    level.push_back(rope.node_pool->push_back(leaf));
+
+    position += leaf.data.size;
+  }
+
+  while (level.size > 1) {
+    i64 parent_count = (level.size + BTREE_MAX_CHILDREN - 1) / BTREE_MAX_CHILDREN;
+    i64 child        = 0;
+    for (i64 i = 0; i < parent_count; i++) {
+      BTreeNode node;
+      node.type        = Node::Type::NODE;
+      node.ref_count   = 1;
+      node.child_count = (level.size * (i + 1)) / parent_count - child;
+      for (i32 j = 0; j < node.child_count; j++) {
+        node.children[j] = level[child + j];
+      }
+      fill_stats(rope, &node);
+      level[i] = rope.node_pool->push_back(node);
+
+      child += node.child_count;
+    }
+    level.resize(parent_count);
+  }
+
+  NodeRef root = level[(i64)0];
+  system_allocator.free(level.allocation);
+  return root;
+}
+
+BTreeRope btree_rope_over(Summarizer summarizer, i64 start, i64 end, i64 chunk_size)
+{
+  BTreeRope rope = create_btree_rope(summarizer);
+  rope.root      = build_over(rope, start, end, chunk_size);
+  return rope;
+}
+
+// appends text to the summarizer's data and builds a tree over it
+BTreeRope btree_rope_of(Summarizer summarizer, String text)
+{
+  i64 start = summarizer.data->append(text.data, text.size);
+  return btree_rope_over(summarizer, start, start + text.size, BTREE_CHUNK_MAX_SIZE);
+}
+
+bool is_ok_child(BTreeNode *node)
+{
+  if (node->type == Node::Type::LEAF) {
+    return node->data.size >= BTREE_CHUNK_MIN_SIZE;
+  }
+  return node->child_count >= BTREE_MIN_CHILDREN;
+}
+
+// children of both lists have the same height
+NodeRef merge_nodes(BTreeRope rope, NodeRef *left, i64 left_count, NodeRef *right,
+                    i64 right_count)
+{
+  NodeRef children[BTREE_MAX_CHILDREN * 2];
+  i64 count = 0;
+  for (i64 i = 0; i < left_count; i++) children[count++] = left[i];
+  for (i64 i = 0; i < right_count; i++) children[count++] = right[i];
+
+  if (count <= BTREE_MAX_CHILDREN) {
+    return new_node(rope, children, count);
+  }
+
+  i64 split_point = std::min(BTREE_MAX_CHILDREN, count - BTREE_MIN_CHILDREN);
+  NodeRef halves[2];
+  halves[0] = new_node(rope, children, split_point);
+  halves[1] = new_node(rope, children + split_point, count - split_point);
+  return new_node(rope, halves, 2);
+}
+
+// copies text into a fresh run at the end of the data so it can be one chunk
+Chunk append_chunks(BTreeRope rope, Chunk left, Chunk right)
+{
+  SegmentedArray<u8> *data = rope.summarizer.data;
+  Chunk chunk               = {left.index, left.size + right.size};
+
+  // neighbouring indices of the text can still be in different segments
+  bool contiguous = (left.index & ORIGINAL_TEXT_BIT) ||
+                    data->contiguous_from(left.index) >= chunk.size;
+  if (left.index + left.size == right.index && contiguous) {
+    return chunk;
+  }
+
+  chunk.index  = data->append_space(chunk.size);
+  u8 *combined = data->at(chunk.index);
+  memcpy(combined, rope.summarizer.chunk_data(left), left.size);
+  memcpy(combined + left.size, rope.summarizer.chunk_data(right), right.size);
+  return chunk;
+}
+
+// an undersized leaf is copied together with its neighbour, so no leaf is smaller than
+// BTREE_CHUNK_MIN_SIZE for long and an edit writes at most two leaves of text. the text
+// that's left behind is given back by compaction
+NodeRef merge_leaves(BTreeRope rope, NodeRef left, NodeRef right)
+{
+  BTreeNode left_val  = read_node(rope, left);
+  BTreeNode right_val = read_node(rope, right);
+  if (right_val.data.size == 0) return left;
+  if (left_val.data.size == 0) return right;
+
+  if (is_ok_child(&left_val) && is_ok_child(&right_val)) {
+    NodeRef children[2] = {left, right};
+    return new_node(rope, children, 2);
+  }
+
+  Chunk combined = append_chunks(rope, left_val.data, right_val.data);
+  if (combined.size <= BTREE_CHUNK_MAX_SIZE) {
+    return new_leaf(rope, combined);
+  }
+
+  i64 half            = combined.size / 2;
+  NodeRef children[2] = {
+      new_leaf(rope, {combined.index, half}),
+      new_leaf(rope, {combined.index + half, combined.size - half}),
+  };
+  return new_node(rope, children, 2);
+}
+
+NodeRef concatanate(BTreeRope rope, NodeRef left, NodeRef right)
+{
+  if (!left.is_valid()) return right;
+  if (!right.is_valid()) return left;
+
+  BTreeNode left_val  = read_node(rope, left);
+  BTreeNode right_val = read_node(rope, right);
+
+  if (left_val.height < right_val.height) {
+    if (left_val.height == right_val.height - 1 && is_ok_child(&left_val)) {
+      return merge_nodes(rope, &left, 1, right_val.children, right_val.child_count);
+    }
+
+    NodeRef merged       = concatanate(rope, left, right_val.children[0]);
+    BTreeNode merged_val = read_node(rope, merged);
+    if (merged_val.height == right_val.height - 1) {
+      return merge_nodes(rope, &merged, 1, right_val.children + 1,
+                         right_val.child_count - 1);
+    }
+    return merge_nodes(rope, merged_val.children, merged_val.child_count,
+                       right_val.children + 1, right_val.child_count - 1);
+  }
+
+  if (left_val.height > right_val.height) {
+    if (right_val.height == left_val.height - 1 && is_ok_child(&right_val)) {
+      return merge_nodes(rope, left_val.children, left_val.child_count, &right, 1);
+    }
+
+    NodeRef merged = concatanate(rope, left_val.children[left_val.child_count - 1], right);
+    BTreeNode merged_val = read_node(rope, merged);
+    if (merged_val.height == left_val.height - 1) {
+      return merge_nodes(rope, left_val.children, left_val.child_count - 1, &merged, 1);
+    }
+    return merge_nodes(rope, left_val.children, left_val.child_count - 1,
+                       merged_val.children, merged_val.child_count);
+  }
+
+  if (is_ok_child(&left_val) && is_ok_child(&right_val)) {
+    NodeRef children[2] = {left, right};
+    return new_node(rope, children, 2);
+  }
+  if (left_val.type == Node::Type::LEAF) {
+    return merge_leaves(rope, left, right);
+  }
+  return merge_nodes(rope, left_val.children, left_val.child_count, right_val.children,
+                     right_val.child_count);
+}
+
+// collapses roots that only have one child, which split tends to leave behind
+NodeRef trim_root(BTreeRope rope, NodeRef root)
+{
+  while (root.is_valid()) {
+    BTreeNode *root_val = rope.get_during_build(root);
+    if (root_val->type != Node::Type::NODE || root_val->child_count != 1) break;
+    root = root_val->children[0];
+  }
+  return root;
+}
+
+NodeRef split(BTreeRope rope, NodeRef root, i64 index, NodeRef *right_ret)
+{
+  BTreeNode root_val = read_node(rope, root);
+  if (index <= 0) {
+    *right_ret = root;
+    return NodeRef::invalid();
+  }
+  if (index >= root_val.summary.size) {
+    *right_ret = NodeRef::invalid();
+    return root;
+  }
+
+  if (root_val.type == Node::Type::LEAF) {
+    Chunk chunk = root_val.data;
+    *right_ret  = new_leaf(rope, {chunk.index + index, chunk.size - index});
+    return new_leaf(rope, {chunk.index, index});
+  }
+
+  i32 child = 0;
+  while (child < root_val.child_count - 1) {
+    i64 child_size = rope.get_during_build(root_val.children[child])->summary.size;
+    if (index < child_size) break;
+
+    index -= child_size;
+    child++;
+  }
+
+  NodeRef split_child_right;
+  NodeRef split_child_left =
+      split(rope, root_val.children[child], index, &split_child_right);
+
+  NodeRef new_left = NodeRef::invalid();
+  if (child > 0) {
+    new_left = child == 1 ? root_val.children[0] : new_node(rope, root_val.children, child);
+  }
+  new_left = concatanate(rope, new_left, split_child_left);
+
+  i32 right_count   = root_val.child_count - child - 1;
+  NodeRef new_right = NodeRef::invalid();
+  if (right_count > 0) {
+    new_right = right_count == 1 ? root_val.children[child + 1]
+                                 : new_node(rope, root_val.children + child + 1, right_count);
+  }
+  new_right = concatanate(rope, split_child_right, new_right);
+
+  *right_ret = new_right;
+  return new_left;
+}
+BTreeRope split(BTreeRope rope, i64 index, BTreeRope *right_ret)
+{
+  NodeRef new_left_root  = NodeRef::invalid();
+  NodeRef new_right_root = NodeRef::invalid();
+  if (rope.root.is_valid()) {
+    new_left_root = split(rope, rope.root, index, &new_right_root);
+  }
+
+  BTreeRope new_left_rope = rope;
+  new_left_rope.root = commit_builder(rope, trim_root(rope, new_left_root));
+
+  BTreeRope new_right_rope = rope;
+  new_right_rope.root = commit_builder(rope, trim_root(rope, new_right_root));
+
+  rope.builder->clear();
+
+  (*right_ret) = new_right_rope;
+  return new_left_rope;
+}
+
+BTreeRope concatanate(BTreeRope left, BTreeRope right)
+{
+  BTreeRope new_rope = left;
+  new_rope.root      = trim_root(left, concatanate(left, left.root, right.root));
+  new_rope           = commit_builder(new_rope);
+  return new_rope;
+}
+BTreeRope merge(BTreeRope left, BTreeRope right) { return concatanate(left, right); }
+
+BTreeRope insert(BTreeRope rope, NodeRef node, i64 index)
+{
+  NodeRef left  = NodeRef::invalid();
+  NodeRef right = NodeRef::invalid();
+  if (rope.root.is_valid()) {
+    left = split(rope, rope.root, index, &right);
+  }
+
+  BTreeRope new_rope = rope;
+  new_rope.root = concatanate(rope, concatanate(rope, left, node), right);
+  new_rope.root = trim_root(rope, new_rope.root);
+  new_rope      = commit_builder(new_rope);
+  return new_rope;
+}
+BTreeRope insert_right(BTreeRope rope, NodeRef node)
+{
+  BTreeRope new_rope = rope;
+  new_rope.root      = trim_root(rope, concatanate(rope, rope.root, node));
+  new_rope           = commit_builder(new_rope);
+  return new_rope;
+}
+
+// THIS IS A MUTATE
+void restat_for_index(BTreeRope rope, NodeRef root, i64 index)
+{
+  BTreeNode *root_val = rope.get(root);
+
+  if (root_val->type == Node::Type::LEAF) {
+    root_val->summary = rope.summarizer.summarize(root_val->data);
+    return;
+  }
+
+  i32 child = 0;
+  while (child < root_val->child_count - 1) {
+    i64 child_size = rope.get(root_val->children[child])->summary.size;
+    if (index < child_size) break;
+
+    index -= child_size;
+    child++;
+  }
+  restat_for_index(rope, root_val->children[child], index);
+  fill_stats(rope, root_val);
+}
+void restat_for_index(BTreeRope rope, i64 index)
+{
+  restat_for_index(rope, rope.root, index);
+}
+
+bool is_uniquely_owned(BTreeRope rope, i64 index)
+{
+  NodeRef current = rope.root;
+  while (true) {
+    BTreeNode *current_val = rope.get(current);
+    if (__atomic_load_n(&current_val->ref_count, __ATOMIC_ACQUIRE) != 1) return false;
+    if (current_val->type == Node::Type::LEAF) return true;
+
+    i32 child = 0;
+    while (child < current_val->child_count - 1) {
+      i64 child_size = rope.get(current_val->children[child])->summary.size;
+      if (index < child_size) break;
+
+      index -= child_size;
+      child++;
+    }
+    current = current_val->children[child];
+  }
+}
+
+NodeRef leaf_at_index(BTreeRope rope, i64 *index, bool include_end, Summary *before)
+{
+  NodeRef current = rope.root;
+  while (rope.get(current)->type == Node::Type::NODE) {
+    BTreeNode *current_val = rope.get(current);
+
+    i32 child = 0;
+    while (child < current_val->child_count - 1) {
+      BTreeNode *child_val = rope.get(current_val->children[child]);
+      i64 child_size       = child_val->summary.size;
+      if (*index < child_size || (include_end && *index == child_size)) break;
+
+      *index -= child_size;
+      *before = rope.summarizer.summarize(*before, child_val->summary);
+      child++;
+    }
+    current = current_val->children[child];
+  }
+  return current;
+}
+
+NodeRef leaf_at_point(BTreeRope rope, i64 *line, i64 *column, Summary *before)
+{
+  NodeRef current = rope.root;
+  while (rope.get(current)->type == Node::Type::NODE) {
+    BTreeNode *current_val = rope.get(current);
+
+    i32 child = 0;
+    while (child < current_val->child_count - 1) {
+      BTreeNode *child_val = rope.get(current_val->children[child]);
+      i64 child_lines      = child_val->summary.newlines;
+      i64 child_columns    = child_val->summary.last_line_chars;
+      if (*line == child_lines && *column >= child_columns) {
+        *column -= child_columns;
+      } else if (*line <= child_lines) {
+        break;
+      }
+
+      *line -= child_lines;
+      *before = rope.summarizer.summarize(*before, child_val->summary);
+      child++;
+    }
+    current = current_val->children[child];
+  }
+  return current;
+}
+
+/////////////////////////////
+
+struct BTreeLeafIterator {
+  struct Step {
+    NodeRef node;
+    i32 child;
+  };
+
+  BTreeRope rope;
+  StaticStack<Step, 32> path;
+  i64 start = 0;  // index of the first byte of the current leaf
+
+  bool is_valid() { return path.size > 0; }
+  BTreeNode *leaf() { return rope.get(path.top().node); }
+};
+
+BTreeLeafIterator leaf_iterator_at(BTreeRope rope, i64 index)
+{
+  BTreeLeafIterator it;
+  it.rope = rope;
+  if (!rope.root.is_valid()) {
+    return it;
+  }
+
+  NodeRef current = rope.root;
+  while (rope.get(current)->type == Node::Type::NODE) {
+    BTreeNode *current_val = rope.get(current);
+
+    i32 child = 0;
+    while (child < current_val->child_count - 1) {
+      i64 child_size = rope.get(current_val->children[child])->summary.size;
+      if (index < child_size) break;
+
+      index -= child_size;
+      it.start += child_size;
+      child++;
+    }
+    it.path.push_back({current, child});
+    current = current_val->children[child];
+  }
+  it.path.push_back({current, 0});
+
+  return it;
+}
+
+bool next_leaf(BTreeLeafIterator *it)
+{
+  BTreeRope rope = it->rope;
+  i64 start      = it->start + it->leaf()->summary.size;
+  it->path.pop();
+  while (it->path.size > 0 &&
+         it->path.top().child == rope.get(it->path.top().node)->child_count - 1) {
+    it->path.pop();
+  }
+  if (it->path.size == 0) {
+    return false;
+  }
+
+  it->path.top().child++;
+  NodeRef current = rope.get(it->path.top().node)->children[it->path.top().child];
+  while (rope.get(current)->type == Node::Type::NODE) {
+    it->path.push_back({current, 0});
+    current = rope.get(current)->children[0];
+  }
+  it->path.push_back({current, 0});
+  it->start = start;
+  return true;
+}
+
+bool previous_leaf(BTreeLeafIterator *it)
+{
+  BTreeRope rope = it->rope;
+  it->path.pop();
+  while (it->path.size > 0 && it->path.top().child == 0) {
+    it->path.pop();
+  }
+  if (it->path.size == 0) {
+    return false;
+  }
+
+  it->path.top().child--;
+  NodeRef current = rope.get(it->path.top().node)->children[it->path.top().child];
+  while (rope.get(current)->type == Node::Type::NODE) {
+    i32 last = rope.get(current)->child_count - 1;
+    it->path.push_back({current, last});
+    current = rope.get(current)->children[last];
+  }
+  it->path.push_back({current, 0});
+  it->start -= rope.get(current)->summary.size;
+  return true;
+}
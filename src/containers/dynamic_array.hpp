@@ -99,11 +99,8 @@ struct DynamicArray {
       return;
     }
 
-    Mem old_allocation = allocation;
-    allocation         = allocator->alloc(capacity * sizeof(T));
-    memcpy(allocation.data, old_allocation.data, old_allocation.size);
-    allocator->free(old_allocation);
-
+    // lets an arena grow its last allocation in place
+    allocation     = allocator->resize(allocation, capacity * sizeof(T));
     data           = (T *)allocation.data;
     this->capacity = capacity;
   }
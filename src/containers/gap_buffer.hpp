@@ -0,0 +1,114 @@
+#pragma once
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "memory.hpp"
+#include "types.hpp"
+
+// the elements sit at both ends of one allocation with the free space, the gap, between
+// them. inserting and removing at the gap is O(1) and moving the gap costs the distance it
+// moves, so a run of edits close to each other only pays once. a full gap doubles the
+// capacity
+template <typename T>
+struct GapBuffer {
+  T *data       = nullptr;
+  i64 capacity  = 0;
+  i64 gap_start = 0;
+  i64 gap_end   = 0;
+
+  Allocator *allocator = nullptr;
+  Mem allocation       = {};
+
+  GapBuffer(Allocator *allocator, i64 capacity = 64)
+  {
+    this->allocator = allocator;
+    allocation      = allocator->alloc(capacity * sizeof(T));
+    data            = (T *)allocation.data;
+    this->capacity  = capacity;
+    gap_end         = capacity;
+  }
+
+  i64 gap_size() { return gap_end - gap_start; }
+  i64 size() { return capacity - gap_size(); }
+
+  // where element i is in data
+  i64 physical(i64 i) { return i < gap_start ? i : i + gap_size(); }
+
+  T &operator[](i64 i)
+  {
+    assert(i > -1);
+    assert(i < size());
+    return data[physical(i)];
+  }
+
+  // how many elements from i on are contiguous in memory
+  i64 contiguous_from(i64 i) { return i < gap_start ? gap_start - i : size() - i; }
+
+  void move_gap(i64 i)
+  {
+    assert(i > -1);
+    assert(i <= size());
+
+    if (i < gap_start) {
+      i64 count = gap_start - i;
+      memmove(data + gap_end - count, data + i, count * sizeof(T));
+      gap_start -= count;
+      gap_end -= count;
+    } else if (i > gap_start) {
+      i64 count = i - gap_start;
+      memmove(data + gap_start, data + gap_end, count * sizeof(T));
+      gap_start += count;
+      gap_end += count;
+    }
+  }
+
+  // makes the gap hold at least count elements
+  void reserve(i64 count)
+  {
+    if (gap_size() >= count) return;
+
+    i64 new_capacity = std::max(capacity * 2, size() + count);
+    i64 after        = capacity - gap_end;
+
+    allocation = allocator->resize(allocation, new_capacity * sizeof(T));
+    data       = (T *)allocation.data;
+    memmove(data + new_capacity - after, data + gap_end, after * sizeof(T));
+    gap_end  = new_capacity - after;
+    capacity = new_capacity;
+  }
+
+  void insert(i64 i, const T *values, i64 count)
+  {
+    reserve(count);
+    move_gap(i);
+    memcpy(data + gap_start, values, count * sizeof(T));
+    gap_start += count;
+  }
+
+  void remove(i64 from, i64 to)
+  {
+    assert(from <= to);
+    move_gap(to);
+    gap_start = from;
+  }
+
+  // moves the gap out of [from, to) so the range is contiguous, to whichever end is closer
+  T *contiguous(i64 from, i64 to)
+  {
+    assert(from <= to);
+    if (from < gap_start && gap_start < to) {
+      move_gap(gap_start - from < to - gap_start ? from : to);
+    }
+    return data + physical(from);
+  }
+
+  void clear()
+  {
+    gap_start = 0;
+    gap_end   = capacity;
+  }
+
+  void free() { allocator->free(allocation); }
+};
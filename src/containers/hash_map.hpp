@@ -1,5 +1,11 @@
 #pragma once
 
+#include <string.h>
+
+#include "memory.hpp"
+#include "string.hpp"
+#include "types.hpp"
+
 u32 hash(String str)
 {
   u32 hash = 5381;
@@ -11,85 +17,206 @@ u32 hash(String str)
   return hash;
 }
 
-u32 hash(void *ptr)
+// murmur3's finalizer, every bit of the input reaches every bit of the output
+u32 hash(u64 value)
 {
-  return (u64)ptr;
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdull;
+  value ^= value >> 33;
+  value *= 0xc4ceb9fe1a85ec53ull;
+  value ^= value >> 33;
+  return (u32)value;
 }
 
+u32 hash(void *ptr) { return hash((u64)ptr); }
+
+// Open addressing with linear probing and robin hood insertion: an element that is further
+// from its home slot than the one in the slot it probes takes that slot and the other
+// element moves on. That keeps probe lengths short and even, and lets a lookup stop as
+// soon as it sees an element closer to home than the key would be. Removing shifts the
+// following run back one slot instead of leaving a tombstone.
+//
+// Inserting, removing and growing move elements, so pointers returned by get and put only
+// stay valid until the next put or remove.
 template <typename KEY_TYPE, typename VALUE_TYPE>
 struct HashMap {
   struct Element {
     KEY_TYPE key;
     VALUE_TYPE value;
-    bool assigned = false;
+    u32 hash;
+    u32 distance;  // from the home slot plus one, 0 for an empty slot
   };
 
   Element *data = nullptr;
-  i32 capacity  = 0;
+  i64 capacity  = 0;  // always a power of two
+  i64 size      = 0;
 
   Allocator *allocator = nullptr;
   Mem allocation;
 
-  HashMap(Allocator *allocator)
+  HashMap(Allocator *allocator, i64 capacity = 16)
   {
     this->allocator = allocator;
-    grow(1024);
+    grow(capacity);
   }
 
+  i64 home_slot(u32 hash) { return hash & (capacity - 1); }
+
   VALUE_TYPE &operator[](KEY_TYPE key)
   {
-    u32 starting_index = hash(key) % capacity;
-    assert(data[starting_index].assigned && data[starting_index].key == key);
-    return data[starting_index].value;
+    VALUE_TYPE *value = get(key);
+    assert(value);
+    return *value;
   }
 
-  VALUE_TYPE *get(KEY_TYPE key)
+  i64 find(KEY_TYPE key, u32 key_hash)
   {
-    u32 starting_index = hash(key) % capacity;
-    if (data[starting_index].assigned && data[starting_index].key == key) {
-      return &data[starting_index].value;
+    i64 index = home_slot(key_hash);
+    for (u32 distance = 1; distance <= data[index].distance; distance++) {
+      if (data[index].hash == key_hash && data[index].key == key) {
+        return index;
+      }
+      index = (index + 1) & (capacity - 1);
     }
+    return -1;
+  }
 
-    return nullptr;
+  VALUE_TYPE *get(KEY_TYPE key)
+  {
+    i64 index = find(key, hash(key));
+    return index == -1 ? nullptr : &data[index].value;
   }
 
+  // places an element that isn't in the map yet, returns where it ended up
+  Element *insert(Element element)
+  {
+    element.distance = 1;
+
+    Element *placed = nullptr;
+    i64 index       = home_slot(element.hash);
+    while (data[index].distance != 0) {
+      if (data[index].distance < element.distance) {
+        Element displaced = data[index];
+        data[index]       = element;
+        element           = displaced;
+        if (!placed) placed = &data[index];
+      }
+      index = (index + 1) & (capacity - 1);
+      element.distance++;
+    }
+    data[index] = element;
+    return placed ? placed : &data[index];
+  }
+
+  // inserts or replaces the value for key
   VALUE_TYPE *put(KEY_TYPE key, VALUE_TYPE value)
   {
-    u32 starting_index = hash(key) % capacity;
-    assert(!data[starting_index].assigned);
+    u32 key_hash = hash(key);
+    i64 existing = find(key, key_hash);
+    if (existing != -1) {
+      data[existing].value = value;
+      return &data[existing].value;
+    }
 
-    data[starting_index].assigned = true;
-    data[starting_index].key      = key;
-    data[starting_index].value    = value;
+    // stays under 7/8 full
+    if ((size + 1) * 8 > capacity * 7) {
+      grow(capacity * 2);
+    }
+    size++;
 
-    return &data[starting_index].value;
+    Element element;
+    element.key   = key;
+    element.value = value;
+    element.hash  = key_hash;
+    return &insert(element)->value;
   }
 
-  void grow(i32 new_capacity)
+  bool remove(KEY_TYPE key)
   {
-    if (!data) {
-      this->allocation = allocator->alloc(new_capacity * sizeof(Element));
-      this->data       = (Element *)allocation.data;
-      this->capacity   = new_capacity;
+    i64 index = find(key, hash(key));
+    if (index == -1) {
+      return false;
+    }
 
-      memset(this->data, 0, this->capacity * sizeof(Element));
-      return;
+    i64 next = (index + 1) & (capacity - 1);
+    while (data[next].distance > 1) {
+      data[index] = data[next];
+      data[index].distance--;
+      index = next;
+      next  = (next + 1) & (capacity - 1);
     }
+    data[index].distance = 0;
+    size--;
+    return true;
+  }
+
+  void clear()
+  {
+    memset(data, 0, capacity * sizeof(Element));
+    size = 0;
+  }
+
+  void grow(i64 new_capacity)
+  {
+    i64 rounded = 1;
+    while (rounded < new_capacity) rounded *= 2;
 
     Mem old_allocation = allocation;
     Element *old_data  = data;
-    i32 old_capacity   = capacity;
-
-    allocation     = allocator->alloc(new_capacity * sizeof(Element));
-    this->data     = (Element *)allocation.data;
-    this->capacity = new_capacity;
-    memset(this->data, 0, this->capacity * sizeof(Element));
-    for (i32 i = 0; i < old_capacity; i++) {
-      if (old_data[i].assigned) {
-        put(old_data[i].key, old_data[i].value);
-      }
+    i64 old_capacity   = capacity;
+
+    allocation = allocator->alloc(rounded * sizeof(Element));
+    data       = (Element *)allocation.data;
+    capacity   = rounded;
+    memset(data, 0, capacity * sizeof(Element));
+    if (!old_data) {
+      return;
     }
 
+    for (i64 i = 0; i < old_capacity; i++) {
+      if (old_data[i].distance != 0) {
+        insert(old_data[i]);
+      }
+    }
     allocator->free(old_allocation);
   }
-};
\ No newline at end of file
+};
+
+void hash_map_tests()
+{
+  HashMap<u64, i64> map(&system_allocator);
+
+  // sequential keys, so a weak hash would pile them into neighbouring slots
+  i64 count = 10000;
+  for (i64 i = 0; i < count; i++) {
+    map.put(i, i * 2);
+  }
+  assert(map.size == count);
+  for (i64 i = 0; i < count; i++) {
+    assert(*map.get(i) == i * 2);
+  }
+  assert(!map.get(count));
+
+  for (i64 i = 0; i < count; i += 2) {
+    assert(map.remove(i));
+  }
+  assert(!map.remove(0));
+  assert(map.size == count / 2);
+  for (i64 i = 0; i < count; i++) {
+    assert((map.get(i) != nullptr) == (i % 2 == 1));
+  }
+
+  map.put(1, 7);
+  assert(map[1] == 7);
+  assert(map.size == count / 2);
+
+  HashMap<String, i32> names(&system_allocator);
+  names.put("rope_buffer.hpp", 1);
+  names.put("hash_map.hpp", 2);
+  assert(*names.get("rope_buffer.hpp") == 1);
+  assert(*names.get("hash_map.hpp") == 2);
+  assert(!names.get("pool.hpp"));
+
+  system_allocator.free(map.allocation);
+  system_allocator.free(names.allocation);
+}
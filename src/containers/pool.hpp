@@ -1,8 +1,17 @@
 #pragma once
 
+#include <thread>
+
 #include "memory.hpp"
 #include "types.hpp"
 
+// Elements live in segments that double in size and are never moved or freed, so a
+// reference into the pool stays valid while it grows. Elements that were never used are
+// handed out from `fresh` on, so adding a segment doesn't touch its memory. Removed ones
+// go on a lock-free stack, push_back and remove can be called from any thread. Its head
+// packs the first index + 1 in the low 32 bits and a counter in the high 32 bits that
+// changes on every update, so a pop that raced with another pop and push of the same
+// element fails its compare instead of linking in a stale next.
 template <typename T>
 struct Pool {
   struct Element {
@@ -12,75 +21,190 @@ struct Pool {
     };
   };
 
-  Element *data      = nullptr;
-  i64 next_available = -1;
-  i64 capacity       = 0;
+  static const i32 MAX_SEGMENTS = 32;
+
+  Element *segments[MAX_SEGMENTS] = {};
+  i32 segment_count               = 0;
+  i32 first_segment_shift         = 0;
+  u64 free_head                   = 0;
+  i64 fresh                       = 0;
+  i64 capacity                    = 0;
 
   Pool() { init(32); }
   Pool(i64 capacity) { init(capacity); }
 
-  void init(i64 capacity) { resize(capacity); }
+  void init(i64 capacity)
+  {
+    while ((1ll << first_segment_shift) < capacity) first_segment_shift++;
+    add_segment(0);
+  }
 
-  void resize(i64 new_capacity)
+  i64 segment_start(i32 k) { return ((1ll << k) - 1) << first_segment_shift; }
+  Element *element(i64 i)
   {
-    if (!data) {
-      data = (Element *)sys_alloc(new_capacity * sizeof(Element));
-    } else {
-      data = (Element *)sys_realloc(data, new_capacity * sizeof(Element));
-    }
+    i32 k = 63 - __builtin_clzll((u64)(i >> first_segment_shift) + 1);
+    return &segments[k][i - segment_start(k)];
+  }
+
+  void push_free(i64 i)
+  {
+    u64 head = __atomic_load_n(&free_head, __ATOMIC_ACQUIRE);
+    u64 new_head;
+    do {
+      __atomic_store_n(&element(i)->next, (i64)(head & 0xffffffff) - 1, __ATOMIC_RELAXED);
+      new_head = (((head >> 32) + 1) << 32) | (u64)(i + 1);
+    } while (!__atomic_compare_exchange_n(&free_head, &head, new_head, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+  }
+  i64 pop_free()
+  {
+    u64 head = __atomic_load_n(&free_head, __ATOMIC_ACQUIRE);
+    while (true) {
+      i64 index = (i64)(head & 0xffffffff) - 1;
+      if (index < 0) return -1;
 
-    i64 *next_available = &this->next_available;
-    while (*next_available != -1) {
-      next_available = &data[*next_available].next;
+      // the element may be popped and reused under us, the compare catches that
+      i64 next     = __atomic_load_n(&element(index)->next, __ATOMIC_RELAXED);
+      u64 new_head = (((head >> 32) + 1) << 32) | (u64)(next + 1);
+      if (__atomic_compare_exchange_n(&free_head, &head, new_head, true, __ATOMIC_ACQ_REL,
+                                      __ATOMIC_ACQUIRE)) {
+        return index;
+      }
     }
-    *next_available = capacity;
+  }
+  i64 pop_fresh()
+  {
+    i64 index = __atomic_load_n(&fresh, __ATOMIC_RELAXED);
+    while (true) {
+      if (index >= __atomic_load_n(&capacity, __ATOMIC_ACQUIRE)) return -1;
+      if (__atomic_compare_exchange_n(&fresh, &index, index + 1, true, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED)) {
+        return index;
+      }
+    }
+  }
 
-    for (i64 i = capacity; i < new_capacity - 1; i++) {
-      data[i].next = i + 1;
+  // returns false if another thread added segment k first
+  bool add_segment(i32 k)
+  {
+    assert(k < MAX_SEGMENTS);
+    if (__atomic_load_n(&segments[k], __ATOMIC_ACQUIRE)) return false;
+
+    i64 size         = 1ll << (first_segment_shift + k);
+    i64 start        = segment_start(k);
+    Element *segment = (Element *)sys_alloc(size * sizeof(Element));
+    assert(start + size < 0xffffffff);
+
+    Element *expected = nullptr;
+    if (!__atomic_compare_exchange_n(&segments[k], &expected, segment, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      sys_free(segment);
+      return false;
     }
-    data[new_capacity - 1].next = -1;
 
-    capacity = new_capacity;
+    // the capacity goes first. nobody adds segment k + 1 before they see the count, so
+    // its bigger capacity can't be overwritten with this one's
+    __atomic_store_n(&capacity, start + size, __ATOMIC_RELEASE);
+    __atomic_store_n(&segment_count, k + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  void resize(i64 new_capacity)
+  {
+    while (capacity < new_capacity) {
+      add_segment(segment_count);
+    }
   }
 
   T &operator[](i64 i)
   {
     assert(i > -1);
-    assert(i < capacity);
-    return data[i].value;
+    assert(i < __atomic_load_n(&capacity, __ATOMIC_RELAXED));
+    return element(i)->value;
   }
-  T &wrapped_get(i64 i) { return data[i % capacity].value; }
+  T &wrapped_get(i64 i) { return (*this)[i % capacity]; }
 
   i64 push_back(T value)
   {
-    if (next_available == -1) {
-      resize(capacity * 2);
-    };
+    i64 idx = pop_free();
+    if (idx == -1) idx = pop_fresh();
+    while (idx == -1) {
+      // whoever wins the race for the next segment adds it, everyone else retries
+      add_segment(__atomic_load_n(&segment_count, __ATOMIC_ACQUIRE));
+      idx = pop_fresh();
+    }
 
-    i64 idx          = next_available;
-    Element *current = &data[idx];
-    next_available   = current->next;
-    current->value   = value;
+    element(idx)->value = value;
     return idx;
   }
 
-  void remove(i64 i)
+  void remove(i64 i) { push_free(i); }
+
+  i64 index_of(T *ptr)
   {
-    Element *element = &data[i];
-    element->next    = next_available;
-    next_available   = i;
+    for (i32 k = 0; k < segment_count; k++) {
+      i64 offset = (Element *)ptr - segments[k];
+      if (offset >= 0 && offset < (1ll << (first_segment_shift + k))) {
+        return segment_start(k) + offset;
+      }
+    }
+    return -1;
   }
 
-  i64 index_of(T *ptr) { return ((Element *)ptr - data); }
+  // these walk the free list, so nothing can push or pop while they run
 
   i64 count_free()
   {
-    i64 count = 0;
-    i64 next  = next_available;
+    i64 count = capacity - fresh;
+    i64 next  = (i64)(free_head & 0xffffffff) - 1;
     while (next != -1) {
       count++;
-      next = data[next].next;
+      next = element(next)->next;
     }
     return count;
   }
+
+  void mark_free(b8 *is_free)
+  {
+    for (i64 i = fresh; i < capacity; i++) {
+      is_free[i] = true;
+    }
+    i64 next = (i64)(free_head & 0xffffffff) - 1;
+    while (next != -1) {
+      is_free[next] = true;
+      next          = element(next)->next;
+    }
+  }
 };
+
+void pool_tests()
+{
+  // threads race to add segments to a pool that starts out with room for one, and
+  // everything any of them pushed has to stay in range and hold its value
+  const i32 THREAD_COUNT = 4;
+  const i64 PUSH_COUNT   = 2000;
+
+  Mem indices = system_allocator.alloc(THREAD_COUNT * PUSH_COUNT * sizeof(i64));
+  i64 *pushed = (i64 *)indices.data;
+  for (i32 round = 0; round < 8; round++) {
+    Pool<i64> pool(1);
+    std::thread threads[THREAD_COUNT];
+    for (i32 t = 0; t < THREAD_COUNT; t++) {
+      threads[t] = std::thread([&, t]() {
+        for (i64 i = t * PUSH_COUNT; i < (t + 1) * PUSH_COUNT; i++) {
+          pushed[i] = pool.push_back(i);
+          assert(pool[pushed[i]] == i);  // even while the others are still growing it
+        }
+      });
+    }
+    for (i32 t = 0; t < THREAD_COUNT; t++) threads[t].join();
+
+    assert(pool.capacity >= THREAD_COUNT * PUSH_COUNT);
+    assert(pool.count_free() == pool.capacity - THREAD_COUNT * PUSH_COUNT);
+    for (i64 i = 0; i < THREAD_COUNT * PUSH_COUNT; i++) {
+      assert(pool[pushed[i]] == i);
+    }
+    for (i32 k = 0; k < pool.segment_count; k++) sys_free(pool.segments[k]);
+  }
+  system_allocator.free(indices);
+}
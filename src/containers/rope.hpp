@@ -1,6 +1,8 @@
 #pragma once
 
 #include "containers/pool.hpp"
+#include "containers/segmented_array.hpp"
+#include "containers/static_stack.hpp"
 #include "string.hpp"
 
 const i64 CHUNK_MAX_SIZE = 64;
@@ -15,8 +17,15 @@ struct Summary {
   i64 last_line_chars = 0;
 };
 
+// chunks with this bit set in their index point into the summarizer's original text
+// (e.g. a mapped file) instead of its data
+const i64 ORIGINAL_TEXT_BIT = 1ll << 62;
+
 struct Summarizer {
-  DynamicArray<u8> *data;
+  SegmentedArray<u8> *data;
+  String original = {};
+
+  u8 *chunk_data(const Chunk &chunk);
 
   // void accumulate(Summary *summary, u8 c);
   // void accumulate_eof(Summary *summary);
@@ -73,8 +82,8 @@ struct Node {
 struct Rope {
   Node empty = {
       .type    = Node::Type::LEAF,
-      .depth   = 0,
       .summary = {},
+      .depth   = 0,
       .data    = {0, 0},
   };
   NodeRef root;
@@ -123,17 +132,17 @@ void increment_ref_count(Rope rope, NodeRef ref)
   if (!ref.is_valid()) return;
 
   Node *node = rope.get(ref);
-  node->ref_count++;
+  __atomic_fetch_add(&node->ref_count, 1, __ATOMIC_RELAXED);
 }
 void release(Rope rope, NodeRef ref)
 {
   if (!ref.is_valid()) return;
 
   Node *node = rope.get(ref);
-  assert(node->ref_count > 0);
+  assert(__atomic_load_n(&node->ref_count, __ATOMIC_RELAXED) > 0);
 
-  node->ref_count--;
-  if (node->ref_count == 0) {
+  // snapshots can be released from other threads, whoever drops the last reference frees
+  if (__atomic_sub_fetch(&node->ref_count, 1, __ATOMIC_ACQ_REL) == 0) {
     if (node->type == Node::Type::NODE) {
       release(rope, node->children.left);
       release(rope, node->children.right);
@@ -321,35 +330,66 @@ Rope insert_right(Rope rope, NodeRef node)
   return new_rope;
 }
 
-// Rope rope_of(String text)
-// {
-//   Rope rope;
-//   rope.node_pool = new Pool<Node>(32);
-//   rope.builder   = new DynamicArray<Node>(&system_allocator);
-//   rope.root      = NodeRef::invalid();
-//   rope.summarizer =
-
-//   i64 next_position = 0;
-//   while (next_position < text.size) {
-//     Chunk chunk;
-//     chunk.index  = next_position;
-//     chunk.size   = std::min(text.size - next_position, CHUNK_MAX_SIZE);
-//     NodeRef leaf = new_leaf(rope, chunk);
-
-//     if (!rope.root.is_valid()) {
-//       rope.root = leaf;
-//       rope      = commit_builder(rope);
-//     } else {
-//       Rope new_rope = insert_right(rope, leaf);
-//       release(rope);
-//       rope = new_rope;
-//     }
-
-//     next_position += chunk.size;
-//   }
-
-//   return rope;
-// };
+// builds a perfectly balanced tree bottom-up, writing straight into the node pool
+NodeRef build_balanced(Rope rope, i64 start, i64 end, i64 chunk_size,
+                       const Summary *leaf_summaries, i64 first_leaf, i64 leaf_count)
+{
+  Node node;
+  node.ref_count = 1;
+
+  if (leaf_count == 1) {
+    node.type       = Node::Type::LEAF;
+    node.depth      = 0;
+    node.data.index = start + first_leaf * chunk_size;
+    node.data.size  = std::min(end - node.data.index, chunk_size);
+    node.summary    = leaf_summaries ? leaf_summaries[first_leaf]
+                                     : rope.summarizer.summarize(node.data);
+    return rope.node_pool->push_back(node);
+  }
+
+  i64 left_count      = leaf_count / 2;
+  node.type           = Node::Type::NODE;
+  node.children.left  = build_balanced(rope, start, end, chunk_size, leaf_summaries,
+                                       first_leaf, left_count);
+  node.children.right = build_balanced(rope, start, end, chunk_size, leaf_summaries,
+                                       first_leaf + left_count, leaf_count - left_count);
+  fill_stats(rope, &node);
+  return rope.node_pool->push_back(node);
+}
+
+// builds a tree into the rope's pool over text that is already in place, [start, end) in
+// chunk index space. leaf_summaries, if given, holds the summary of each leaf in order
+NodeRef build_over(Rope rope, i64 start, i64 end, i64 chunk_size,
+                   const Summary *leaf_summaries = nullptr)
+{
+  if (end == start) {
+    return NodeRef::invalid();
+  }
+
+  i64 leaf_count = (end - start + chunk_size - 1) / chunk_size;
+  return build_balanced(rope, start, end, chunk_size, leaf_summaries, 0, leaf_count);
+}
+
+Rope rope_over(Summarizer summarizer, i64 start, i64 end, i64 chunk_size)
+{
+  Rope rope = create_rope(summarizer);
+
+  i64 leaf_count = (end - start + chunk_size - 1) / chunk_size;
+  i64 node_count = leaf_count * 2 - 1;
+  if (rope.node_pool->capacity < node_count) {
+    rope.node_pool->resize(node_count);
+  }
+
+  rope.root = build_over(rope, start, end, chunk_size);
+  return rope;
+}
+
+// appends text to the summarizer's data and builds a rope over it in O(n)
+Rope rope_of(Summarizer summarizer, String text)
+{
+  i64 start = summarizer.data->append(text.data, text.size);
+  return rope_over(summarizer, start, start + text.size, CHUNK_MAX_SIZE);
+}
 
 // TODO this creates empty nodes if the index is at the beginning or end of a chunk
 NodeRef split(Rope rope, NodeRef root, i64 index, NodeRef *right_ret)
@@ -427,31 +467,6 @@ Rope split(Rope rope, i64 index, Rope *right_ret)
   return new_left_rope;
 }
 
-NodeRef merge(Rope rope, NodeRef left, NodeRef right)
-{
-  if (!left.is_valid()) return right;
-  if (!right.is_valid()) return left;
-
-  Node *right_val = rope.get_during_build(right);
-  if (right_val->type == Node::Type::LEAF) {
-    NodeRef new_ref = insert_right(rope, left, right);
-    return new_ref;
-  }
-
-  NodeRef merged_left  = merge(rope, left, right_val->children.left);
-  NodeRef merged_right = merge(rope, merged_left, right_val->children.right);
-  return merged_right;
-}
-Rope merge(Rope left, Rope right)
-{
-  NodeRef new_root = merge(left, left.root, right.root);
-
-  Rope new_rope = left;
-  new_rope.root = new_root;
-  new_rope      = commit_builder(new_rope);
-  return new_rope;
-}
-
 NodeRef concatanate_left(Rope rope, NodeRef left, NodeRef right)
 {
   if (get_balance(rope, left, right) >= -1) {
@@ -494,6 +509,7 @@ Rope concatanate(Rope left, Rope right)
   new_rope      = commit_builder(new_rope);
   return new_rope;
 }
+Rope merge(Rope left, Rope right) { return concatanate(left, right); }
 
 // THIS IS A MUTATE
 void restat_for_index(Rope rope, NodeRef root, i64 index)
@@ -515,6 +531,154 @@ void restat_for_index(Rope rope, NodeRef root, i64 index)
 }
 void restat_for_index(Rope rope, i64 index) { restat_for_index(rope, rope.root, index); }
 
+// whether every node on the path restat_for_index takes is held exactly once, so it can be
+// mutated without changing another rope that shares it
+bool is_uniquely_owned(Rope rope, i64 index)
+{
+  NodeRef current = rope.root;
+  while (true) {
+    Node *current_val = rope.get(current);
+    if (__atomic_load_n(&current_val->ref_count, __ATOMIC_ACQUIRE) != 1) return false;
+    if (current_val->type == Node::Type::LEAF) return true;
+
+    i64 left_size = rope.get(current_val->children.left)->summary.size;
+    if (index < left_size) {
+      current = current_val->children.left;
+    } else {
+      index -= left_size;
+      current = current_val->children.right;
+    }
+  }
+}
+
+// descends to the leaf holding index, leaving index relative to that leaf and adding
+// everything before it to before. with include_end, an index on the boundary between
+// two leaves resolves to the earlier one.
+NodeRef leaf_at_index(Rope rope, i64 *index, bool include_end, Summary *before)
+{
+  NodeRef current = rope.root;
+  while (rope.get(current)->type == Node::Type::NODE) {
+    Node *current_val = rope.get(current);
+    Node *left        = rope.get(current_val->children.left);
+    i64 left_size     = left->summary.size;
+    if (*index < left_size || (include_end && *index == left_size)) {
+      current = current_val->children.left;
+    } else {
+      *index -= left_size;
+      *before = rope.summarizer.summarize(*before, left->summary);
+      current = current_val->children.right;
+    }
+  }
+  return current;
+}
+
+// descends to the leaf holding the point, leaving line and column relative to that leaf
+NodeRef leaf_at_point(Rope rope, i64 *line, i64 *column, Summary *before)
+{
+  NodeRef current = rope.root;
+  while (rope.get(current)->type == Node::Type::NODE) {
+    Node *current_val = rope.get(current);
+    Node *left        = rope.get(current_val->children.left);
+    i64 left_lines    = left->summary.newlines;
+    i64 left_columns  = left->summary.last_line_chars;
+    if (*line == left_lines && *column >= left_columns) {
+      *line -= left_lines;
+      *column -= left_columns;
+      *before = rope.summarizer.summarize(*before, left->summary);
+      current = current_val->children.right;
+    } else if (*line <= left_lines) {
+      current = current_val->children.left;
+    } else {
+      *line -= left_lines;
+      *before = rope.summarizer.summarize(*before, left->summary);
+      current = current_val->children.right;
+    }
+  }
+  return current;
+}
+
+/////////////////////////////
+
+// walks the leaves in order, keeping the path from the root so stepping to a
+// neighbouring leaf doesn't need a fresh descent
+struct LeafIterator {
+  Rope rope;
+  StaticStack<NodeRef, 96> path;
+  i64 start = 0;  // index of the first byte of the current leaf
+
+  bool is_valid() { return path.size > 0; }
+  Node *leaf() { return rope.get(path.top()); }
+};
+
+LeafIterator leaf_iterator_at(Rope rope, i64 index)
+{
+  LeafIterator it;
+  it.rope = rope;
+  if (!rope.root.is_valid()) {
+    return it;
+  }
+
+  NodeRef current = rope.root;
+  it.path.push_back(current);
+  while (rope.get(current)->type == Node::Type::NODE) {
+    Node *current_val = rope.get(current);
+    Node *left        = rope.get(current_val->children.left);
+    if (index < left->summary.size) {
+      current = current_val->children.left;
+    } else {
+      index -= left->summary.size;
+      it.start += left->summary.size;
+      current = current_val->children.right;
+    }
+    it.path.push_back(current);
+  }
+
+  return it;
+}
+
+bool next_leaf(LeafIterator *it)
+{
+  Rope rope   = it->rope;
+  i64 start   = it->start + it->leaf()->summary.size;
+  NodeRef ref = it->path.pop();
+  while (it->path.size > 0 && rope.get(it->path.top())->children.right.index == ref.index) {
+    ref = it->path.pop();
+  }
+  if (it->path.size == 0) {
+    return false;
+  }
+
+  NodeRef current = rope.get(it->path.top())->children.right;
+  it->path.push_back(current);
+  while (rope.get(current)->type == Node::Type::NODE) {
+    current = rope.get(current)->children.left;
+    it->path.push_back(current);
+  }
+  it->start = start;
+  return true;
+}
+
+bool previous_leaf(LeafIterator *it)
+{
+  Rope rope   = it->rope;
+  NodeRef ref = it->path.pop();
+  while (it->path.size > 0 && rope.get(it->path.top())->children.left.index == ref.index) {
+    ref = it->path.pop();
+  }
+  if (it->path.size == 0) {
+    return false;
+  }
+
+  NodeRef current = rope.get(it->path.top())->children.left;
+  it->path.push_back(current);
+  while (rope.get(current)->type == Node::Type::NODE) {
+    current = rope.get(current)->children.right;
+    it->path.push_back(current);
+  }
+  it->start -= rope.get(current)->summary.size;
+  return true;
+}
+
 /////////////////////////////
 
 void test_rope() {}
\ No newline at end of file
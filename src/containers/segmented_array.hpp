@@ -0,0 +1,96 @@
+#pragma once
+
+#include <string.h>
+
+#include "memory.hpp"
+#include "types.hpp"
+
+// an append-only array that grows by adding segments that double in size instead of
+// copying what's there, so pointers into it stay valid and growing never stalls on a big
+// copy. a span is only contiguous within one segment, so append places each span in a
+// single segment and skips what's left of the last one when the span doesn't fit
+template <typename T>
+struct SegmentedArray {
+  static const i32 MAX_SEGMENTS = 40;
+
+  Mem segments[MAX_SEGMENTS] = {};
+  i32 first_segment_shift    = 0;
+  i64 size                   = 0;  // one past the last element, counting skipped space
+
+  Allocator *allocator = nullptr;
+
+  SegmentedArray(Allocator *allocator, i64 first_segment_size = 4 * KB)
+  {
+    this->allocator = allocator;
+    while ((1ll << first_segment_shift) < first_segment_size) first_segment_shift++;
+  }
+
+  i64 segment_start(i32 k) { return ((1ll << k) - 1) << first_segment_shift; }
+  i64 segment_end(i32 k) { return segment_start(k + 1); }
+  i32 segment_of(i64 i) { return 63 - __builtin_clzll((u64)(i >> first_segment_shift) + 1); }
+
+  T *at(i64 i)
+  {
+    i32 k = segment_of(i);
+    assert(segments[k].data);
+    return (T *)segments[k].data + (i - segment_start(k));
+  }
+  T &operator[](i64 i)
+  {
+    assert(i > -1);
+    assert(i < size);
+    return *at(i);
+  }
+
+  // how many elements from i on are contiguous in memory
+  i64 contiguous_from(i64 i) { return segment_end(segment_of(i)) - i; }
+
+  // whether count elements can go right after the last one in the same segment
+  bool can_extend(i64 count)
+  {
+    return size > 0 && size + count <= segment_end(segment_of(size - 1));
+  }
+
+  // makes room for count contiguous elements past the end, returns the index of the first
+  i64 append_space(i64 count)
+  {
+    if (count == 0) return size;
+
+    i64 start = size;
+    i32 k     = segment_of(start);
+    if (start + count > segment_end(k)) {
+      k++;
+      while (segment_end(k) - segment_start(k) < count) k++;
+      start = segment_start(k);
+    }
+    assert(k < MAX_SEGMENTS);
+
+    if (!segments[k].data) {
+      segments[k] = allocator->alloc((segment_end(k) - segment_start(k)) * sizeof(T));
+    }
+    size = start + count;
+    return start;
+  }
+  i64 append(const T *values, i64 count)
+  {
+    i64 start = append_space(count);
+    if (count > 0) {
+      memcpy(at(start), values, count * sizeof(T));
+    }
+    return start;
+  }
+  i64 push_back(T value) { return append(&value, 1); }
+
+  void clear() { size = 0; }
+
+  void free_segments()
+  {
+    for (i32 k = 0; k < MAX_SEGMENTS; k++) {
+      if (segments[k].data) {
+        allocator->free(segments[k]);
+        segments[k] = {};
+      }
+    }
+    size = 0;
+  }
+};
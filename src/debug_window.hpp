@@ -214,9 +214,7 @@ void draw(DebugWindow *window, Draw::List *dl, Rect4f target_rect)
   i32 next_rect_i = 0;
   auto next_rect  = [&]() { return &rects[next_rect_i++]; };
 
-  String find_buffer_string;
-  find_buffer_string.data = window->find_input.buffer->data;
-  find_buffer_string.size = window->find_input.buffer->size;
+  String find_buffer_string = buffer_string(window->find_input.buffer);
 
   // handle the mouse position here, and interaaction later
 
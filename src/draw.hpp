@@ -4,6 +4,7 @@
 #include "font.hpp"
 #include "gpu/gpu.hpp"
 #include "math/math.hpp"
+#include "profiler.hpp"
 #include "types.hpp"
 
 namespace Draw
@@ -447,6 +448,8 @@ void init_draw_system(List *dl, Gpu::Device *gpu)
 
 void start_frame(List *dl, Vec2f canvas_size)
 {
+  PROFILE_FUNCTION();
+
   dl->vert_count = 0;
   dl->draw_calls.clear();
   dl->max_z = -1;
@@ -472,6 +475,8 @@ void start_frame(List *dl, Vec2f canvas_size)
 
 void end_frame(List *dl, Gpu::Device *gpu, u64 frame)
 {
+  PROFILE_FUNCTION();
+
   dl->primitives.canvas_size = Vec4f{dl->canvas_size.x, dl->canvas_size.y, 0, 0};
 
   if (dl->frame != frame) {
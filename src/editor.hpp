@@ -38,16 +38,15 @@ void handle_action(Editor *editor, Action *action)
     i64 start = std::min(editor->cursor.index - 1, editor->anchor.index);
     i64 end   = std::max(editor->cursor.index - 1, editor->anchor.index);
 
-    String copy_str;
-    copy_str.data = editor->buffer->data + start;
-    copy_str.size = end - start + 1;
+    // the cursor at the start or the anchor at the end reach one past the text
+    start           = std::max(start, (i64)0);
+    end             = std::min(end + 1, editor->buffer->size);
+    String copy_str = contiguous_range(editor->buffer, start, end);
     Platform::set_clipboard(copy_str);
   }
   if (eat(action, Command::BUFFER_PASTE)) {
     String paste_str = Platform::get_clipboard();
-    for (i32 i = 0; i < paste_str.size; i++) {
-      editor->cursor = buffer_insert(editor->buffer, editor->cursor, paste_str.data[i]);
-    }
+    editor->cursor   = buffer_insert(editor->buffer, editor->cursor, paste_str);
   }
 
   if (eat(action, Command::NAV_LINE_DOWN)) {
@@ -69,7 +68,7 @@ void handle_action(Editor *editor, Action *action)
   if (eat(action, Command::NAV_WORD_LEFT)) {
     bool seen_word = false;
     while (editor->cursor.index > 0) {
-      if (!std::isspace(editor->buffer->data[editor->cursor.index - 1])) {
+      if (!std::isspace(char_at(editor->buffer, editor->cursor.index - 1))) {
         seen_word = true;
       } else if (seen_word) {
         break;
@@ -81,7 +80,7 @@ void handle_action(Editor *editor, Action *action)
   if (eat(action, Command::NAV_WORD_RIGHT)) {
     bool seen_word = false;
     while (editor->cursor.index < editor->buffer->size) {
-      if (!std::isspace(editor->buffer->data[editor->cursor.index])) {
+      if (!std::isspace(char_at(editor->buffer, editor->cursor.index))) {
         seen_word = true;
       } else if (seen_word) {
         break;
@@ -138,54 +137,67 @@ void draw_editor(Editor &editor, Draw::List *dl, Rect4f target_rect, ViewRange v
   Font &font          = dl->font;
   f32 space_width     = font.glyphs_zero[' '].advance.x;
 
-  Vec2f pos = {
+  Vec2f origin = {
       target_rect.x + view_range.text_offset.x * space_width,
       target_rect.y + view_range.text_offset.y * font.height,
   };
-  i64 idx  = find_position(buffer, view_range.top_line, 0).index;
-  i64 line = view_range.top_line;
-  while (line <= view_range.last_line) {
-    Color cursor_color = focused ? settings.activated_color : settings.deactivated_color;
-    if (idx == editor.anchor.index) {
+  Color cursor_color = focused ? settings.activated_color : settings.deactivated_color;
+  auto draw_marks    = [&](i64 index, Vec2f pos) {
+    if (index == editor.anchor.index) {
       Rect4f fill_rect   = {pos.x, pos.y - font.descent, space_width, font.height};
       Rect4f border_rect = inset(fill_rect, -2.f);
       Draw::push_rounded_rect(dl, 0, border_rect, 3, cursor_color);
       Draw::push_rounded_rect(dl, 0, fill_rect, 3, Color(40, 44, 52));
     }
-    if (idx == editor.cursor.index) {
+    if (index == editor.cursor.index) {
       Rect4f cursor_rect = {pos.x, pos.y - font.descent, space_width, font.height};
       Draw::push_rounded_rect(dl, 0, cursor_rect, 1, cursor_color);
     }
+  };
 
-    if (idx >= buffer->size) {
-      break;
+  Temp tmp;
+  DynamicArray<LineSpan> spans(&tmp);
+  i64 end = visible_lines(buffer, view_range.top_line, view_range.last_line,
+                          view_range.num_columns, &spans);
+
+  Vec2f pos      = origin;
+  i64 first_line = spans.size > 0 ? spans[0].line : 0;
+  for (i64 i = 0; i < spans.size; i++) {
+    LineSpan span = spans[i];
+    if (i > 0 && span.line != spans[i - 1].line) {
+      pos = {origin.x, origin.y + (span.line - first_line) * font.height};
     }
 
-    u8 c = buffer->data[idx];
-    if (c == '\n') {
-      pos.y += font.height;
-      pos.x = target_rect.x;
-      line++;
-    } else if (c == '\t') {
-      pos.x += 2 * space_width;
-    } else if (c == ' ') {
-      pos.x += space_width;
-    } else {
-      if ((i32)c >= font.glyphs_zero.size) {
-        c = 0;
+    for (i64 j = 0; j < span.text.size; j++) {
+      i64 index = span.index + j;
+      draw_marks(index, pos);
+
+      u8 c = span.text.data[j];
+      if (c == '\n') {
+        pos.y += font.height;
+        pos.x = origin.x;
+      } else if (c == '\t') {
+        pos.x += 2 * space_width;
+      } else if (c == ' ') {
+        pos.x += space_width;
+      } else {
+        if ((i32)c >= font.glyphs_zero.size) {
+          c = 0;
+        }
+        Color color =
+            (index == editor.cursor.index) ? Color(34, 36, 43) : settings.text_color;
+        pos = Draw::draw_char(dl, dl->font, color, c, pos);
       }
-      Color color =
-          (idx == editor.cursor.index) ? Color(34, 36, 43) : settings.text_color;
-      pos = Draw::draw_char(dl, dl->font, color, c, pos);
     }
-
-    idx++;
+  }
+  if (end == buffer->size) {
+    draw_marks(end, pos);
   }
 }
 
 void clear_and_reset(Editor *editor)
 {
-  editor->buffer->size = 0;
-  editor->cursor       = FILE_START;
-  editor->anchor       = FILE_START;
+  clear_buffer(editor->buffer);
+  editor->cursor = FILE_START;
+  editor->anchor = FILE_START;
 }
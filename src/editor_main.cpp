@@ -2,15 +2,22 @@
 #include "buffer.hpp"
 #include "debug_window.hpp"
 #include "draw.hpp"
+#include "file_search.hpp"
+#include "find_in_files.hpp"
 #include "font_manager.hpp"
 #include "gpu/gpu.hpp"
 #include "gpu/metal/device.hpp"
 #include "gpu/metal/render_target.hpp"
 #include "gpu/metal/texture.hpp"
+#include "latency_overlay.hpp"
 #include "math/math.hpp"
 #include "menu.hpp"
 #include "panes/pane_manager.hpp"
+#include "parallel_search.hpp"
 #include "platform.hpp"
+#include "profiler_overlay.hpp"
+#include "regex.hpp"
+#include "search_session.hpp"
 #include "status_bar.hpp"
 #include "tester.hpp"
 #include "types.hpp"
@@ -135,7 +142,18 @@ constexpr bool ENABLE_METAL_CAPTURE = !true;
 int mymain()
 {
   test_rope();
+  text_tests();
+  buffer_tests();
   rope_buffer_tests();
+  hash_map_tests();
+  arena_tests();
+  pool_tests();
+  latency_tests();
+  profiler_tests();
+  regex_tests();
+  search_session_tests();
+  parallel_search_tests();
+  file_search_tests();
 
   Input input;
   Chord chord;
@@ -168,10 +186,18 @@ int mymain()
   create_or_open_editor_tab(&pm.panes[0], buffer);
   Tester tester = create_tester("resources/test/tiny.txt");
 
+  set_profile_thread_name("main");
+
   i64 frame = 0;
   while (!sys_window.should_close()) {
-    Platform::fill_input(&sys_window, &input);
-    process_input(&input, &actions, &chord);
+    profile_frame();
+    PROFILE_ZONE("frame");
+
+    {
+      PROFILE_ZONE("input");
+      Platform::fill_input(&sys_window, &input);
+      process_input(&input, &actions, &chord);
+    }
     // add_actions(&tester, pm.windows[0].active_editor, &actions);
 
     // i32 asd = 0;
@@ -196,9 +222,34 @@ int mymain()
         menu.open = true;
         continue;
       }
+      if (eat(action, Command::TOGGLE_LATENCY_OVERLAY)) {
+        latency.overlay_open = !latency.overlay_open;
+      }
+      if (eat(action, Command::DUMP_LATENCY)) {
+        if (dump_latency("latency.txt")) {
+          info("wrote command latencies to latency.txt");
+        } else {
+          error("couldn't write latency.txt");
+        }
+      }
+      if (eat(action, Command::TOGGLE_PROFILER_OVERLAY)) {
+        profiler.overlay_open = !profiler.overlay_open;
+      }
+      if (eat(action, Command::EXPORT_TRACE)) {
+        if (export_chrome_trace("trace.json")) {
+          info("wrote a chrome trace to trace.json");
+        } else {
+          error("couldn't write trace.json");
+        }
+      }
+    }
+    {
+      PROFILE_ZONE("process");
+      process(&menu, &actions);
+      process(&find_in_files, &actions);
+      process(&pm, &actions);
+      buffer_manager.continue_loading();
     }
-    process(&menu, &actions);
-    process(&pm, &actions);
 
     // if constexpr (ENABLE_METAL_CAPTURE) {
     //   if (capture == 0) {
@@ -211,8 +262,13 @@ int mymain()
 
     Draw::start_frame(&dl, sys_window.get_size());
 
-    draw_panes(&pm, &dl);
+    {
+      PROFILE_ZONE("draw_panes");
+      draw_panes(&pm, &dl);
+    }
     draw_status_bar(&dl);
+    draw_latency_overlay(&dl);
+    draw_profiler_overlay(&dl);
 
     // if (pm.panes[0].active_editor) {
     //   static DebugWindow debug_window =
@@ -226,10 +282,18 @@ int mymain()
     // }
 
     draw_filemenu(&menu, &dl);
+    draw_find_in_files(&find_in_files, &dl);
 
-    Draw::end_frame(&dl, device, frame);
+    {
+      PROFILE_ZONE("Draw::end_frame");
+      Draw::end_frame(&dl, device, frame);
+    }
     Gpu::end_backbuffer(device);
-    Gpu::end_frame(device);
+    {
+      // waits for the gpu to take the frame
+      PROFILE_ZONE("Gpu::end_frame");
+      Gpu::end_frame(device);
+    }
 
     // if constexpr (ENABLE_METAL_CAPTURE) {
     //   if (capture == 3) {
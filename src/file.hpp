@@ -1,5 +1,13 @@
 #pragma once
 
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
 #include <fstream>
 #include <iostream>
 
@@ -12,20 +20,25 @@ struct File {
   Mem mem;
 };
 
+// the null terminated path is allocated from the caller's allocator and then resized into
+// the whole file, a Temp here would roll back the result when allocator is a Temp too
 bool read_file(String path, Allocator *allocator, File *file)
 {
-  Temp tmp;
-  std::ifstream in_stream(path.c_str(&tmp), std::ios::binary | std::ios::ate);
+  Mem mem = allocator->alloc(path.size + 1);
+  memcpy(mem.data, path.data, path.size);
+  mem.data[path.size] = '\0';
+
+  std::ifstream in_stream((char *)mem.data, std::ios::binary | std::ios::ate);
   if (!in_stream.is_open()) {
+    allocator->free(mem);
     return false;
   }
 
   u64 file_size = in_stream.tellg();
-  file->mem     = allocator->alloc(path.size + file_size);
+  file->mem     = allocator->resize(mem, path.size + file_size);
 
   file->path.data = file->mem.data;
   file->path.size = path.size;
-  memcpy(file->path.data, path.data, path.size);
 
   file->data.data = file->mem.data + file->path.size;
   file->data.size = file_size;
@@ -49,3 +62,105 @@ void write_file(String filename, String file, b8 overwrite = false)
   out_stream.write((char *)file.data, file.size);
   out_stream.close();
 }
+
+// a read-only view of a whole file. pages are read in by the os as they are touched and
+// can be dropped again at any time, so even huge files cost little resident memory
+struct MappedFile {
+  String data;
+};
+
+bool map_file(String path, MappedFile *file)
+{
+  Temp tmp;
+  int fd = open(path.c_str(&tmp), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    return false;
+  }
+
+  file->data = {};
+  if (info.st_size > 0) {
+    void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      close(fd);
+      return false;
+    }
+    file->data = String((u8 *)mapping, info.st_size);
+  }
+
+  // the mapping holds its own reference to the file
+  close(fd);
+  return true;
+}
+
+void unmap_file(MappedFile *file)
+{
+  if (file->data.size > 0) {
+    munmap(file->data.data, file->data.size);
+  }
+  file->data = {};
+}
+
+// hints that the pages in [from, to) aren't needed anymore, they are read back in from
+// the file if they are touched again. from has to be page aligned
+void release_mapped_pages(MappedFile file, i64 from, i64 to)
+{
+  if (to > from) {
+    madvise(file.data.data + from, to - from, MADV_DONTNEED);
+  }
+}
+
+// writes go to a temporary file next to path that replaces it on commit, so nothing that
+// is still reading the old file (like a mapping of it) sees a partial write. a symlink is
+// followed so the file it points at is replaced rather than the link, and the new file
+// keeps the old one's permissions
+struct FileReplacement {
+  char path[PATH_MAX];
+  char tmp_path[PATH_MAX + 4];
+  std::ofstream stream;
+};
+
+bool begin_replacement(String path, FileReplacement *replacement)
+{
+  Temp tmp;
+  if (!realpath(path.c_str(&tmp), replacement->path)) {
+    // a new file, there's no link to follow yet
+    if (path.size >= PATH_MAX) return false;
+    memcpy(replacement->path, path.data, path.size);
+    replacement->path[path.size] = '\0';
+  }
+  snprintf(replacement->tmp_path, sizeof(replacement->tmp_path), "%s.tmp",
+           replacement->path);
+
+  replacement->stream.open(replacement->tmp_path,
+                           std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!replacement->stream.is_open()) {
+    return false;
+  }
+
+  struct stat info;
+  if (stat(replacement->path, &info) == 0) {
+    chmod(replacement->tmp_path, info.st_mode & 07777);
+  }
+  return true;
+}
+
+void write(FileReplacement *replacement, String data)
+{
+  replacement->stream.write((char *)data.data, data.size);
+}
+
+bool commit_replacement(FileReplacement *replacement)
+{
+  replacement->stream.close();
+  if (replacement->stream.fail()) {
+    remove(replacement->tmp_path);
+    return false;
+  }
+  return rename(replacement->tmp_path, replacement->path) == 0;
+}
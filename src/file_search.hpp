@@ -0,0 +1,447 @@
+#pragma once
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "containers/dynamic_array.hpp"
+#include "file.hpp"
+#include "memory.hpp"
+#include "profiler.hpp"
+#include "rope_buffer.hpp"
+#include "rope_editor.hpp"
+#include "string.hpp"
+#include "text.hpp"
+#include "types.hpp"
+#include "worker_pool.hpp"
+
+// Find in files. The workers claim files one at a time, map each and search it with the
+// find kernels, and write every line with a match as "path:line: text". Binary files are
+// skipped. The lines go to a FileSearchResults that every copy of the results buffer
+// shares. Each copy takes in what's new a slice at a time, the way a loading file links
+// in its leaves, so the results can be read while the search goes on. Once every copy
+// has taken some text in it's dropped from the results.
+//
+// A new search over the same results starts them over. The old one is cancelled and
+// stops at its next match, and whatever it still hands over is dropped.
+
+const i64 FILE_RESULT_MAX_LINE = 256;       // of a matching line, the rest isn't shown
+const i64 FILE_RESULTS_FLUSH   = 64 * KB;   // a worker hands its lines over this often
+const i64 FILE_RESULTS_SLICE   = 256 * KB;  // taken into a buffer per call, at most
+const i64 BINARY_CHECK_SIZE    = 8000;      // a NUL in this much of a file means binary
+
+struct FileSearchResults {
+  std::mutex mutex;
+  DynamicArray<u8> text = DynamicArray<u8>(&system_allocator);  // not yet taken by all
+  i64 trimmed           = 0;  // of the generation's text, before the start of text
+  i64 generation        = 0;  // one per search, each one's text replaces the last's
+
+  // how much of the generation's text each copy of the buffer has taken, -1 for a copy
+  // that's been dropped
+  DynamicArray<i64> taken = DynamicArray<i64>(&system_allocator);
+
+  // of the current generation
+  std::atomic<i64> match_count{0};
+  std::atomic<i64> files_searched{0};
+  std::atomic<i64> files_skipped{0};  // binary, empty or couldn't be mapped
+};
+
+struct FileSearch {
+  FileSearchResults *results;
+  i64 generation;
+
+  Arena paths;
+  DynamicArray<String> files = DynamicArray<String>(&paths);
+  DynamicArray<u8> needle    = DynamicArray<u8>(&system_allocator);
+
+  std::atomic<i64> next_file{0};
+  std::atomic<i64> files_done{0};
+  std::atomic<bool> cancelled{false};
+
+  std::atomic<i32> references{1};  // the one who started it, and each queued task
+};
+
+void release_file_search(FileSearch *search)
+{
+  if (search->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    system_allocator.free(search->needle.allocation);
+    delete search;
+  }
+}
+
+// empties the results and starts a new generation of them, returns it
+i64 clear_file_results(FileSearchResults *results)
+{
+  std::lock_guard<std::mutex> lock(results->mutex);
+  results->text.clear();
+  results->trimmed = 0;
+  for (i64 i = 0; i < results->taken.size; i++) {
+    if (results->taken.data[i] != -1) results->taken.data[i] = 0;
+  }
+  results->match_count.store(0, std::memory_order_relaxed);
+  results->files_searched.store(0, std::memory_order_relaxed);
+  results->files_skipped.store(0, std::memory_order_relaxed);
+  return ++results->generation;
+}
+
+// hands lines over to the results, unless a newer search has started them over
+void flush_file_results(FileSearch *search, DynamicArray<u8> *lines, i64 matches,
+                        i64 searched, i64 skipped)
+{
+  FileSearchResults *results = search->results;
+  std::lock_guard<std::mutex> lock(results->mutex);
+  if (results->generation == search->generation) {
+    i64 at = results->text.size;
+    results->text.resize(at + lines->size);
+    memcpy(results->text.data + at, lines->data, lines->size);
+    results->match_count.fetch_add(matches, std::memory_order_relaxed);
+    results->files_searched.fetch_add(searched, std::memory_order_relaxed);
+    results->files_skipped.fetch_add(skipped, std::memory_order_relaxed);
+  }
+  lines->clear();
+}
+
+bool looks_binary(String data)
+{
+  return data.size > 0 &&
+         memchr(data.data, 0, std::min(data.size, BINARY_CHECK_SIZE)) != nullptr;
+}
+
+void push_string(DynamicArray<u8> *array, String str)
+{
+  i64 at = array->size;
+  array->resize(at + str.size);
+  memcpy(array->data + at, str.data, str.size);
+}
+
+// writes a line for every line of the file with a match, only once however many it has
+void search_file(FileSearch *search, String path)
+{
+  PROFILE_FUNCTION();
+
+  Temp tmp;
+  DynamicArray<u8> lines(&tmp);
+  MappedFile file;
+  if (!map_file(path, &file)) {
+    flush_file_results(search, &lines, 0, 0, 1);
+    return;
+  }
+
+  String data   = file.data;
+  String needle = {search->needle.data, search->needle.size};
+  i64 matches   = 0;
+  bool searched = data.size > 0 && !looks_binary(data);
+  if (searched) {
+    i64 line       = 1;
+    i64 line_start = 0;
+    i64 counted    = 0;  // newlines before here are in line
+    i64 from       = 0;
+    while (from < data.size && !search->cancelled.load(std::memory_order_relaxed)) {
+      i64 at = find(data.sub(from, data.size), needle);
+      if (at == -1) break;
+      at += from;
+
+      i64 last_newline;
+      line += count_newlines(data.sub(counted, at), &last_newline);
+      if (last_newline != -1) line_start = counted + last_newline + 1;
+      counted = at;
+
+      u8 *newline  = (u8 *)memchr(data.data + at, '\n', data.size - at);
+      i64 line_end = newline ? newline - data.data : data.size;
+      String text  = data.sub(line_start,
+                              std::min(line_end, line_start + FILE_RESULT_MAX_LINE));
+      if (text.size > 0 && text.data[text.size - 1] == '\r') text.size--;
+
+      char number[32];
+      i32 number_size = snprintf(number, sizeof(number), ":%lld: ", (long long)line);
+      push_string(&lines, path);
+      push_string(&lines, String((u8 *)number, number_size));
+      push_string(&lines, text);
+      lines.push_back('\n');
+      matches++;
+
+      // the rest of the line is already in the results
+      from = line_end + 1;
+      if (lines.size >= FILE_RESULTS_FLUSH) {
+        flush_file_results(search, &lines, matches, 0, 0);
+        matches = 0;
+      }
+    }
+  }
+
+  unmap_file(&file);
+  flush_file_results(search, &lines, matches, searched, !searched);
+}
+
+// claims files until there are none left
+void search_files(FileSearch *search)
+{
+  while (true) {
+    i64 i = search->next_file.fetch_add(1, std::memory_order_relaxed);
+    if (i >= search->files.size) {
+      return;
+    }
+
+    if (!search->cancelled.load(std::memory_order_relaxed)) {
+      search_file(search, search->files.data[i]);
+    }
+    search->files_done.fetch_add(1, std::memory_order_release);
+  }
+}
+
+void run_file_search_task(void *data, i64 index)
+{
+  FileSearch *search = (FileSearch *)data;
+  search_files(search);
+  release_file_search(search);
+}
+
+// starts the results over with a search of files for needle on the workers
+FileSearch *start_file_search(FileSearchResults *results, DynamicArray<String> files,
+                              String needle)
+{
+  FileSearch *search = new FileSearch();
+  search->results    = results;
+  search->needle.resize(needle.size);
+  memcpy(search->needle.data, needle.data, needle.size);
+  search->files.set_capacity(files.size);
+  for (i64 i = 0; i < files.size; i++) {
+    search->files.push_back(files.data[i].copy(&search->paths));
+  }
+  search->generation = clear_file_results(results);
+
+  i64 tasks = std::min((i64)worker_count(), search->files.size);
+  search->references.fetch_add(tasks, std::memory_order_relaxed);
+  run_on_workers(run_file_search_task, search, tasks);
+  return search;
+}
+
+bool file_search_done(FileSearch *search)
+{
+  return search->files_done.load(std::memory_order_acquire) == search->files.size;
+}
+
+// helps with the files nobody has claimed yet and returns once they've all been searched
+void wait_for_file_search(FileSearch *search)
+{
+  search_files(search);
+  while (!file_search_done(search)) {
+    std::this_thread::yield();
+  }
+}
+
+// stops the search if it's still running and lets go of it
+void cancel_file_search(FileSearch *search)
+{
+  search->cancelled.store(true, std::memory_order_relaxed);
+  release_file_search(search);
+}
+
+// has the results keep what this copy of the buffer hasn't taken yet. every copy that
+// takes them in has to be shared this way, from the first one on
+void share_file_results(RopeBuffer *buffer, FileSearchResults *results)
+{
+  std::lock_guard<std::mutex> lock(results->mutex);
+  if (buffer->results_generation != results->generation) {
+    buffer->results_taken = 0;  // it starts over when it next takes
+  }
+  buffer->file_results = results;
+  buffer->results_copy = results->taken.size;
+  results->taken.push_back(buffer->results_taken);
+}
+
+// for a copy that's dropped, the rest of the results aren't kept for it anymore
+void stop_sharing_file_results(RopeBuffer *buffer)
+{
+  FileSearchResults *results = buffer->file_results;
+  std::lock_guard<std::mutex> lock(results->mutex);
+  results->taken.data[buffer->results_copy] = -1;
+  buffer->file_results = nullptr;
+  buffer->results_copy = -1;
+}
+
+// drops the text every copy has taken. only once that's at least as much as is left, so
+// moving the rest down costs no more than taking it did
+void trim_file_results(FileSearchResults *results)
+{
+  i64 least = -1;
+  for (i64 i = 0; i < results->taken.size; i++) {
+    i64 taken = results->taken.data[i];
+    if (taken != -1 && (least == -1 || taken < least)) least = taken;
+  }
+
+  i64 drop = least - results->trimmed;
+  if (least == -1 || drop == 0 || drop < results->text.size - drop) {
+    return;
+  }
+  memmove(results->text.data, results->text.data + drop, results->text.size - drop);
+  results->text.resize(results->text.size - drop);
+  results->trimmed = least;
+}
+
+// what taking results changed in a copy of the buffer
+struct TakenResults {
+  bool started_over;
+  i64 at;
+  i64 size;
+};
+
+// takes the results added since the last call into this copy of the buffer, at most a
+// slice of them. a new generation empties it first
+TakenResults take_file_results(RopeBuffer *buffer)
+{
+  FileSearchResults *results = buffer->file_results;
+  TakenResults changed       = {};
+  if (!results) {
+    return changed;
+  }
+  PROFILE_FUNCTION();
+
+  Temp tmp;
+  DynamicArray<u8> taken(&tmp);
+  {
+    std::lock_guard<std::mutex> lock(results->mutex);
+    changed.started_over = buffer->results_generation != results->generation;
+    if (changed.started_over) {
+      buffer->results_generation = results->generation;
+      buffer->results_taken      = 0;
+    }
+    i64 from = buffer->results_taken - results->trimmed;
+    i64 to   = std::min(results->text.size, from + FILE_RESULTS_SLICE);
+    push_string(&taken, String(results->text.data + from, to - from));
+
+    buffer->results_taken                     = results->trimmed + to;
+    results->taken.data[buffer->results_copy] = buffer->results_taken;
+    trim_file_results(results);
+  }
+
+  if (changed.started_over) {
+    buffer_remove_range(*buffer, 0, buffer->rope.get_summary_or_empty().size);
+  }
+  changed.at   = buffer->rope.get_summary_or_empty().size;
+  changed.size = taken.size;
+  if (taken.size > 0) {
+    String span = {taken.data, taken.size};
+    buffer_insert(*buffer, cursor_at(*buffer, changed.at), span);
+  }
+  return changed;
+}
+
+// takes results into the editor's copy, keeping its cursor and matches in step
+void take_file_results(RopeEditor *editor)
+{
+  TakenResults changed = take_file_results(&editor->buffer);
+  if (changed.started_over) {
+    reset_search(&editor->search);
+    editor->cursor = cursor_at(editor->buffer, 0);
+    editor->anchor = editor->cursor;
+    editor->scroll = 0;
+  }
+  if (changed.size > 0) {
+    note_edit(&editor->search, changed.at, 0, changed.size);
+    editor->cursor = cursor_at(editor->buffer, editor->cursor.index);
+    editor->anchor = cursor_at(editor->buffer, editor->anchor.index);
+  }
+}
+
+void file_search_tests()
+{
+  // a few files in a fresh directory, one of them binary
+  char dir[]   = "/tmp/file_search_XXXXXX";
+  bool created = mkdtemp(dir) != nullptr;
+  assert(created);
+  const char *names[] = {"a.txt", "b.txt", "c.bin", "empty.txt", "missing.txt"};
+  char paths[5][64];
+  Temp tmp;
+  DynamicArray<String> files(&tmp);
+  for (i32 i = 0; i < 5; i++) {
+    i32 size = snprintf(paths[i], sizeof(paths[i]), "%s/%s", dir, names[i]);
+    files.push_back(String((u8 *)paths[i], size));
+  }
+
+  DynamicArray<u8> b(&tmp);
+  for (i32 i = 1; i <= 300; i++) {
+    char line[32];
+    i32 size = snprintf(line, sizeof(line), i == 200 ? "x needle %d\n" : "line %d\n", i);
+    push_string(&b, String((u8 *)line, size));
+  }
+  u8 binary[] = {'n', 'e', 'e', 'd', 'l', 'e', 0, 'n', 'e', 'e', 'd', 'l', 'e'};
+  write_file(files.data[0], "one needle\ntwo\nneedle needle three\r\n", true);
+  write_file(files.data[1], String(b.data, b.size), true);
+  write_file(files.data[2], String(binary, sizeof(binary)), true);
+  write_file(files.data[3], "", true);
+
+  FileSearchResults results;
+  RopeEditor editor;
+  editor.buffer = create_rope_buffer();
+  fill_rope(&editor.buffer, "");
+  share_file_results(&editor.buffer, &results);
+
+  // the copy holds exactly these lines, in whatever order the files finished
+  auto check = [&](RopeEditor *copy, std::initializer_list<const char *> expected) {
+    take_file_results(copy);
+    DynamicArray<u8> builder(&tmp);
+    String contents = buffer_to_string(copy->buffer, &builder);
+    i64 size        = 0;
+    for (const char *line : expected) {
+      char full[128];
+      i32 full_size = snprintf(full, sizeof(full), "%s/%s\n", dir, line);
+      assert(find(contents, String((u8 *)full, full_size)) != -1);
+      size += full_size;
+    }
+    assert(contents.size == size);
+    assert(results.match_count.load() == (i64)expected.size());
+  };
+
+  FileSearch *search = start_file_search(&results, files, "needle");
+  wait_for_file_search(search);
+  release_file_search(search);
+  assert(results.files_searched.load() == 2 && results.files_skipped.load() == 3);
+  check(&editor, {"a.txt:1: one needle", "a.txt:3: needle needle three",
+                  "b.txt:200: x needle 200"});
+  assert(results.text.size == 0);  // every copy has it, so it isn't kept
+
+  // a second copy, the text is kept until both have taken it in
+  RopeEditor other;
+  other.buffer = copy_buffer(&editor.buffer);
+  share_file_results(&other.buffer, &results);
+
+  // a new query starts the results over, whatever the last search still finds is dropped
+  FileSearch *cancelled = start_file_search(&results, files, "needle");
+  cancelled->cancelled.store(true);
+  search = start_file_search(&results, files, "two");
+  wait_for_file_search(search);
+  release_file_search(search);
+  check(&editor, {"a.txt:2: two"});
+  assert(results.text.size > 0);
+  wait_for_file_search(cancelled);
+  release_file_search(cancelled);
+  check(&other, {"a.txt:2: two"});
+  assert(results.text.size == 0);
+
+  // nothing is kept for a copy that's been dropped
+  stop_sharing_file_results(&other.buffer);
+  release(other.buffer.rope);
+  search = start_file_search(&results, files, "needle");
+  wait_for_file_search(search);
+  release_file_search(search);
+  check(&editor, {"a.txt:1: one needle", "a.txt:3: needle needle three",
+                  "b.txt:200: x needle 200"});
+  assert(results.text.size == 0);
+
+  search = start_file_search(&results, files, "zzz");
+  wait_for_file_search(search);
+  release_file_search(search);
+  check(&editor, {});
+
+  for (i32 i = 0; i < 4; i++) unlink(paths[i]);
+  rmdir(dir);
+  stop_sharing_file_results(&editor.buffer);
+  release(editor.buffer.rope);
+  system_allocator.free(results.text.allocation);
+  system_allocator.free(results.taken.allocation);
+}
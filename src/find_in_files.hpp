@@ -0,0 +1,130 @@
+#pragma once
+
+#include "buffer_manager.hpp"
+#include "draw.hpp"
+#include "file_search.hpp"
+#include "find_prompt.hpp"
+#include "latency.hpp"
+#include "panes/pane_manager.hpp"
+#include "platform.hpp"
+#include "profiler.hpp"
+#include "settings.hpp"
+
+// The find in files prompt. The results go to one buffer that's opened in the focused
+// pane along with the prompt, and every change to the query starts a new search of the
+// files that were there when it was opened.
+struct FindInFiles {
+  FindPrompt prompt;
+
+  Arena alloc;
+  DynamicArray<String> files = DynamicArray<String>(&alloc);
+
+  RopeBuffer *buffer         = nullptr;
+  FileSearchResults *results = nullptr;  // never freed, cancelled searches still use it
+  FileSearch *search         = nullptr;
+  DynamicArray<u8> query     = DynamicArray<u8>(&system_allocator);  // being searched for
+};
+FindInFiles find_in_files;
+
+// a file or directory starting with a dot, like .git
+bool is_hidden(String path)
+{
+  for (i64 i = 0; i < path.size; i++) {
+    if (path.data[i] == '.' && (i == 0 || path.data[i - 1] == '/')) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void open_find_in_files(FindInFiles *find)
+{
+  if (!find->buffer) {
+    find->results = new FileSearchResults();
+    find->buffer  = buffer_manager.create_buffer();
+    fill_rope(find->buffer, "");
+    share_file_results(find->buffer, find->results);
+  }
+
+  find->alloc.reset();
+  find->files                = DynamicArray<String>(&find->alloc);
+  DynamicArray<String> files = Platform::list_files(".", &find->alloc);
+  for (i64 i = 0; i < files.size; i++) {
+    if (!is_hidden(files.data[i])) find->files.push_back(files.data[i]);
+  }
+
+  find->prompt.open    = true;
+  find->prompt.focused = true;
+  create_or_open_editor_tab(pm.get_focused_pane(), find->buffer);
+}
+
+// cancels the search that's running, if any, and starts one for the query
+void restart_file_search(FindInFiles *find)
+{
+  String query = find_query(&find->prompt);
+  find->query.resize(query.size);
+  memcpy(find->query.data, query.data, query.size);
+
+  if (find->search) {
+    cancel_file_search(find->search);
+    find->search = nullptr;
+  }
+  if (query.size == 0) {
+    clear_file_results(find->results);
+    return;
+  }
+  find->search = start_file_search(find->results, find->files, query);
+}
+
+void process(FindInFiles *find, Actions *actions)
+{
+  for (i32 i = 0; i < actions->size; i++) {
+    Action *action = &actions->operator[](i);
+    if (eat(action, Command::FIND_IN_FILES)) {
+      open_find_in_files(find);
+      continue;
+    }
+    if (!find->prompt.focused || action->eaten) {
+      continue;
+    }
+
+    // everything typed goes to the prompt, enter leaves the results to be read
+    LatencyScope latency_scope(action);
+    if (eat(action, Command::INPUT_NEWLINE)) {
+      find->prompt.open    = false;
+      find->prompt.focused = false;
+      continue;
+    }
+    if (eat(action, Command::TOGGLE_FIND_REGEX)) {
+      continue;  // the files are only searched for the text as it is
+    }
+    handle_action(&find->prompt, action);
+    action->eaten = true;
+  }
+
+  String query = find_query(&find->prompt);
+  if (find->prompt.open && !(query == String(find->query.data, find->query.size))) {
+    restart_file_search(find);
+  }
+
+  // editors opened later copy this buffer, so it keeps up with the results too
+  if (find->buffer) {
+    take_file_results(find->buffer);
+  }
+}
+
+void draw_find_in_files(FindInFiles *find, Draw::List *dl)
+{
+  if (!find->prompt.open) {
+    return;
+  }
+  PROFILE_FUNCTION();
+
+  find->prompt.rect = {
+      0,
+      dl->canvas_size.y - settings.info_bar_height * 2,
+      dl->canvas_size.x,
+      settings.info_bar_height,
+  };
+  draw_find_prompt(find->prompt, dl, true, find->results->match_count.load());
+}
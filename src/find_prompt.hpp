@@ -5,18 +5,30 @@
 
 struct FindPrompt {
   Editor find_input;
+  BasicBuffer buffer;
 
   Rect4f rect;
   bool open    = false;
   bool focused = false;
+  bool regex   = false;  // the query is a pattern for regex.hpp
 };
 
+String find_query(FindPrompt *prompt) { return buffer_string(&prompt->buffer); }
+
 bool handle_action(FindPrompt *prompt, Action *action)
 {
+  // the prompt is copied along with its window, so its editor is pointed at the buffer
+  // whenever it's used
+  prompt->find_input.buffer = &prompt->buffer;
+
   if (eat(action, Command::TOGGLE_FIND)) {
     prompt->focused = false;
     return true;
   }
+  if (eat(action, Command::TOGGLE_FIND_REGEX)) {
+    prompt->regex = !prompt->regex;
+    return true;
+  }
   if (eat(action, Command::ESCAPE)) {
     prompt->open    = false;
     prompt->focused = false;
@@ -46,8 +58,11 @@ bool handle_action(FindPrompt *prompt, Action *action)
   return true;
 }
 
-void draw_find_prompt(FindPrompt &prompt, Draw::List *dl, bool focused)
+// match_count is drawn at the right, unless it's -1
+void draw_find_prompt(FindPrompt &prompt, Draw::List *dl, bool focused,
+                      i64 match_count)
 {
+  prompt.find_input.buffer = &prompt.buffer;
   Draw::push_rect(dl, 0, prompt.rect, settings.foreground_color);
 
   ViewRange full_view_range;
@@ -61,4 +76,15 @@ void draw_find_prompt(FindPrompt &prompt, Draw::List *dl, bool focused)
 
   draw_editor(prompt.find_input, dl, prompt.rect, full_view_range,
               focused && prompt.focused);
+
+  if (prompt.regex) {
+    Vec2f position = {prompt.rect.x + prompt.rect.width - space_width * 3, prompt.rect.y};
+    draw_string(dl, dl->font, settings.activated_color, ".*", position);
+  }
+  if (match_count >= 0 && find_query(&prompt).size > 0) {
+    String count   = StaticString<32>::from_i32(match_count);
+    Vec2f position = {prompt.rect.x + prompt.rect.width - space_width * (count.size + 1),
+                      prompt.rect.y};
+    draw_string(dl, dl->font, settings.deactivated_color, count, position);
+  }
 }
\ No newline at end of file
@@ -11,6 +11,7 @@
 #include "image.hpp"
 #include "logging.hpp"
 #include "platform.hpp"
+#include "profiler.hpp"
 #include "types.hpp"
 
 const i32 NUM_CHARS_IN_FONT = 128;
@@ -104,6 +105,8 @@ void rasterize_glyph(Font *font, FT_Face face, u32 character, Glyph *glyph)
 
 Array<Glyph, 3> extract_glyph(Font *font, FT_Face face, u32 character)
 {
+  PROFILE_FUNCTION();
+
   FT_Vector offset_zero = {0, 0};
   FT_Vector offset_one  = {64 / 3, 0};
   FT_Vector offset_two  = {2 * 64 / 3, 0};
@@ -161,6 +164,8 @@ Array<Glyph, 3> extract_glyph(Font *font, FT_Face face, u32 character)
 
 Font load_font(String filename, f32 size)
 {
+  PROFILE_FUNCTION();
+
   FT_Error err = FT_Init_FreeType(&library);
   if (err) {
     fatal("failed to init freetype");
@@ -253,6 +253,12 @@ struct Modifiers {
     m.values[1] = true;
     return m;
   }
+  static Modifiers with_shift()
+  {
+    Modifiers m;
+    m.values[0] = true;
+    return m;
+  }
 
   bool shift() const { return values[0]; }
   bool ctrl() const { return values[1]; }
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "actions.hpp"
+#include "timer.hpp"
+#include "types.hpp"
+
+// How long each Command takes to handle. The handler that eats an action is charged for
+// the time since its loop picked the action up, so a command that scans the buffer shows
+// up under its own name. Every command keeps its most recent samples in a ring, for
+// percentiles of what the editor is doing now, and a histogram of all of them by powers of
+// two.
+const i32 LATENCY_RING_SIZE    = 128;
+const i32 LATENCY_BUCKET_COUNT = 40;  // bucket i holds times in [2^(i-1), 2^i) ns
+
+struct CommandLatency {
+  u64 recent[LATENCY_RING_SIZE];
+  i64 count = 0;
+
+  u64 max   = 0;
+  u64 total = 0;
+  i64 buckets[LATENCY_BUCKET_COUNT] = {};
+};
+
+struct Latency {
+  CommandLatency commands[COMMAND_COUNT];
+
+  bool overlay_open = false;
+};
+Latency latency;
+
+i32 latency_bucket(u64 nanos)
+{
+  i32 bucket = nanos == 0 ? 0 : 64 - __builtin_clzll(nanos);
+  return std::min(bucket, LATENCY_BUCKET_COUNT - 1);
+}
+
+void record_latency(Command command, u64 nanos)
+{
+  CommandLatency *stats = &latency.commands[(i32)command];
+  stats->recent[stats->count % LATENCY_RING_SIZE] = nanos;
+  stats->count++;
+
+  stats->max = std::max(stats->max, nanos);
+  stats->total += nanos;
+  stats->buckets[latency_bucket(nanos)]++;
+}
+
+// times an action from construction to destruction and records it if it got eaten in
+// between, put one at the top of a loop over actions
+struct LatencyScope {
+  Action *action;
+  bool was_eaten;
+  u64 start;
+
+  LatencyScope(Action *action)
+  {
+    this->action = action;
+    was_eaten    = action->eaten;
+    start        = now_ns();
+  }
+  ~LatencyScope()
+  {
+    if (!was_eaten && action->eaten) {
+      record_latency(action->command, now_ns() - start);
+    }
+  }
+};
+
+struct LatencySummary {
+  i64 samples;  // how many of the recent samples the percentiles are over
+  u64 p50;
+  u64 p99;
+  u64 max;
+};
+
+LatencySummary summarize_latency(CommandLatency *stats)
+{
+  u64 sorted[LATENCY_RING_SIZE];
+  i64 samples = std::min(stats->count, (i64)LATENCY_RING_SIZE);
+  std::copy(stats->recent, stats->recent + samples, sorted);
+  std::sort(sorted, sorted + samples);
+
+  LatencySummary summary = {};
+  summary.samples        = samples;
+  summary.max            = stats->max;
+  if (samples > 0) {
+    summary.p50 = sorted[samples / 2];
+    summary.p99 = sorted[samples * 99 / 100];
+  }
+  return summary;
+}
+
+// writes every command that has run with its recent percentiles and histogram
+bool dump_latency(const char *filename)
+{
+  FILE *file = fopen(filename, "w");
+  if (!file) {
+    return false;
+  }
+
+  for (i32 i = 0; i < COMMAND_COUNT; i++) {
+    CommandLatency *stats = &latency.commands[i];
+    if (stats->count == 0) continue;
+
+    LatencySummary summary = summarize_latency(stats);
+    fprintf(file,
+            "%.*s count %lld mean %.2f us p50 %.2f us p99 %.2f us max %.2f us (last "
+            "%lld)\n",
+            (i32)command_strings[i].size, command_strings[i].data, (long long)stats->count,
+            stats->total / 1000.0 / stats->count, summary.p50 / 1000.0,
+            summary.p99 / 1000.0, summary.max / 1000.0, (long long)summary.samples);
+    for (i32 bucket = 0; bucket < LATENCY_BUCKET_COUNT; bucket++) {
+      if (stats->buckets[bucket] == 0) continue;
+
+      u64 below = bucket == 0 ? 1 : 1ull << bucket;
+      fprintf(file, "  < %10.2f us %lld\n", below / 1000.0,
+              (long long)stats->buckets[bucket]);
+    }
+  }
+
+  fclose(file);
+  return true;
+}
+
+void latency_tests()
+{
+  Latency saved = latency;
+  latency       = {};
+
+  Action typed(Command::INPUT_TEXT);
+  {
+    LatencyScope scope(&typed);
+    eat(&typed, Command::INPUT_TEXT);
+  }
+  Action ignored(Command::NAV_BLOCK_DOWN);
+  {
+    LatencyScope scope(&ignored);
+  }
+  {
+    // eaten by an earlier handler, this one shouldn't be charged
+    LatencyScope scope(&typed);
+  }
+  assert(latency.commands[(i32)Command::INPUT_TEXT].count == 1);
+  assert(latency.commands[(i32)Command::NAV_BLOCK_DOWN].count == 0);
+
+  for (u64 i = 1; i <= 1000; i++) {
+    record_latency(Command::NAV_BLOCK_DOWN, i * 1000);
+  }
+  CommandLatency *stats  = &latency.commands[(i32)Command::NAV_BLOCK_DOWN];
+  LatencySummary summary = summarize_latency(stats);
+  assert(summary.samples == LATENCY_RING_SIZE);
+  assert(summary.p50 == (1000 - LATENCY_RING_SIZE / 2 + 1) * 1000);
+  assert(summary.max == 1000 * 1000);
+
+  i64 bucketed = 0;
+  for (i32 i = 0; i < LATENCY_BUCKET_COUNT; i++) bucketed += stats->buckets[i];
+  assert(bucketed == 1000);
+  assert(stats->buckets[latency_bucket(1000)] == 1);
+  assert(latency_bucket(1023) == 10 && latency_bucket(1024) == 11);
+
+  latency = saved;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "draw.hpp"
+#include "latency.hpp"
+
+// a panel in the top right corner with the recent latency of every command that has run.
+// commands slower than a frame are drawn red
+void draw_latency_overlay(Draw::List *dl)
+{
+  if (!latency.overlay_open) {
+    return;
+  }
+
+  Font &font = dl->font;
+
+  i32 rows = 0;
+  for (i32 i = 0; i < COMMAND_COUNT; i++) {
+    if (latency.commands[i].count > 0) rows++;
+  }
+
+  f32 width   = 760.f;
+  f32 padding = 12.f;
+  Rect4f rect = {
+      dl->canvas_size.x - width - padding,
+      padding,
+      width,
+      (rows + 1) * font.height + padding * 2,
+  };
+  Draw::push_rect(dl, 0, rect, {25, 27, 32});
+
+  Color color = Color(187, 194, 207);
+  Color slow  = Color(224, 108, 117);
+  Vec2f pos   = {rect.x + padding, rect.y + padding};
+  draw_string(dl, font, color, "command                     p50 us    p99 us    max us", pos);
+  pos.y += font.height;
+
+  for (i32 i = 0; i < COMMAND_COUNT; i++) {
+    CommandLatency *stats = &latency.commands[i];
+    if (stats->count == 0) continue;
+
+    LatencySummary summary = summarize_latency(stats);
+    char line[128];
+    i32 size = snprintf(line, sizeof(line), "%-24.*s %9.1f %9.1f %9.1f",
+                        (i32)command_strings[i].size, command_strings[i].data,
+                        summary.p50 / 1000.0, summary.p99 / 1000.0, summary.max / 1000.0);
+
+    bool over_frame = summary.p99 > 16600000;
+    draw_string(dl, font, over_frame ? slow : color, {(u8 *)line, size}, pos);
+    pos.y += font.height;
+  }
+}
@@ -1,7 +1,13 @@
 #pragma once
 
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
+#include <cstring>
 
 #include "types.hpp"
 
@@ -18,9 +24,37 @@ struct Allocator {
   virtual void free(Mem mem)  = 0;
 };
 
-const auto sys_alloc = malloc;
-const auto sys_realloc = realloc;
-const auto sys_free  = free;
+// every heap allocation goes through these, so a benchmark can count them
+struct AllocationCounts {
+  i64 allocations;
+  i64 bytes;
+};
+AllocationCounts allocation_counts = {};
+
+void count_allocation(u64 size)
+{
+  __atomic_fetch_add(&allocation_counts.allocations, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&allocation_counts.bytes, (i64)size, __ATOMIC_RELAXED);
+}
+
+void *sys_alloc(u64 size)
+{
+  count_allocation(size);
+  return malloc(size);
+}
+void *sys_realloc(void *data, u64 size)
+{
+  count_allocation(size);
+  return realloc(data, size);
+}
+void sys_free(void *data) { free(data); }
+
+AllocationCounts current_allocation_counts()
+{
+  return {__atomic_load_n(&allocation_counts.allocations, __ATOMIC_RELAXED),
+          __atomic_load_n(&allocation_counts.bytes, __ATOMIC_RELAXED)};
+}
+
 struct SystemAllocator : Allocator {
   Mem alloc(u64 size) override
   {
@@ -46,97 +80,200 @@ struct SystemAllocator : Allocator {
   }
 };
 
-struct StackAllocator : Allocator {
-  Mem base_memory;
-  u8 *beg, *end, *next;
+// Bump allocation out of a chain of blocks. Each block is reserved as virtual memory and
+// pages are only committed when they get touched, so the blocks can be large and an
+// allocation that doesn't fit just starts another block instead of asserting. Everything
+// allocated after a marker is released at once by rolling back to it, and the most recent
+// allocation can also be freed or resized in place.
+const u64 ARENA_BLOCK_SIZE = 64 * MB;
 
+struct ArenaBlock {
+  ArenaBlock *prev;
+  u64 size;         // including this header
+  u64 used_before;  // bytes in use in the blocks before this one when it was started
+};
+
+struct ArenaMarker {
+  ArenaBlock *block;
+  u8 *next;
+};
+
+struct ArenaStats {
+  u64 used;
+  u64 high_water;
+  u64 reserved;
+};
+
+struct Arena : Allocator {
+  ArenaBlock *block   = nullptr;
+  u8 *next            = nullptr;
+  u8 *end             = nullptr;
   u8 *last_allocation = nullptr;
 
-  StackAllocator(Allocator *from, u64 size)
+  u64 high_water = 0;
+  u64 reserved   = 0;
+
+  Arena() {}
+  Arena(const Arena &) = delete;
+  ~Arena()
   {
-    base_memory = from->alloc(size);
-    beg         = base_memory.data;
-    next        = beg;
-    end         = beg + size;
+    while (block) pop_block();
   }
 
-  ~StackAllocator() { base_memory.allocator->free(base_memory); }
+  static u8 *block_data(ArenaBlock *block) { return (u8 *)(block + 1); }
+
+  void push_block(u64 min_size)
+  {
+    u64 page_size = getpagesize();
+    u64 size      = (min_size + sizeof(ArenaBlock) + page_size - 1) / page_size * page_size;
+    size          = std::max(size, ARENA_BLOCK_SIZE);
+
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    assert(memory != MAP_FAILED);
+
+    ArenaBlock *new_block  = (ArenaBlock *)memory;
+    new_block->prev        = block;
+    new_block->size        = size;
+    new_block->used_before = used();
+
+    block = new_block;
+    next  = block_data(block);
+    end   = (u8 *)block + size;
+    reserved += size;
+  }
+  void pop_block()
+  {
+    ArenaBlock *prev = block->prev;
+    reserved -= block->size;
+    munmap(block, block->size);
+
+    block = prev;
+    next  = block ? block_data(block) : nullptr;
+    end   = block ? (u8 *)block + block->size : nullptr;
+  }
 
   Mem alloc(u64 size) override
   {
-    // assume that base_memory is already aligned, so this adds padding to the end of each
-    // allocation.
-    u32 max_alignment = alignof(std::max_align_t);
-    u64 padded_size   = size + (max_alignment - (size % max_alignment));
+    u64 alignment = alignof(std::max_align_t);
+    u8 *start     = (u8 *)(((u64)next + alignment - 1) & ~(alignment - 1));
+    if (!block || start + size > end) {
+      push_block(size + alignment);
+      start = (u8 *)(((u64)next + alignment - 1) & ~(alignment - 1));
+    }
 
-    assert(next + padded_size < end);
+    next            = start + size;
+    last_allocation = start;
+    high_water      = std::max(high_water, used());
 
     Mem mem;
-    mem.data      = next;
+    mem.data      = start;
     mem.size      = size;
     mem.allocator = this;
-
-    last_allocation = next;
-
-    next += padded_size;
-
     return mem;
   }
 
   Mem resize(Mem mem, u64 new_size) override
   {
     assert(mem.allocator == this);
-    free(mem);
-    return alloc(new_size);
-  }
+    if (mem.data == last_allocation && mem.data + new_size <= end) {
+      next       = mem.data + new_size;
+      mem.size   = new_size;
+      high_water = std::max(high_water, used());
+      return mem;
+    }
 
-  void free(Mem mem) override { try_free(mem); }
+    Mem moved = alloc(new_size);
+    memcpy(moved.data, mem.data, std::min((u64)mem.size, new_size));
+    return moved;
+  }
 
-  void try_free(Mem mem)
+  // only the most recent allocation can be given back early, the rest goes on rollback
+  void free(Mem mem) override
   {
-    assert(mem.data >= beg && mem.data < end);
-
     if (mem.data == last_allocation) {
-      next            = (u8 *)mem.data;
+      next            = mem.data;
       last_allocation = nullptr;
     }
   }
 
-  void force_free(Mem mem)
-  {
-    assert(mem.data >= beg && mem.data < end);
+  ArenaMarker marker() { return {block, next}; }
 
-    next            = (u8 *)mem.data;
-    last_allocation = nullptr;
-  }
-
-  void reset()
+  // releases everything allocated since the marker. the first block is kept around, so an
+  // arena that is reset every frame doesn't map and unmap it every time
+  void rollback(ArenaMarker marker)
   {
-    next            = beg;
+    while (block && block != marker.block && block->prev) {
+      pop_block();
+    }
+    if (block) {
+      next = marker.block ? marker.next : block_data(block);
+    }
     last_allocation = nullptr;
   }
+  void reset() { rollback({}); }
 
-  Mem get_top()
-  {
-    Mem mem;
-    mem.data      = next;
-    mem.size      = 0;
-    mem.allocator = this;
-    return mem;
-  };
+  u64 used() { return block ? block->used_before + (next - block_data(block)) : 0; }
+  ArenaStats stats() { return {used(), high_water, reserved}; }
 };
 
 SystemAllocator system_allocator;
-StackAllocator tmp_allocator(&system_allocator, 32 * MB);
 
+// scratch memory for the current thread, the main thread resets it every frame
+thread_local Arena tmp_allocator;
+
+// allocates from an arena and gives back everything allocated from that arena since it
+// was opened when it goes out of scope. that includes memory a callee allocated from an
+// outer Temp on the same arena, so a function that returns memory from a caller's
+// allocator can't open one itself
 struct Temp : Allocator {
-  Mem stack_marker;
+  Arena *arena;
+  ArenaMarker marker;
 
-  Temp() { stack_marker = tmp_allocator.get_top(); }
-  Temp(StackAllocator *stack) { stack_marker = stack->get_top(); }
-  ~Temp() { stack_marker.allocator->free(stack_marker); }
+  Temp() : Temp(&tmp_allocator) {}
+  Temp(Arena *arena)
+  {
+    this->arena  = arena;
+    this->marker = arena->marker();
+  }
+  ~Temp() { arena->rollback(marker); }
 
-  Mem alloc(u64 size) override final { return stack_marker.allocator->alloc(size); }
-  Mem resize(Mem mem, u64 new_size) override final { return stack_marker.allocator->resize(mem, new_size); }
-  void free(Mem mem) override final { stack_marker.allocator->free(mem); }
+  Mem alloc(u64 size) override final { return arena->alloc(size); }
+  Mem resize(Mem mem, u64 new_size) override final { return arena->resize(mem, new_size); }
+  void free(Mem mem) override final { arena->free(mem); }
 };
+
+void arena_tests()
+{
+  Arena arena;
+  Mem first = arena.alloc(100);
+  assert(((u64)first.data % alignof(std::max_align_t)) == 0);
+
+  // the last allocation grows in place, an earlier one has to move
+  Mem grown = arena.resize(first, 1000);
+  assert(grown.data == first.data);
+  Mem second = arena.alloc(10);
+  Mem moved  = arena.resize(grown, 2000);
+  assert(moved.data != grown.data && moved.data > second.data);
+
+  // past the end of a block starts another one, a rollback gives it back
+  ArenaMarker marker = arena.marker();
+  u64 used           = arena.used();
+  Mem big            = arena.alloc(ARENA_BLOCK_SIZE * 2);
+  big.data[big.size - 1] = 1;
+  assert(arena.reserved > ARENA_BLOCK_SIZE * 2);
+  assert(arena.stats().high_water >= used + ARENA_BLOCK_SIZE * 2);
+  arena.rollback(marker);
+  assert(arena.used() == used);
+  assert(arena.reserved == ARENA_BLOCK_SIZE);
+
+  {
+    Temp temp(&arena);
+    temp.alloc(KB);
+    temp.alloc(KB);
+  }
+  assert(arena.used() == used);
+
+  arena.reset();
+  assert(arena.used() == 0);
+}
@@ -3,14 +3,16 @@
 #include "buffer_manager.hpp"
 #include "draw.hpp"
 #include "editor.hpp"
+#include "latency.hpp"
 #include "panes/pane_manager.hpp"
+#include "profiler.hpp"
 #include "window.hpp"
 
 struct Menu {
   Editor editor;
   BasicBuffer buffer;
 
-  StackAllocator alloc = StackAllocator(&system_allocator, 32 * MB);
+  Arena alloc;
 
   bool open    = false;
   i32 selected = 0;
@@ -32,6 +34,7 @@ void process(Menu *menu, Actions *actions)
   if (menu->open) {
     for (i32 i = 0; i < actions->size; i++) {
       Action *action = &actions->operator[](i);
+      LatencyScope latency_scope(action);
       if (eat(action, Command::ESCAPE)) {
         close_menu(menu);
       } else if (eat(action, Command::INPUT_NEWLINE)) {
@@ -172,6 +175,7 @@ void draw_filemenu(Menu *menu, Draw::List *dl)
   if (!menu->open) {
     return;
   }
+  PROFILE_FUNCTION();
 
   static bool init = false;
   if (!init) {
@@ -181,15 +185,19 @@ void draw_filemenu(Menu *menu, Draw::List *dl)
   }
 
   menu->alloc.reset();
+  String query               = buffer_string(&menu->buffer);
   DynamicArray<String> files = Platform::list_files(".", &menu->alloc);
   DynamicArray<std::pair<i64, i64>> scores(&menu->alloc);
   DynamicArray<std::pair<i64, i64>> sorted(&menu->alloc);
   scores.set_capacity(files.size);
-  for (i64 i = 0; i < files.size; i++) {
-    i32 score = fuzzy_score({menu->buffer.data, menu->buffer.size}, files[i]);
-    if (score > 0) {
-      scores.push_back({i, score});
-      sorted.push_back({i, score});
+  {
+    PROFILE_ZONE("fuzzy_score");
+    for (i64 i = 0; i < files.size; i++) {
+      i32 score = fuzzy_score(query, files[i]);
+      if (score > 0) {
+        scores.push_back({i, score});
+        sorted.push_back({i, score});
+      }
     }
   }
   merge_sort(scores, sorted, 0, scores.size);
@@ -210,9 +218,8 @@ void draw_filemenu(Menu *menu, Draw::List *dl)
   Draw::push_rect(dl, 0, rect, {25, 27, 32});
 
   {
-    String text = {menu->buffer.data, menu->buffer.size};
-    Vec2f pos   = {margin, rect.y + margin};
-    draw_string(dl, dl->font, {187, 194, 207}, text, pos);
+    Vec2f pos = {margin, rect.y + margin};
+    draw_string(dl, dl->font, {187, 194, 207}, query, pos);
   }
 
   for (i64 i = 1; i < line_count && i < sorted.size; i++) {
@@ -233,7 +240,7 @@ void draw_filemenu(Menu *menu, Draw::List *dl)
     pos       = draw_string(dl, dl->font, {187, 194, 207}, text, pos);
     {
       pos.x += 5;
-      i32 score = fuzzy_score({menu->buffer.data, menu->buffer.size}, text);
+      i32 score = fuzzy_score(query, text);
       u8 score_characters[32];
       i32 str_len = snprintf((char *)score_characters, 32, "%i", score);
 
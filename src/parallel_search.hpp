@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "containers/dynamic_array.hpp"
+#include "memory.hpp"
+#include "profiler.hpp"
+#include "rope_buffer.hpp"
+#include "string.hpp"
+#include "types.hpp"
+#include "worker_pool.hpp"
+
+// Finding every match of a string at once on all the cores. The search pins a snapshot,
+// so the editor goes on editing newer roots, and cuts it into partitions of whole runs of
+// leaves. Each worker claims the next partition, descends to its first leaf and streams
+// its leaves through for_each_match, so a match that straddles two partitions is found by
+// the one it starts in. Every partition keeps its matches in an array of its own and once
+// they're all done the counts are summed into offsets, which put them in order as one
+// list without copying them.
+
+const i64 PARALLEL_PARTITION_MIN_SIZE = 1 * MB;
+const i64 PARALLEL_PARTITION_MAX_SIZE = 16 * MB;  // how far a cancel has to wait, at most
+
+struct SearchPartition {
+  i64 start;
+  i64 end;
+  DynamicArray<i64> matches = DynamicArray<i64>(&system_allocator);
+};
+
+struct ParallelSearch {
+  RopeBuffer snapshot;
+  DynamicArray<u8> needle = DynamicArray<u8>(&system_allocator);
+
+  DynamicArray<SearchPartition> partitions =
+      DynamicArray<SearchPartition>(&system_allocator);
+  DynamicArray<i64> offsets = DynamicArray<i64>(&system_allocator);  // set once finished
+  std::atomic<i64> next_partition{0};
+  std::atomic<i64> partitions_done{0};
+
+  std::atomic<i64> match_count{0};  // in the partitions done so far
+  std::atomic<bool> cancelled{false};
+  std::atomic<bool> finished{false};
+
+  std::atomic<i32> references{1};  // the one who started it, and each queued task
+};
+
+void release_parallel_search(ParallelSearch *search)
+{
+  if (search->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    for (i64 i = 0; i < search->partitions.size; i++) {
+      system_allocator.free(search->partitions.data[i].matches.allocation);
+    }
+    system_allocator.free(search->partitions.allocation);
+    system_allocator.free(search->offsets.allocation);
+    system_allocator.free(search->needle.allocation);
+    delete search;
+  }
+}
+
+// whoever finishes the last partition puts the results in order and lets go of the
+// snapshot
+void finish_partition(ParallelSearch *search)
+{
+  i64 done = search->partitions_done.fetch_add(1, std::memory_order_acq_rel) + 1;
+  if (done < search->partitions.size) {
+    return;
+  }
+
+  i64 offset = 0;
+  for (i64 i = 0; i < search->partitions.size; i++) {
+    search->offsets.push_back(offset);
+    offset += search->partitions.data[i].matches.size;
+  }
+  search->offsets.push_back(offset);
+
+  release_snapshot(search->snapshot);
+  search->finished.store(true, std::memory_order_release);
+}
+
+// claims partitions until there are none left
+void search_partitions(ParallelSearch *search)
+{
+  String needle = {search->needle.data, search->needle.size};
+  while (true) {
+    i64 i = search->next_partition.fetch_add(1, std::memory_order_relaxed);
+    if (i >= search->partitions.size) {
+      return;
+    }
+
+    SearchPartition *partition = &search->partitions.data[i];
+    if (!search->cancelled.load(std::memory_order_relaxed)) {
+      PROFILE_ZONE("search partition");
+      for_each_match(search->snapshot, partition->start, partition->end, needle,
+                     [&](i64 at) { partition->matches.push_back(at); });
+      search->match_count.fetch_add(partition->matches.size, std::memory_order_relaxed);
+    }
+    finish_partition(search);
+  }
+}
+
+void run_search_task(void *data, i64 index)
+{
+  ParallelSearch *search = (ParallelSearch *)data;
+  search_partitions(search);
+  release_parallel_search(search);
+}
+
+// searches the buffer as it is now on up to threads workers. partition_size is picked
+// from the size of the buffer unless it's given
+ParallelSearch *start_parallel_search(RopeBuffer buffer, String needle,
+                                      i32 threads        = worker_count(),
+                                      i64 partition_size = 0)
+{
+  ParallelSearch *search = new ParallelSearch();
+  search->needle.resize(needle.size);
+  memcpy(search->needle.data, needle.data, needle.size);
+  search->snapshot = take_snapshot(buffer);
+
+  // a few partitions per thread, so one that has more to push back doesn't hold up the
+  // rest
+  i64 size = buffer.rope.get_summary_or_empty().size;
+  if (partition_size == 0) {
+    partition_size = std::clamp(size / (threads * 4), PARALLEL_PARTITION_MIN_SIZE,
+                                PARALLEL_PARTITION_MAX_SIZE);
+  }
+  for (i64 start = 0; start < size || start == 0; start += partition_size) {
+    SearchPartition partition;
+    partition.start = start;
+    partition.end   = std::min(start + partition_size, size);
+    search->partitions.push_back(partition);
+  }
+
+  i64 tasks = std::min((i64)threads, search->partitions.size);
+  search->references.fetch_add(tasks, std::memory_order_relaxed);
+  run_on_workers(run_search_task, search, tasks);
+  return search;
+}
+
+// helps with the partitions nobody has claimed yet and returns once they're all done
+void wait_for_parallel_search(ParallelSearch *search)
+{
+  search_partitions(search);
+  while (!search->finished.load(std::memory_order_acquire)) {
+    std::this_thread::yield();
+  }
+}
+
+// the ith match in the whole buffer, once the search has finished
+i64 parallel_search_match(ParallelSearch *search, i64 i)
+{
+  i64 *offsets  = search->offsets.data;
+  i64 partition = std::upper_bound(offsets, offsets + search->offsets.size, i) - offsets;
+  partition--;
+  return search->partitions.data[partition].matches.data[i - offsets[partition]];
+}
+
+// stops the search if it's still running and lets go of it
+void cancel_parallel_search(ParallelSearch *search)
+{
+  search->cancelled.store(true, std::memory_order_relaxed);
+  release_parallel_search(search);
+}
+
+void parallel_search_tests()
+{
+  // fragmented, so partitions start in the middle of leaves and matches straddle them
+  RopeBuffer buffer = create_rope_buffer();
+  fill_rope(&buffer, "");
+  u64 random = 3;
+  for (i32 i = 0; i < 600; i++) {
+    random   = random * 6364136223846793005ull + 1442695040888963407ull;
+    u8 span[8];
+    i64 size = (random >> 40) % 8 + 1;
+    for (i64 c = 0; c < size; c++) span[c] = 'a' + (random >> (c * 3)) % 2;
+    i64 index = (random >> 20) % (buffer.rope.get_summary_or_empty().size + 1);
+    buffer_insert(buffer, cursor_at(buffer, index), String(span, size));
+  }
+  i64 size = buffer.rope.get_summary_or_empty().size;
+
+  for (String needle : {String("a"), String("abba"), String("babababa")}) {
+    DynamicArray<i64> expected(&system_allocator);
+    for_each_match(buffer, 0, size, needle, [&](i64 at) { expected.push_back(at); });
+
+    for (i64 partition_size : {(i64)0, (i64)7, (i64)1000}) {
+      ParallelSearch *search = start_parallel_search(buffer, needle, 3, partition_size);
+      wait_for_parallel_search(search);
+
+      assert(search->match_count.load() == expected.size);
+      for (i64 i = 0; i < expected.size; i++) {
+        assert(parallel_search_match(search, i) == expected.data[i]);
+      }
+      release_parallel_search(search);
+    }
+    system_allocator.free(expected.allocation);
+  }
+
+  // edits go on while it runs, it sees the buffer as it was
+  i64 count = 0;
+  for_each_match(buffer, 0, size, "bb", [&](i64 at) { count++; });
+  ParallelSearch *search = start_parallel_search(buffer, "bb", 2, 100);
+  for (i32 i = 0; i < 100; i++) buffer_insert(buffer, cursor_at(buffer, i * 7), "bbb");
+  wait_for_parallel_search(search);
+  assert(search->match_count.load() == count);
+  release_parallel_search(search);
+
+  search = start_parallel_search(buffer, "b", 2);
+  cancel_parallel_search(search);
+
+  release(buffer.rope);
+}
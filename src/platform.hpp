@@ -476,7 +476,7 @@ void setup_input_callbacks(GlfwWindow *window, Input *input)
   glfwSetScrollCallback(window->ref, scroll_callback);
 }
 
-DynamicArray<String> list_files(String root, StackAllocator *alloc)
+DynamicArray<String> list_files(String root, Arena *alloc)
 {
   DynamicArray<String> files(alloc);
   files.set_capacity(128);
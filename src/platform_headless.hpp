@@ -0,0 +1,20 @@
+#pragma once
+
+#include "memory.hpp"
+#include "string.hpp"
+#include "types.hpp"
+
+// stands in for platform.hpp in builds without a window or GPU, like the benchmarks
+namespace Platform
+{
+// there's no system clipboard without a window, so a copy only lives in this process
+Mem clipboard = {};
+
+void set_clipboard(String str)
+{
+  if (clipboard.data) system_allocator.free(clipboard);
+  clipboard = system_allocator.alloc(str.size);
+  memcpy(clipboard.data, str.data, str.size);
+}
+String get_clipboard() { return {clipboard.data, clipboard.data ? clipboard.size : 0}; }
+}  // namespace Platform
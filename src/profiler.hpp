@@ -0,0 +1,231 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+
+#include "memory.hpp"
+#include "timer.hpp"
+#include "types.hpp"
+
+// Scoped zones: PROFILE_ZONE("name") or PROFILE_FUNCTION() at the top of a scope records
+// when it started and ended. Every thread writes its zones into a ring of its own, a lane,
+// so recording takes no locks. A lane is handed back when its thread exits and the next
+// new thread reuses it with its ring started over, so short lived loading threads don't
+// use up lanes.
+//
+// The rings can be exported as a Chrome trace (chrome://tracing or ui.perfetto.dev) and
+// the last frame is drawn by profiler_overlay.hpp. Reading a ring while its thread writes
+// to it may show a zone that was just overwritten, that's fine for a profile.
+//
+// Build with -DENABLE_PROFILER=0 to compile the zones out.
+#ifndef ENABLE_PROFILER
+#define ENABLE_PROFILER 1
+#endif
+
+struct ProfileZoneEvent {
+  const char *name;
+  u64 start;
+  u64 end;
+  i32 depth;
+};
+
+const i64 PROFILE_RING_SIZE = 16 * 1024;
+const i32 MAX_PROFILE_LANES = 32;
+
+struct ProfileLane {
+  ProfileZoneEvent *events = nullptr;
+  i64 count                = 0;  // zones ever written, the ring holds the last ones
+  i32 depth                = 0;
+  const char *name         = nullptr;
+  bool in_use              = false;
+};
+
+struct Profiler {
+  ProfileLane lanes[MAX_PROFILE_LANES];
+
+  u64 frame_start      = 0;
+  u64 last_frame_start = 0;
+  u64 last_frame_end   = 0;
+
+  bool overlay_open = false;
+};
+Profiler profiler;
+
+ProfileLane *claim_profile_lane()
+{
+  for (i32 i = 0; i < MAX_PROFILE_LANES; i++) {
+    ProfileLane *lane = &profiler.lanes[i];
+    bool expected     = false;
+    if (__atomic_compare_exchange_n(&lane->in_use, &expected, true, false, __ATOMIC_ACQUIRE,
+                                    __ATOMIC_RELAXED)) {
+      if (!lane->events) {
+        Mem mem      = system_allocator.alloc(PROFILE_RING_SIZE * sizeof(ProfileZoneEvent));
+        lane->events = (ProfileZoneEvent *)mem.data;
+      }
+      // the zones of the thread that had it before aren't this one's
+      __atomic_store_n(&lane->count, 0, __ATOMIC_RELEASE);
+      lane->depth = 0;
+      lane->name  = nullptr;
+      return lane;
+    }
+  }
+  return nullptr;
+}
+
+// owned by one thread, gives its lane back when the thread exits
+struct ProfileLaneHandle {
+  ProfileLane *lane = nullptr;
+  bool claimed      = false;
+
+  ProfileLane *get()
+  {
+    if (!claimed) {
+      lane    = claim_profile_lane();
+      claimed = true;
+    }
+    return lane;
+  }
+
+  ~ProfileLaneHandle()
+  {
+    if (lane) {
+      __atomic_store_n(&lane->in_use, false, __ATOMIC_RELEASE);
+    }
+  }
+};
+thread_local ProfileLaneHandle profile_lane;
+
+void set_profile_thread_name(const char *name)
+{
+  ProfileLane *lane = profile_lane.get();
+  if (lane) lane->name = name;
+}
+
+struct ProfileZone {
+  ProfileLane *lane;
+  const char *name;
+  u64 start;
+
+  ProfileZone(const char *name)
+  {
+    this->name = name;
+    lane       = profile_lane.get();
+    if (lane) lane->depth++;
+    start = now_ns();
+  }
+
+  ~ProfileZone()
+  {
+    u64 end = now_ns();
+    if (!lane) return;
+
+    lane->depth--;
+    i64 count = lane->count;
+
+    lane->events[count % PROFILE_RING_SIZE] = {name, start, end, lane->depth};
+    __atomic_store_n(&lane->count, count + 1, __ATOMIC_RELEASE);
+  }
+};
+
+#if ENABLE_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_FUNCTION()
+#endif
+
+// marks the start of a frame on the main thread, the overlay shows the frame before
+void profile_frame()
+{
+  u64 now                   = now_ns();
+  profiler.last_frame_start = profiler.frame_start;
+  profiler.last_frame_end   = now;
+  profiler.frame_start      = now;
+}
+
+// calls f with every zone still in the lane's ring, oldest first
+template <typename F>
+void for_each_zone(ProfileLane *lane, F f)
+{
+  if (!lane->events) return;
+
+  i64 count = __atomic_load_n(&lane->count, __ATOMIC_ACQUIRE);
+  for (i64 i = std::max(count - PROFILE_RING_SIZE, (i64)0); i < count; i++) {
+    f(lane->events[i % PROFILE_RING_SIZE]);
+  }
+}
+
+bool export_chrome_trace(const char *filename)
+{
+  FILE *file = fopen(filename, "w");
+  if (!file) {
+    return false;
+  }
+
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  bool first = true;
+  for (i32 i = 0; i < MAX_PROFILE_LANES; i++) {
+    ProfileLane *lane = &profiler.lanes[i];
+    if (!lane->events) continue;
+
+    if (lane->name) {
+      fprintf(file,
+              "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+              "\"args\":{\"name\":\"%s\"}}",
+              first ? "" : ",\n", i, lane->name);
+      first = false;
+    }
+    for_each_zone(lane, [&](ProfileZoneEvent event) {
+      fprintf(file,
+              "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+              first ? "" : ",\n", event.name, i, event.start / 1000.0,
+              (event.end - event.start) / 1000.0);
+      first = false;
+    });
+  }
+  fprintf(file, "\n]}\n");
+
+  fclose(file);
+  return true;
+}
+
+void profiler_tests()
+{
+  ProfileLane *lane = profile_lane.get();
+  assert(lane);
+  i64 before = lane->count;
+  {
+    ProfileZone outer("outer");
+    {
+      ProfileZone inner("inner");
+    }
+  }
+
+  // inner ends first, one deeper
+  ProfileZoneEvent inner = lane->events[before % PROFILE_RING_SIZE];
+  ProfileZoneEvent outer = lane->events[(before + 1) % PROFILE_RING_SIZE];
+  assert(lane->count == before + 2);
+  assert(strcmp(inner.name, "inner") == 0 && inner.depth == outer.depth + 1);
+  assert(outer.start <= inner.start && inner.end <= outer.end);
+  assert(lane->depth == 0);
+
+  i64 seen = 0;
+  for_each_zone(lane, [&](ProfileZoneEvent event) { seen++; });
+  assert(seen == std::min(lane->count, PROFILE_RING_SIZE));
+
+  // a thread that takes over the lane of one that exited starts with an empty ring
+  std::thread([]() { ProfileZone zone("exited"); }).join();
+  std::thread([&]() {
+    ProfileLane *reused = profile_lane.get();
+    assert(reused && reused->count == 0);
+    seen = 0;
+    for_each_zone(reused, [&](ProfileZoneEvent event) { seen++; });
+    assert(seen == 0);
+  }).join();
+}
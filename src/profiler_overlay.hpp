@@ -0,0 +1,67 @@
+#pragma once
+
+#include "draw.hpp"
+#include "font.hpp"
+#include "profiler.hpp"
+
+// a flame graph of the last frame across the top of the canvas, one band per thread with
+// a row per zone depth. the time axis is at least a 60 hz frame long so a fast frame
+// doesn't stretch to fill the width, the line marks where the frame budget ends
+void draw_profiler_overlay(Draw::List *dl)
+{
+  if (!profiler.overlay_open || profiler.last_frame_start == 0) {
+    return;
+  }
+
+  Font &font = dl->font;
+
+  u64 frame_start = profiler.last_frame_start;
+  u64 frame_end   = profiler.last_frame_end;
+  u64 budget      = 16600000;
+  f64 span        = std::max(frame_end - frame_start, budget);
+
+  f32 margin     = 12.f;
+  f32 row_height = font.height;
+  f32 width      = dl->canvas_size.x - margin * 2;
+  Color colors[] = {{97, 175, 239}, {152, 195, 121}, {229, 192, 123}, {198, 120, 221}};
+  Color text     = Color(25, 27, 32);
+
+  f32 y = margin;
+  for (i32 l = 0; l < MAX_PROFILE_LANES; l++) {
+    ProfileLane *lane = &profiler.lanes[l];
+    if (!lane->events) continue;
+
+    // zones are in the ring in the order they ended, so walk back until they end before
+    // the frame
+    i32 max_depth = -1;
+    i64 count     = __atomic_load_n(&lane->count, __ATOMIC_ACQUIRE);
+    for (i64 i = count - 1; i >= std::max(count - PROFILE_RING_SIZE, (i64)0); i--) {
+      ProfileZoneEvent event = lane->events[i % PROFILE_RING_SIZE];
+      if (event.end < frame_start) break;
+      if (event.start > frame_end) continue;
+
+      f64 start   = std::max(event.start, frame_start) - frame_start;
+      f64 end     = std::min(event.end, frame_end) - frame_start;
+      Rect4f rect = {
+          (f32)(margin + start / span * width),
+          y + event.depth * row_height,
+          std::max((f32)((end - start) / span * width), 1.f),
+          row_height,
+      };
+      Draw::push_rect(dl, 0, rect, colors[event.depth % 4]);
+
+      String name = {(u8 *)event.name, (i64)strlen(event.name)};
+      if (text_width(font, name) < rect.width) {
+        draw_string(dl, font, text, name, {rect.x, rect.y});
+      }
+      max_depth = std::max(max_depth, event.depth);
+    }
+
+    if (max_depth >= 0) {
+      y += (max_depth + 1) * row_height + margin;
+    }
+  }
+
+  f32 budget_x = margin + budget / span * width;
+  Draw::push_line(dl, 0, {budget_x, margin}, {budget_x, y}, Color(224, 108, 117));
+}
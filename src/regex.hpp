@@ -0,0 +1,1382 @@
+#pragma once
+
+#include <ctype.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "containers/dynamic_array.hpp"
+#include "containers/hash_map.hpp"
+#include "containers/segmented_array.hpp"
+#include "memory.hpp"
+#include "profiler.hpp"
+#include "rope_buffer.hpp"
+#include "string.hpp"
+#include "text.hpp"
+#include "types.hpp"
+
+// Regular expressions, matched leftmost-longest like egrep: of the matches that start
+// first, the longest one. The syntax is
+//
+//   abc       bytes as they are, UTF-8 in the pattern matches UTF-8 in the text
+//   .         any character but a newline, a whole UTF-8 sequence
+//   [a-z_]    any byte in the class, [^...] any character not in it or a newline
+//   \d \w \s  digits, word bytes and whitespace, \D \W \S anything else but a newline
+//   \n \t \r  and a backslash before any punctuation for the punctuation itself
+//   ^ $       the start and end of a line
+//   a|b (a)   alternatives, and groups, (?:a) too. groups don't capture
+//   * + ?     repeats, {n} {n,} {n,m} as well
+//
+// A pattern compiles to a Thompson program and to the same program for the pattern
+// reversed. Each program is run by a DFA that is built lazily: a state is the set of
+// program threads alive at a position, and a transition is only worked out the first
+// time it's taken, then cached in a table. The bytes are first mapped to classes of bytes
+// that no part of the pattern tells apart, so a table row is only as wide as the number
+// of classes. When the states outgrow their budget the cache is thrown away and rebuilt
+// from where the scan is.
+//
+// The forward DFA streams the leaves from the start of the search and stops once it
+// knows where the leftmost longest match ends, then the reverse DFA walks back from
+// there to find where it starts. Neither needs the buffer to be flat. A match that ends
+// is only noticed on the next byte, so that $ can see whether that byte is a newline.
+
+const i32 REGEX_MAX_INSTRUCTIONS = 16 * 1024;
+const i32 REGEX_MAX_REPEAT       = 1000;
+
+struct ByteSet {
+  u64 bits[4] = {};
+
+  bool has(u8 c) { return (bits[c >> 6] >> (c & 63)) & 1; }
+  void add(u8 c) { bits[c >> 6] |= 1ull << (c & 63); }
+  void add_range(u8 first, u8 last)
+  {
+    for (i32 c = first; c <= last; c++) add(c);
+  }
+  void add(ByteSet other)
+  {
+    for (i32 i = 0; i < 4; i++) bits[i] |= other.bits[i];
+  }
+};
+
+enum struct RegexOp : u8 {
+  BYTES,
+  SPLIT,
+  JUMP,
+  LINE_START,
+  LINE_END,
+  MATCH,
+};
+
+struct RegexInstruction {
+  RegexOp op;
+  i32 x;  // the set for BYTES, where SPLIT and JUMP go
+  i32 y;  // the other way SPLIT goes
+};
+
+struct RegexProgram {
+  DynamicArray<RegexInstruction> instructions =
+      DynamicArray<RegexInstruction>(&system_allocator);
+  bool has_line_start = false;
+};
+
+struct Regex;
+
+// between the threads of a state that started at different positions, earlier first
+const u32 DFA_MARK = 0xffffffff;
+
+enum DfaFlags : u8 {
+  DFA_MATCH      = 1,  // a match ended just before the byte that led here
+  DFA_DEAD       = 2,  // nothing can match from here on
+  DFA_STARTING   = 4,  // a thread starts at every position until something matches
+  DFA_LINE_START = 8,
+};
+const u8 DFA_STOP = DFA_MATCH | DFA_DEAD;
+
+const i64 DFA_CACHE_BYTES = 2 * MB;
+
+struct Dfa {
+  Regex *regex;
+  RegexProgram *program;
+
+  // a row per state: where each class goes, -1 until it's been taken, then where the end
+  // of the text goes and last the state's flags
+  DynamicArray<i32> transitions = DynamicArray<i32>(&system_allocator);
+  i32 stride;
+
+  DynamicArray<String> states = DynamicArray<String>(&system_allocator);  // the keys
+  HashMap<String, i32> cache  = HashMap<String, i32>(&system_allocator);   // key to row
+  Arena key_memory;
+  i32 start_states[4];  // by whether it's at a line start and whether it's anchored
+
+  i64 cache_bytes = 0;
+  i64 cache_limit = DFA_CACHE_BYTES;
+  i64 flushes     = 0;
+};
+
+struct Regex {
+  const char *error = nullptr;  // why the pattern didn't compile
+
+  DynamicArray<ByteSet> sets = DynamicArray<ByteSet>(&system_allocator);
+  RegexProgram forward_program;
+  RegexProgram reverse_program;
+
+  u8 classes[256];
+  u8 class_bytes[256];  // a byte in each class
+  i32 class_count;
+  i32 newline_class;
+
+  // while the forward DFA is only waiting for a match to start it skips to the next place
+  // one can: to the bytes every match starts with, found with the find kernels, or else
+  // to a byte a match can start with
+  u8 prefix[64];
+  i32 prefix_size;
+  bool first_bytes[256];
+  bool skip_to_first_byte;
+
+  Dfa forward;
+  Dfa reverse;
+};
+
+struct RegexMatch {
+  i64 start;
+  i64 end;
+};
+
+//////////////////////////////////////////////
+
+enum struct RegexNodeKind : u8 {
+  EMPTY,
+  BYTES,
+  CONCAT,
+  ALTERNATE,
+  REPEAT,
+  LINE_START,
+  LINE_END,
+};
+
+struct RegexNode {
+  RegexNodeKind kind;
+  i32 a;  // the set for BYTES, the first or only child otherwise
+  i32 b;
+  i32 min;
+  i32 max;  // -1 for no limit
+};
+
+struct RegexParser {
+  String pattern;
+  i64 at = 0;
+  Regex *regex;
+  DynamicArray<RegexNode> *nodes;
+  const char *error = nullptr;
+};
+
+i32 add_node(RegexParser *p, RegexNodeKind kind, i32 a = 0, i32 b = 0, i32 min = 0,
+             i32 max = 0)
+{
+  return p->nodes->push_back({kind, a, b, min, max});
+}
+i32 bytes_node(RegexParser *p, ByteSet set)
+{
+  return add_node(p, RegexNodeKind::BYTES, p->regex->sets.push_back(set));
+}
+i32 concat_node(RegexParser *p, i32 a, i32 b)
+{
+  if (a == -1) return b;
+  return add_node(p, RegexNodeKind::CONCAT, a, b);
+}
+
+// any character that isn't ASCII or is in ascii, with the multibyte ones matched as a
+// whole sequence
+i32 any_char_node(RegexParser *p, ByteSet ascii)
+{
+  ByteSet continuation, two, three, four;
+  continuation.add_range(0x80, 0xbf);
+  two.add_range(0xc0, 0xdf);
+  three.add_range(0xe0, 0xef);
+  four.add_range(0xf0, 0xf7);
+
+  i32 tail   = bytes_node(p, continuation);
+  i32 tail2  = concat_node(p, tail, bytes_node(p, continuation));
+  i32 tail3  = concat_node(p, tail2, bytes_node(p, continuation));
+  i32 node   = concat_node(p, bytes_node(p, four), tail3);
+  node       = add_node(p, RegexNodeKind::ALTERNATE,
+                        concat_node(p, bytes_node(p, three), tail2), node);
+  node       = add_node(p, RegexNodeKind::ALTERNATE,
+                        concat_node(p, bytes_node(p, two), tail), node);
+  return add_node(p, RegexNodeKind::ALTERNATE, bytes_node(p, ascii), node);
+}
+
+// every ASCII byte but a newline that isn't in set
+ByteSet ascii_complement(ByteSet set)
+{
+  ByteSet complement;
+  for (i32 c = 0; c < 0x80; c++) {
+    if (!set.has(c) && c != '\n') complement.add(c);
+  }
+  return complement;
+}
+
+bool at_end(RegexParser *p) { return p->at >= p->pattern.size; }
+u8 peek(RegexParser *p) { return p->pattern.data[p->at]; }
+
+// the class for \d \w \s, sets negated for the uppercase ones
+bool escape_class(u8 c, ByteSet *set, bool *negated)
+{
+  *negated = c == 'D' || c == 'W' || c == 'S';
+  switch (c) {
+    case 'd':
+    case 'D':
+      set->add_range('0', '9');
+      return true;
+    case 'w':
+    case 'W':
+      set->add_range('a', 'z');
+      set->add_range('A', 'Z');
+      set->add_range('0', '9');
+      set->add('_');
+      return true;
+    case 's':
+    case 'S':
+      for (u8 space : {' ', '\t', '\n', '\r', '\f', '\v'}) set->add(space);
+      return true;
+  }
+  return false;
+}
+
+bool escape_byte(RegexParser *p, u8 c, u8 *byte)
+{
+  switch (c) {
+    case 'n':
+      *byte = '\n';
+      return true;
+    case 't':
+      *byte = '\t';
+      return true;
+    case 'r':
+      *byte = '\r';
+      return true;
+  }
+  if (isalnum(c)) {
+    p->error = "unknown escape";
+    return false;
+  }
+  *byte = c;
+  return true;
+}
+
+i32 parse_class(RegexParser *p)
+{
+  bool negated = !at_end(p) && peek(p) == '^';
+  if (negated) p->at++;
+
+  ByteSet set;
+  bool first = true;
+  while (!at_end(p) && (peek(p) != ']' || first)) {
+    first  = false;
+    u8 low = p->pattern.data[p->at++];
+    if (low == '\\') {
+      if (at_end(p)) break;
+      u8 c = p->pattern.data[p->at++];
+
+      ByteSet escaped;
+      bool escaped_negated;
+      if (escape_class(c, &escaped, &escaped_negated)) {
+        set.add(escaped_negated ? ascii_complement(escaped) : escaped);
+        continue;
+      }
+      if (!escape_byte(p, c, &low)) return -1;
+    }
+
+    u8 high = low;
+    if (p->at + 1 < p->pattern.size && peek(p) == '-' && p->pattern.data[p->at + 1] != ']') {
+      high = p->pattern.data[p->at + 1];
+      p->at += 2;
+      if (high == '\\') {
+        if (at_end(p) || !escape_byte(p, p->pattern.data[p->at++], &high)) {
+          if (!p->error) p->error = "unterminated class";
+          return -1;
+        }
+      }
+      if (high < low) {
+        p->error = "range out of order";
+        return -1;
+      }
+    }
+    set.add_range(low, high);
+  }
+  if (at_end(p)) {
+    p->error = "unterminated class";
+    return -1;
+  }
+  p->at++;
+
+  return negated ? any_char_node(p, ascii_complement(set)) : bytes_node(p, set);
+}
+
+i32 parse_alternation(RegexParser *p, i32 depth);
+
+i32 parse_atom(RegexParser *p, i32 depth)
+{
+  u8 c = p->pattern.data[p->at++];
+  switch (c) {
+    case '(': {
+      if (p->at + 1 < p->pattern.size && peek(p) == '?' && p->pattern.data[p->at + 1] == ':') {
+        p->at += 2;
+      }
+      i32 node = parse_alternation(p, depth + 1);
+      if (node == -1) return -1;
+      if (at_end(p) || peek(p) != ')') {
+        p->error = "missing )";
+        return -1;
+      }
+      p->at++;
+      return node;
+    }
+    case '[':
+      return parse_class(p);
+    case '.':
+      return any_char_node(p, ascii_complement({}));
+    case '^':
+      return add_node(p, RegexNodeKind::LINE_START);
+    case '$':
+      return add_node(p, RegexNodeKind::LINE_END);
+    case '*':
+    case '+':
+    case '?':
+      p->error = "nothing to repeat";
+      return -1;
+    case '\\': {
+      if (at_end(p)) {
+        p->error = "trailing \\";
+        return -1;
+      }
+      u8 escaped = p->pattern.data[p->at++];
+
+      ByteSet set;
+      bool negated;
+      if (escape_class(escaped, &set, &negated)) {
+        return negated ? any_char_node(p, ascii_complement(set)) : bytes_node(p, set);
+      }
+      if (!escape_byte(p, escaped, &c)) return -1;
+    } break;
+  }
+
+  ByteSet set;
+  set.add(c);
+  return bytes_node(p, set);
+}
+
+bool parse_count(RegexParser *p, i32 *count)
+{
+  if (at_end(p) || !isdigit(peek(p))) return false;
+
+  *count = 0;
+  while (!at_end(p) && isdigit(peek(p))) {
+    *count = std::min(*count * 10 + (peek(p) - '0'), REGEX_MAX_REPEAT + 1);
+    p->at++;
+  }
+  return true;
+}
+
+// {n} {n,} or {n,m}, a brace that doesn't start one of those is just a brace
+bool parse_braces(RegexParser *p, i32 *min, i32 *max)
+{
+  i64 start = p->at;
+  p->at++;
+  if (parse_count(p, min)) {
+    *max = *min;
+    if (!at_end(p) && peek(p) == ',') {
+      p->at++;
+      if (!parse_count(p, max)) *max = -1;
+    }
+    if (!at_end(p) && peek(p) == '}') {
+      p->at++;
+      return true;
+    }
+  }
+  p->at = start;
+  return false;
+}
+
+i32 parse_repeat(RegexParser *p, i32 depth)
+{
+  i32 node = parse_atom(p, depth);
+  while (node != -1 && !at_end(p)) {
+    i32 min, max;
+    u8 c = peek(p);
+    if (c == '*' || c == '+' || c == '?') {
+      p->at++;
+      min = c == '+';
+      max = c == '?' ? 1 : -1;
+    } else if (c != '{' || !parse_braces(p, &min, &max)) {
+      break;
+    }
+
+    if (min > REGEX_MAX_REPEAT || max > REGEX_MAX_REPEAT) {
+      p->error = "repeat count too big";
+      return -1;
+    }
+    if (max != -1 && max < min) {
+      p->error = "repeat range out of order";
+      return -1;
+    }
+    node = add_node(p, RegexNodeKind::REPEAT, node, 0, min, max);
+  }
+  return node;
+}
+
+i32 parse_alternation(RegexParser *p, i32 depth)
+{
+  if (depth > 100) {
+    p->error = "groups nested too deep";
+    return -1;
+  }
+
+  i32 alternation = -1;
+  while (true) {
+    i32 sequence = -1;
+    while (!at_end(p) && peek(p) != '|' && peek(p) != ')') {
+      i32 node = parse_repeat(p, depth);
+      if (node == -1) return -1;
+      sequence = concat_node(p, sequence, node);
+    }
+    if (sequence == -1) sequence = add_node(p, RegexNodeKind::EMPTY);
+
+    alternation = alternation == -1
+                      ? sequence
+                      : add_node(p, RegexNodeKind::ALTERNATE, alternation, sequence);
+    if (at_end(p) || peek(p) != '|') break;
+    p->at++;
+  }
+  return alternation;
+}
+
+//////////////////////////////////////////////
+
+i32 emit(RegexProgram *program, RegexOp op, i32 x = 0, i32 y = 0)
+{
+  return program->instructions.push_back({op, x, y});
+}
+
+// reversed, concatenations are emitted back to front and the line assertions swap
+bool compile_node(RegexProgram *program, DynamicArray<RegexNode> *nodes, i32 index,
+                  bool reversed)
+{
+  if (program->instructions.size > REGEX_MAX_INSTRUCTIONS) {
+    return false;
+  }
+
+  DynamicArray<RegexInstruction> &code = program->instructions;
+  RegexNode node                       = nodes->data[index];
+  switch (node.kind) {
+    case RegexNodeKind::EMPTY:
+      return true;
+    case RegexNodeKind::BYTES:
+      emit(program, RegexOp::BYTES, node.a);
+      return true;
+    case RegexNodeKind::CONCAT:
+      return compile_node(program, nodes, reversed ? node.b : node.a, reversed) &&
+             compile_node(program, nodes, reversed ? node.a : node.b, reversed);
+    case RegexNodeKind::ALTERNATE: {
+      i32 split = emit(program, RegexOp::SPLIT, code.size + 1);
+      if (!compile_node(program, nodes, node.a, reversed)) return false;
+      i32 jump      = emit(program, RegexOp::JUMP);
+      code.data[split].y = code.size;
+      if (!compile_node(program, nodes, node.b, reversed)) return false;
+      code.data[jump].x = code.size;
+      return true;
+    }
+    case RegexNodeKind::REPEAT: {
+      for (i32 i = 0; i < node.min; i++) {
+        if (!compile_node(program, nodes, node.a, reversed)) return false;
+      }
+      if (node.max == -1) {
+        i32 loop = emit(program, RegexOp::SPLIT, code.size + 1);
+        if (!compile_node(program, nodes, node.a, reversed)) return false;
+        emit(program, RegexOp::JUMP, loop);
+        code.data[loop].y = code.size;
+        return true;
+      }
+
+      // each optional copy can skip straight to the end
+      i32 first_split = code.size;
+      for (i32 i = node.min; i < node.max; i++) {
+        emit(program, RegexOp::SPLIT, code.size + 1, -1);
+        if (!compile_node(program, nodes, node.a, reversed)) return false;
+      }
+      for (i32 i = first_split; i < code.size; i++) {
+        if (code.data[i].op == RegexOp::SPLIT && code.data[i].y == -1) {
+          code.data[i].y = code.size;
+        }
+      }
+      return true;
+    }
+    case RegexNodeKind::LINE_START:
+    case RegexNodeKind::LINE_END: {
+      bool start = (node.kind == RegexNodeKind::LINE_START) != reversed;
+      emit(program, start ? RegexOp::LINE_START : RegexOp::LINE_END);
+      program->has_line_start |= start;
+      return true;
+    }
+  }
+  return false;
+}
+
+// bytes that no set tells apart share a class. classes are runs of bytes, cut wherever
+// some set starts or stops including them, and a newline always gets one of its own
+void compute_byte_classes(Regex *regex)
+{
+  bool cut[256] = {};
+  cut['\n'] = cut['\n' + 1] = true;
+  for (i64 i = 0; i < regex->sets.size; i++) {
+    ByteSet set = regex->sets[i];
+    for (i32 c = 1; c < 256; c++) {
+      if (set.has(c) != set.has(c - 1)) cut[c] = true;
+    }
+  }
+
+  i32 current = 0;
+  for (i32 c = 0; c < 256; c++) {
+    if (c > 0 && cut[c]) current++;
+    regex->classes[c]           = current;
+    regex->class_bytes[current] = c;
+  }
+  regex->class_count   = current + 1;
+  regex->newline_class = regex->classes['\n'];
+}
+
+void compute_prefilter(Regex *regex);
+
+void reset_dfa(Dfa *dfa)
+{
+  dfa->states.clear();
+  dfa->transitions.clear();
+  dfa->cache.clear();
+  dfa->key_memory.reset();
+  dfa->cache_bytes = 0;
+  for (i32 i = 0; i < 4; i++) dfa->start_states[i] = -1;
+}
+
+bool compile_regex(Regex *regex, String pattern)
+{
+  Temp tmp;
+  DynamicArray<RegexNode> nodes(&tmp);
+
+  RegexParser parser;
+  parser.pattern = pattern;
+  parser.regex   = regex;
+  parser.nodes   = &nodes;
+
+  i32 root = parse_alternation(&parser, 0);
+  if (root != -1 && !at_end(&parser)) {
+    parser.error = "unmatched )";
+  }
+  if (parser.error) {
+    regex->error = parser.error;
+    return false;
+  }
+
+  for (bool reversed : {false, true}) {
+    RegexProgram *program = reversed ? &regex->reverse_program : &regex->forward_program;
+    if (!compile_node(program, &nodes, root, reversed) ||
+        program->instructions.size > REGEX_MAX_INSTRUCTIONS) {
+      regex->error = "pattern too big";
+      return false;
+    }
+    emit(program, RegexOp::MATCH);
+  }
+  compute_byte_classes(regex);
+  compute_prefilter(regex);
+
+  for (Dfa *dfa : {&regex->forward, &regex->reverse}) {
+    dfa->regex  = regex;
+    dfa->stride = regex->class_count + 2;
+  }
+  regex->forward.program = &regex->forward_program;
+  regex->reverse.program = &regex->reverse_program;
+  reset_dfa(&regex->forward);
+  reset_dfa(&regex->reverse);
+  return true;
+}
+
+void free_dfa(Dfa *dfa)
+{
+  system_allocator.free(dfa->states.allocation);
+  system_allocator.free(dfa->transitions.allocation);
+  system_allocator.free(dfa->cache.allocation);
+  dfa->key_memory.reset();
+}
+void free_regex(Regex *regex)
+{
+  system_allocator.free(regex->sets.allocation);
+  system_allocator.free(regex->forward_program.instructions.allocation);
+  system_allocator.free(regex->reverse_program.instructions.allocation);
+  free_dfa(&regex->forward);
+  free_dfa(&regex->reverse);
+}
+
+//////////////////////////////////////////////
+
+struct ThreadList {
+  DynamicArray<u32> threads;
+  DynamicArray<i32> stack;
+  u8 *seen;  // by instruction, a thread is only added once per state
+};
+
+// follows the program from pc to the instructions that wait on a byte, a match, or a
+// line end that isn't known yet
+void add_thread(RegexProgram *program, ThreadList *list, i32 pc, bool line_start,
+                bool line_end)
+{
+  list->stack.push_back(pc);
+  while (list->stack.size > 0) {
+    pc = list->stack.data[--list->stack.size];
+    if (list->seen[pc]) continue;
+    list->seen[pc] = true;
+
+    RegexInstruction instruction = program->instructions.data[pc];
+    switch (instruction.op) {
+      case RegexOp::JUMP:
+        list->stack.push_back(instruction.x);
+        break;
+      case RegexOp::SPLIT:
+        list->stack.push_back(instruction.y);
+        list->stack.push_back(instruction.x);
+        break;
+      case RegexOp::LINE_START:
+        if (line_start) list->stack.push_back(pc + 1);
+        break;
+      case RegexOp::LINE_END:
+        if (line_end) {
+          list->stack.push_back(pc + 1);
+        } else {
+          list->threads.push_back(pc);
+        }
+        break;
+      case RegexOp::BYTES:
+      case RegexOp::MATCH:
+        list->threads.push_back(pc);
+        break;
+    }
+  }
+}
+
+// closes off the threads added since group_start as one start position's, sorted so the
+// same set always makes the same state
+void end_group(ThreadList *list, i64 group_start)
+{
+  std::sort(list->threads.data + group_start, list->threads.data + list->threads.size);
+  if (list->threads.size > group_start) list->threads.push_back(DFA_MARK);
+}
+
+// states are known by where their row starts in the transitions, so a step is one load
+i32 add_dfa_state(Dfa *dfa, u8 flags, u32 *threads, i64 count)
+{
+  // no trailing mark, so a state doesn't depend on which group was last
+  if (count > 0 && threads[count - 1] == DFA_MARK) count--;
+  if (count == 0 && !(flags & DFA_STARTING)) flags |= DFA_DEAD;
+
+  Temp tmp;
+  Mem key_mem = tmp.alloc((count + 1) * sizeof(u32));
+  u32 *words  = (u32 *)key_mem.data;
+  words[0]    = flags;
+  memcpy(words + 1, threads, count * sizeof(u32));
+  String key = {key_mem.data, key_mem.size};
+
+  i32 *existing = dfa->cache.get(key);
+  if (existing) {
+    return *existing;
+  }
+
+  Mem stored = dfa->key_memory.alloc(key.size);
+  memcpy(stored.data, key.data, key.size);
+  key.data = stored.data;
+  dfa->states.push_back(key);
+
+  i32 row = dfa->transitions.size;
+  dfa->transitions.resize(row + dfa->stride);
+  for (i64 i = 0; i < dfa->stride - 1; i++) dfa->transitions.data[row + i] = -1;
+  dfa->transitions.data[row + dfa->stride - 1] = flags;
+  dfa->cache.put(key, row);
+
+  dfa->cache_bytes += key.size + dfa->stride * sizeof(i32) + sizeof(String) + 32;
+  return row;
+}
+
+ThreadList thread_list(Allocator *allocator, RegexProgram *program)
+{
+  ThreadList list = {DynamicArray<u32>(allocator), DynamicArray<i32>(allocator)};
+  Mem seen        = allocator->alloc(program->instructions.size);
+  list.seen       = seen.data;
+  memset(list.seen, 0, seen.size);
+  return list;
+}
+
+// finds the prefix and the first bytes of matches. nothing is skipped when the empty string
+// matches
+void compute_prefilter(Regex *regex)
+{
+  RegexProgram *program = &regex->forward_program;
+  regex->prefix_size        = 0;
+  regex->skip_to_first_byte = false;
+  memset(regex->first_bytes, 0, sizeof(regex->first_bytes));
+
+  Temp tmp;
+  for (bool line_end : {false, true}) {
+    ThreadList list = thread_list(&tmp, program);
+    add_thread(program, &list, 0, true, line_end);
+    for (i64 i = 0; i < list.threads.size; i++) {
+      RegexInstruction instruction = program->instructions.data[list.threads.data[i]];
+      if (instruction.op == RegexOp::MATCH) return;
+      if (instruction.op == RegexOp::LINE_END) regex->first_bytes['\n'] = true;
+      if (instruction.op != RegexOp::BYTES) continue;
+
+      for (i32 c = 0; c < 256; c++) {
+        if (regex->sets.data[instruction.x].has(c)) regex->first_bytes[c] = true;
+      }
+    }
+  }
+  // from a line start the DFA is in another state, it has to see the newline
+  if (program->has_line_start) regex->first_bytes['\n'] = true;
+
+  i32 first_byte_count = 0;
+  for (i32 c = 0; c < 256; c++) first_byte_count += regex->first_bytes[c];
+  // past a handful of bytes they're in most text and stopping costs more than it saves
+  regex->skip_to_first_byte = first_byte_count <= 16;
+
+  // follow the program while it can only go one way, on one byte
+  i32 pc = 0;
+  while (regex->prefix_size < (i32)sizeof(regex->prefix)) {
+    ThreadList list = thread_list(&tmp, program);
+    add_thread(program, &list, pc, true, false);
+    if (list.threads.size != 1) break;
+
+    RegexInstruction instruction = program->instructions.data[list.threads.data[0]];
+    if (instruction.op != RegexOp::BYTES) break;
+
+    i32 byte = -1;
+    for (i32 c = 0; c < 256; c++) {
+      if (!regex->sets.data[instruction.x].has(c)) continue;
+      byte = byte == -1 ? c : 256;
+    }
+    if (byte == 256) break;
+
+    regex->prefix[regex->prefix_size++] = byte;
+    pc                                  = list.threads.data[0] + 1;
+  }
+}
+
+i32 dfa_start(Dfa *dfa, bool line_start, bool anchored)
+{
+  i32 slot = line_start * 2 + anchored;
+  if (dfa->start_states[slot] != -1) {
+    return dfa->start_states[slot];
+  }
+
+  Temp tmp;
+  ThreadList list = thread_list(&tmp, dfa->program);
+  add_thread(dfa->program, &list, 0, line_start, false);
+  end_group(&list, 0);
+
+  u8 flags = anchored ? 0 : DFA_STARTING;
+  if (line_start && dfa->program->has_line_start) flags |= DFA_LINE_START;
+  dfa->start_states[slot] = add_dfa_state(dfa, flags, list.threads.data, list.threads.size);
+  return dfa->start_states[slot];
+}
+
+// works out and caches where the state at row from goes on a byte of the class, or at the
+// end of the text for class_count
+i32 dfa_transition(Dfa *dfa, i32 from, i32 byte_class)
+{
+  Regex *regex          = dfa->regex;
+  RegexProgram *program = dfa->program;
+  bool at_text_end      = byte_class == regex->class_count;
+  bool at_newline       = byte_class == regex->newline_class;
+
+  Temp tmp;
+  String from_key = dfa->states.data[from / dfa->stride];
+  i64 count       = from_key.size / sizeof(u32) - 1;
+  u8 flags        = ((u32 *)from_key.data)[0];
+  u32 *threads    = (u32 *)tmp.alloc(count * sizeof(u32)).data;
+  memcpy(threads, (u32 *)from_key.data + 1, count * sizeof(u32));
+
+  if (dfa->cache_bytes > dfa->cache_limit) {
+    reset_dfa(dfa);
+    dfa->flushes++;
+    from = add_dfa_state(dfa, flags, threads, count);
+  }
+
+  // now that the next byte is known, threads waiting on $ can go on
+  if ((at_text_end || at_newline) && count > 0) {
+    ThreadList resolved = thread_list(&tmp, program);
+    i64 group_start     = 0;
+    for (i64 i = 0; i < count; i++) {
+      if (threads[i] == DFA_MARK) {
+        end_group(&resolved, group_start);
+        group_start = resolved.threads.size;
+        continue;
+      }
+      add_thread(program, &resolved, threads[i], flags & DFA_LINE_START, true);
+    }
+    end_group(&resolved, group_start);
+    threads = resolved.threads.data;
+    count   = resolved.threads.size;
+  }
+
+  // a match in a group means no later start can be leftmost, so those are dropped
+  bool matched = false;
+  for (i64 i = 0; i < count && !matched; i++) {
+    if (threads[i] == DFA_MARK) continue;
+    if (program->instructions.data[threads[i]].op == RegexOp::MATCH) {
+      matched = true;
+      while (i < count && threads[i] != DFA_MARK) i++;
+      count = i;
+    }
+  }
+
+  ThreadList next = thread_list(&tmp, program);
+  if (!at_text_end) {
+    u8 byte         = regex->class_bytes[byte_class];
+    i64 group_start = 0;
+    for (i64 i = 0; i < count; i++) {
+      if (threads[i] == DFA_MARK) {
+        end_group(&next, group_start);
+        group_start = next.threads.size;
+        continue;
+      }
+      RegexInstruction instruction = program->instructions.data[threads[i]];
+      if (instruction.op == RegexOp::BYTES && regex->sets.data[instruction.x].has(byte)) {
+        add_thread(program, &next, threads[i] + 1, at_newline, false);
+      }
+    }
+    end_group(&next, group_start);
+
+    if ((flags & DFA_STARTING) && !matched) {
+      group_start = next.threads.size;
+      add_thread(program, &next, 0, at_newline, false);
+      end_group(&next, group_start);
+    }
+  }
+
+  u8 next_flags = matched ? DFA_MATCH : 0;
+  if ((flags & DFA_STARTING) && !matched && !at_text_end) next_flags |= DFA_STARTING;
+  if (at_newline && program->has_line_start) next_flags |= DFA_LINE_START;
+
+  i32 to = add_dfa_state(dfa, next_flags, next.threads.data, next.threads.size);
+  dfa->transitions.data[from + byte_class] = to;
+  return to;
+}
+
+i32 dfa_next(Dfa *dfa, i32 from, i32 byte_class)
+{
+  i32 to = dfa->transitions.data[from + byte_class];
+  return to >= 0 ? to : dfa_transition(dfa, from, byte_class);
+}
+
+u8 dfa_flags(Dfa *dfa, i32 row) { return dfa->transitions.data[row + dfa->stride - 1]; }
+
+//////////////////////////////////////////////
+
+u8 byte_at(RopeBuffer buffer, i64 index)
+{
+  BufferLeafIterator it = leaf_iterator_at(buffer.rope, index);
+  return leaf_string(buffer, it).data[index - it.start];
+}
+
+// where the forward scan can go on from, in the waiting state, without passing where a
+// match could start. with a prefix it goes on from the byte before the next one, which
+// takes the DFA to the state it'd have been in there
+i64 skip_to_match_start(Regex *regex, u8 *data, i64 i, i64 count)
+{
+  if (regex->prefix_size >= 2) {
+    i64 found = find_impl(data + i, count - i, regex->prefix, regex->prefix_size);
+    i64 next  = found == -1 ? std::max(i, count - regex->prefix_size + 1) : i + found;
+    return next > i ? next - 1 : i;
+  }
+
+  while (i < count && !regex->first_bytes[data[i]]) i++;
+  return i;
+}
+
+// runs the forward DFA from from and returns where the last match it saw ends, or -1.
+// anchored that's the longest match starting at from, otherwise it's the end of the
+// leftmost longest one. gives up with -1 between leaves once cancelled is set
+i64 scan_forward(Regex *regex, RopeBuffer buffer, i64 from, bool anchored,
+                 std::atomic<bool> *cancelled = nullptr)
+{
+  Dfa *dfa        = &regex->forward;
+  i64 size        = buffer.rope.get_summary_or_empty().size;
+  i32 flags_index = dfa->stride - 1;
+  u8 *classes     = regex->classes;
+
+  if (from == size) {
+    i32 state = dfa_start(dfa, from == 0 || byte_at(buffer, from - 1) == '\n', anchored);
+    state     = dfa_next(dfa, state, regex->class_count);
+    return dfa_flags(dfa, state) & DFA_MATCH ? size : -1;
+  }
+
+  BufferLeafIterator it = leaf_iterator_at(buffer.rope, from);
+  String leaf           = leaf_string(buffer, it);
+  i64 offset            = from - it.start;
+
+  // the byte before is usually in the same leaf
+  u8 before = '\n';
+  if (offset > 0) {
+    before = leaf.data[offset - 1];
+  } else if (from > 0) {
+    before = byte_at(buffer, from - 1);
+  }
+
+  i32 state = dfa_start(dfa, before == '\n', anchored);
+  i64 end   = -1;
+
+  // the state that is only waiting for a match to start, after anything but a newline
+  bool prefilter = !anchored && (regex->prefix_size >= 2 || regex->skip_to_first_byte);
+  i32 waiting    = prefilter ? dfa_start(dfa, false, false) : -1;
+  i64 flushes    = dfa->flushes;
+  while (true) {
+    u8 *data     = leaf.data + offset;
+    i64 count    = leaf.size - offset;
+    i64 position = it.start + offset;
+
+    i32 *table = dfa->transitions.data;
+    for (i64 i = 0; i < count; i++) {
+      if (state == waiting) {
+        i = skip_to_match_start(regex, data, i, count);
+        if (i == count) break;
+      }
+
+      i32 byte_class = classes[data[i]];
+      i32 next       = table[state + byte_class];
+      if (next < 0) {
+        next  = dfa_transition(dfa, state, byte_class);
+        table = dfa->transitions.data;
+        if (dfa->flushes != flushes) {
+          flushes = dfa->flushes;
+          waiting = prefilter ? dfa_start(dfa, false, false) : -1;
+          table   = dfa->transitions.data;
+        }
+      }
+      state = next;
+
+      if (table[state + flags_index] & DFA_STOP) {
+        if (table[state + flags_index] & DFA_MATCH) end = position + i;
+        if (table[state + flags_index] & DFA_DEAD) return end;
+      }
+    }
+
+    if (cancelled && cancelled->load(std::memory_order_relaxed)) return -1;
+    if (!next_leaf(&it)) break;
+    leaf   = leaf_string(buffer, it);
+    offset = 0;
+  }
+
+  state = dfa_next(dfa, state, regex->class_count);
+  if (dfa_flags(dfa, state) & DFA_MATCH) end = size;
+  return end;
+}
+
+// the reverse DFA walking back from from, but not past limit. returns the start of the
+// last match it saw, or -1
+i64 scan_backward(Regex *regex, RopeBuffer buffer, i64 from, i64 limit, bool anchored)
+{
+  Dfa *dfa        = &regex->reverse;
+  i64 size        = buffer.rope.get_summary_or_empty().size;
+  i32 flags_index = dfa->stride - 1;
+  u8 *classes     = regex->classes;
+
+  // a match starting at limit is only seen after the byte before it
+  i64 last  = std::max(limit - 1, (i64)0);
+  i64 start = -1;
+  i32 state;
+  if (from > last) {
+    BufferLeafIterator it = leaf_iterator_at(buffer.rope, from - 1);
+    String leaf           = leaf_string(buffer, it);
+    i64 end               = from - it.start;
+
+    u8 after = '\n';
+    if (end < leaf.size) {
+      after = leaf.data[end];
+    } else if (from < size) {
+      after = byte_at(buffer, from);
+    }
+
+    state = dfa_start(dfa, after == '\n', anchored);
+    while (true) {
+      i64 first = std::max(last - it.start, (i64)0);
+      i64 count = std::min(leaf.size, from - it.start);
+
+      i32 *table = dfa->transitions.data;
+      for (i64 i = count - 1; i >= first; i--) {
+        i32 byte_class = classes[leaf.data[i]];
+        i32 next       = table[state + byte_class];
+        if (next < 0) {
+          next  = dfa_transition(dfa, state, byte_class);
+          table = dfa->transitions.data;
+        }
+        state = next;
+
+        if (table[state + flags_index] & DFA_STOP) {
+          if (table[state + flags_index] & DFA_MATCH) start = it.start + i + 1;
+          if (table[state + flags_index] & DFA_DEAD) return start;
+        }
+      }
+
+      if (it.start <= last || !previous_leaf(&it)) break;
+      leaf = leaf_string(buffer, it);
+    }
+  } else {
+    state = dfa_start(dfa, from == size || byte_at(buffer, from) == '\n', anchored);
+  }
+
+  if (limit == 0) {
+    state = dfa_next(dfa, state, regex->class_count);
+    if (dfa_flags(dfa, state) & DFA_MATCH) start = 0;
+  }
+  return start;
+}
+
+// the leftmost longest match starting at from or later, {-1, -1} if there isn't one
+RegexMatch regex_find_next(Regex *regex, RopeBuffer buffer, i64 from,
+                           std::atomic<bool> *cancelled = nullptr)
+{
+  i64 size = buffer.rope.get_summary_or_empty().size;
+  if (from < 0 || from > size) {
+    return {-1, -1};
+  }
+
+  i64 end = scan_forward(regex, buffer, from, false, cancelled);
+  if (end == -1) {
+    return {-1, -1};
+  }
+  return {scan_backward(regex, buffer, end, from, true), end};
+}
+
+// the match that ends nearest before before and starts before it, as long as it can be
+// at the start and then at the end. it may run on past before
+RegexMatch regex_find_previous(Regex *regex, RopeBuffer buffer, i64 before)
+{
+  i64 size = buffer.rope.get_summary_or_empty().size;
+  before   = std::min(before, size);
+  for (i64 end = before; end >= 0; end--) {
+    i64 start = scan_backward(regex, buffer, end, 0, false);
+    if (start == -1) {
+      return {-1, -1};
+    }
+    // only the empty match at before ends there, look for one ending earlier
+    if (start < before) {
+      return {start, scan_forward(regex, buffer, start, true)};
+    }
+  }
+  return {-1, -1};
+}
+
+// calls found with every match from from on, in order, while it returns true. an empty
+// match moves the search on by a byte
+template <typename F>
+void for_each_regex_match(Regex *regex, RopeBuffer buffer, i64 from, F found,
+                          std::atomic<bool> *cancelled = nullptr)
+{
+  i64 size = buffer.rope.get_summary_or_empty().size;
+  while (from <= size) {
+    RegexMatch match = regex_find_next(regex, buffer, from, cancelled);
+    if (match.start == -1 || !found(match)) {
+      return;
+    }
+    from = match.end > match.start ? match.end : match.end + 1;
+  }
+}
+
+//////////////////////////////////////////////
+
+// A search for every match of a pattern over a snapshot of the buffer, run on its own
+// thread so the buffer can be edited while it goes. Matches are appended where they never
+// move and counted once they're written, so they can be read while the search runs.
+struct RegexSearch {
+  Regex regex;
+  RopeBuffer snapshot;
+
+  SegmentedArray<RegexMatch> matches = SegmentedArray<RegexMatch>(&system_allocator);
+  std::atomic<i64> match_count{0};
+  std::atomic<bool> cancelled{false};
+  std::atomic<bool> finished{false};
+
+  std::atomic<i32> references{1};  // the one who started it, and the thread while it runs
+};
+
+void release_regex_search(RegexSearch *search)
+{
+  if (search->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    free_regex(&search->regex);
+    search->matches.free_segments();
+    delete search;
+  }
+}
+
+void run_regex_search(RegexSearch *search)
+{
+  set_profile_thread_name("regex");
+  {
+    PROFILE_ZONE("regex search");
+    for_each_regex_match(
+        &search->regex, search->snapshot, 0,
+        [&](RegexMatch match) {
+          search->matches.push_back(match);
+          search->match_count.fetch_add(1, std::memory_order_release);
+          return !search->cancelled.load(std::memory_order_relaxed);
+        },
+        &search->cancelled);
+  }
+
+  release_snapshot(search->snapshot);
+  search->finished.store(true, std::memory_order_release);
+  release_regex_search(search);
+}
+
+// a pattern that doesn't compile leaves regex.error set and the search finished
+RegexSearch *start_regex_search(RopeBuffer buffer, String pattern)
+{
+  RegexSearch *search = new RegexSearch();
+  if (!compile_regex(&search->regex, pattern)) {
+    search->finished.store(true);
+    return search;
+  }
+
+  search->snapshot = take_snapshot(buffer);
+  search->references.fetch_add(1, std::memory_order_relaxed);
+  std::thread(run_regex_search, search).detach();
+  return search;
+}
+
+// matches below match_count can be read while the search is still running
+RegexMatch regex_search_match(RegexSearch *search, i64 i) { return *search->matches.at(i); }
+
+// stops the search if it's still running and lets go of it
+void cancel_regex_search(RegexSearch *search)
+{
+  search->cancelled.store(true, std::memory_order_relaxed);
+  release_regex_search(search);
+}
+
+//////////////////////////////////////////////
+
+
+// every end of a match of the whole pattern starting at start, found by keeping all the
+// program's threads in a set the way the DFA's states are built but without the DFA
+void regex_match_ends(Regex *regex, String text, i64 start, bool *ends)
+{
+  RegexProgram *program = &regex->forward_program;
+
+  Temp tmp;
+  ThreadList current = thread_list(&tmp, program);
+  add_thread(program, &current, 0, start == 0 || text.data[start - 1] == '\n', false);
+  for (i64 i = start; i <= text.size; i++) {
+    bool line_start = i == 0 || text.data[i - 1] == '\n';
+    bool line_end   = i == text.size || text.data[i] == '\n';
+
+    ThreadList resolved = thread_list(&tmp, program);
+    ThreadList next     = thread_list(&tmp, program);
+    for (i64 t = 0; t < current.threads.size; t++) {
+      add_thread(program, &resolved, current.threads[t], line_start, line_end);
+    }
+    for (i64 t = 0; t < resolved.threads.size; t++) {
+      RegexInstruction instruction = program->instructions[resolved.threads[t]];
+      if (instruction.op == RegexOp::MATCH) ends[i] = true;
+      if (i < text.size && instruction.op == RegexOp::BYTES &&
+          regex->sets.data[instruction.x].has(text.data[i])) {
+        add_thread(program, &next, resolved.threads[t] + 1, text.data[i] == '\n', false);
+      }
+    }
+    current = next;
+  }
+}
+
+void regex_tests()
+{
+  auto string = [](const char *s) { return String((u8 *)s, strlen(s)); };
+
+  struct Case {
+    const char *pattern;
+    const char *text;
+    i64 start;
+    i64 end;
+  };
+  Case cases[] = {
+      {"abc", "xxabcxx", 2, 5},
+      {"a|ab", "abc", 0, 2},
+      {"ab|bcde", "abcde", 0, 2},
+      {"abcd|c", "abcd", 0, 4},
+      {"a*", "baa", 0, 0},
+      {"a+", "baa", 1, 3},
+      {"x{2,3}", "xxxxx", 0, 3},
+      {"x{2,}", "axxxxx", 1, 6},
+      {"[a-c]+", "zzcabz", 2, 5},
+      {"[^a]+", "aabb\nb", 2, 4},
+      {"^b", "ab\nbc", 3, 4},
+      {"b$", "abb\nbc", 2, 3},
+      {"^$", "a\n\nb", 2, 2},
+      {"$", "ab", 2, 2},
+      {"\\d+ms", "took 125ms", 5, 10},
+      {"\\w+\\.c", "a main.c", 2, 8},
+      {"(?:ab)+", "ababa", 0, 4},
+      {"a.c", "a\xc3\xa9" "c", 0, 4},
+      {"[^x]", "\xe2\x82\xac", 0, 3},
+      {"\\S+", "  \xc3\xa9t\xc3\xa9 ", 2, 7},
+      {"a{2}b?", "aaab", 0, 2},
+      {"(a|b)*c", "abababc", 0, 7},
+      {"x", "abc", -1, -1},
+  };
+  for (Case c : cases) {
+    RopeBuffer buffer = create_rope_buffer();
+    fill_rope(&buffer, string(c.text));
+
+    Regex regex;
+    assert(compile_regex(&regex, string(c.pattern)));
+    RegexMatch match = regex_find_next(&regex, buffer, 0);
+    assert(match.start == c.start && match.end == c.end);
+
+    free_regex(&regex);
+    release(buffer.rope);
+  }
+
+  for (const char *pattern : {"(", "a)", "[ab", "*a", "a{3,2}", "a{2000}", "\\q", "a\\"}) {
+    Regex regex;
+    assert(!compile_regex(&regex, string(pattern)) && regex.error);
+    free_regex(&regex);
+  }
+
+  // what the forward scan skips to
+  {
+    Regex comment, numbers, empty;
+    assert(compile_regex(&comment, string("^//x+")));
+    assert(comment.prefix_size == 3 && memcmp(comment.prefix, "//x", 3) == 0);
+    assert(comment.first_bytes['/'] && comment.first_bytes['\n'] && !comment.first_bytes['x']);
+
+    assert(compile_regex(&numbers, string("[0-9]+|ab")));
+    assert(numbers.prefix_size == 0 && numbers.skip_to_first_byte);
+    assert(numbers.first_bytes['7'] && numbers.first_bytes['a'] && !numbers.first_bytes['b']);
+
+    assert(compile_regex(&empty, string("a*")));
+    assert(empty.prefix_size == 0 && !empty.skip_to_first_byte);
+
+    free_regex(&comment);
+    free_regex(&numbers);
+    free_regex(&empty);
+  }
+
+  // random patterns against the set simulation, over text spread across many leaves
+  const char *atoms[] = {"a", "b", "ab", ".", "[ab]", "[^a]", "\\n", "^", "$",
+                         "(a|b)", "(ab|a)", "(a|)", "(b|ba|aab)", "\\w", "\\s"};
+  const char *repeats[] = {"", "", "", "*", "+", "?", "{2}", "{1,3}"};
+  u64 random            = 11;
+  auto next             = [&]() {
+    random = random * 6364136223846793005ull + 1442695040888963407ull;
+    return random >> 33;
+  };
+  for (i32 round = 0; round < 40; round++) {
+    char pattern[128] = {};
+    i32 atom_count    = next() % 4 + 1;
+    for (i32 i = 0; i < atom_count; i++) {
+      strcat(pattern, atoms[next() % (sizeof(atoms) / sizeof(atoms[0]))]);
+      strcat(pattern, repeats[next() % (sizeof(repeats) / sizeof(repeats[0]))]);
+      if (next() % 8 == 0) strcat(pattern, "|");
+    }
+
+    RopeBuffer buffer = create_rope_buffer();
+    fill_rope(&buffer, "");
+    i32 pieces = next() % 24;
+    for (i32 i = 0; i < pieces; i++) {
+      u8 piece[3];
+      i64 size = next() % 3 + 1;
+      for (i64 c = 0; c < size; c++) piece[c] = "aab\nc"[next() % 5];
+      i64 index = next() % (buffer.rope.get_summary_or_empty().size + 1);
+      buffer_insert(buffer, cursor_at(buffer, index), String(piece, size));
+    }
+    DynamicArray<u8> contents(&system_allocator);
+    String text = buffer_to_string(buffer, &contents);
+
+    Regex regex;
+    assert(compile_regex(&regex, string(pattern)));
+    // small enough to be thrown away and rebuilt over and over
+    if (round % 2) regex.forward.cache_limit = regex.reverse.cache_limit = 512;
+
+    i64 n = text.size + 1;
+    DynamicArray<bool> ends(&system_allocator);
+    ends.resize(n * n);
+    memset(ends.data, 0, n * n);
+    for (i64 s = 0; s <= text.size; s++) regex_match_ends(&regex, text, s, ends.data + s * n);
+
+    for (i64 from = 0; from <= text.size; from++) {
+      RegexMatch expected = {-1, -1};
+      for (i64 s = from; s <= text.size && expected.start == -1; s++) {
+        for (i64 e = text.size; e >= s; e--) {
+          if (ends[s * n + e]) {
+            expected = {s, e};
+            break;
+          }
+        }
+      }
+      RegexMatch match = regex_find_next(&regex, buffer, from);
+      assert(match.start == expected.start && match.end == expected.end);
+
+      // the match ending nearest before from, then as long as it goes both ways
+      expected = {-1, -1};
+      for (i64 e = from; e >= 0 && expected.start == -1; e--) {
+        for (i64 s = 0; s <= std::min(e, from - 1); s++) {
+          if (ends[s * n + e]) {
+            expected.start = s;
+            break;
+          }
+        }
+      }
+      for (i64 e = text.size; expected.start != -1 && expected.end == -1; e--) {
+        if (ends[expected.start * n + e]) expected.end = e;
+      }
+      match = regex_find_previous(&regex, buffer, from);
+      assert(match.start == expected.start && match.end == expected.end);
+    }
+
+    system_allocator.free(ends.allocation);
+    system_allocator.free(contents.allocation);
+    free_regex(&regex);
+    release(buffer.rope);
+  }
+
+  // the background search finds what searching in place does, while the buffer changes
+  RopeBuffer buffer = create_rope_buffer();
+  fill_rope(&buffer, "");
+  String words = "abc ";
+  String line  = "line 12\n";
+  for (i32 i = 0; i < 500; i++) {
+    i64 index = next() % (buffer.rope.get_summary_or_empty().size + 1);
+    buffer_insert(buffer, cursor_at(buffer, index), i % 7 ? words : line);
+  }
+  RegexSearch *search = start_regex_search(buffer, "\\d+|b\\w*");
+  assert(!search->regex.error);
+  buffer_insert(buffer, cursor_at(buffer, 0), "b99 ");
+
+  Regex regex;
+  compile_regex(&regex, "\\d+|b\\w*");
+  i64 expected = 0;
+  for_each_regex_match(&regex, buffer, 4, [&](RegexMatch match) {
+    while (!search->finished.load(std::memory_order_acquire) &&
+           search->match_count.load(std::memory_order_acquire) <= expected) {
+      std::this_thread::yield();
+    }
+    RegexMatch found = regex_search_match(search, expected++);
+    assert(found.start == match.start - 4 && found.end == match.end - 4);
+    return true;
+  });
+  while (!search->finished.load(std::memory_order_acquire)) std::this_thread::yield();
+  assert(search->match_count.load() == expected);
+  release_regex_search(search);
+
+  RegexSearch *cancelled = start_regex_search(buffer, "a");
+  cancel_regex_search(cancelled);
+  RegexSearch *invalid = start_regex_search(buffer, "(");
+  assert(invalid->regex.error && invalid->finished.load());
+  release_regex_search(invalid);
+
+  free_regex(&regex);
+}
@@ -1,12 +1,18 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <optional>
+#include <thread>
 
 #include "buffer.hpp"
+#include "containers/btree_rope.hpp"
 #include "containers/rope.hpp"
 #include "file.hpp"
 #include "memory.hpp"
+#include "profiler.hpp"
 #include "string.hpp"
+#include "text.hpp"
 #include "types.hpp"
 
 void accumulate(Summary *summary, u8 c)
@@ -38,12 +44,25 @@ Summary Summarizer::summarize(const Summary &left, const Summary &right)
 
   return summary;
 }
+u8 *Summarizer::chunk_data(const Chunk &chunk)
+{
+  if (chunk.index & ORIGINAL_TEXT_BIT) {
+    assert((chunk.index ^ ORIGINAL_TEXT_BIT) + chunk.size <= original.size);
+    return original.data + (chunk.index ^ ORIGINAL_TEXT_BIT);
+  }
+
+  if (chunk.size == 0) return nullptr;
+  return data->at(chunk.index);
+}
 Summary Summarizer::summarize(const Chunk &chunk)
 {
+  String text = {chunk_data(chunk), chunk.size};
+
+  i64 last_newline;
   Summary summary;
-  for (i64 i = 0; i < chunk.size; i++) {
-    accumulate(&summary, (*data)[chunk.index + i]);
-  }
+  summary.size            = chunk.size;
+  summary.newlines        = count_newlines(text, &last_newline);
+  summary.last_line_chars = chunk.size - (last_newline + 1);
   return summary;
 }
 Summary Summarizer::summarize(const Chunk &right, i64 index)
@@ -54,6 +73,114 @@ Summary Summarizer::summarize(const Chunk &right, i64 index)
 
 //////////////////////////////////////////////
 
+// build with -DUSE_BTREE_ROPE=1 to back every RopeBuffer with the wide-node B+-tree
+// instead of the binary AVL rope
+#ifndef USE_BTREE_ROPE
+#define USE_BTREE_ROPE 0
+#endif
+
+#if USE_BTREE_ROPE
+typedef BTreeRope BufferRope;
+typedef BTreeNode BufferNode;
+typedef BTreeLeafIterator BufferLeafIterator;
+const i64 BUFFER_CHUNK_MAX_SIZE = BTREE_CHUNK_MAX_SIZE;
+BufferRope buffer_rope_of(Summarizer summarizer, String text)
+{
+  return btree_rope_of(summarizer, text);
+}
+#else
+typedef Rope BufferRope;
+typedef Node BufferNode;
+typedef LeafIterator BufferLeafIterator;
+const i64 BUFFER_CHUNK_MAX_SIZE = CHUNK_MAX_SIZE;
+BufferRope buffer_rope_of(Summarizer summarizer, String text)
+{
+  return rope_of(summarizer, text);
+}
+#endif
+
+// files at least this big are mapped and read in place instead of being copied into the
+// text, their leaves are bigger to keep the tree small
+const i64 MAPPED_FILE_MIN_SIZE = 16 * MB;
+const i64 MAPPED_CHUNK_SIZE    = 4 * KB;
+
+// the leaves of a mapped file are summarized on a worker thread, and the main thread
+// links whatever is ready onto the end of the rope a slice at a time, so the start of the
+// file can be shown and scrolled while the rest is still loading
+const i64 LOAD_SLICE_LEAVES = 8 * 1024;
+
+struct BackgroundLoad {
+  MappedFile file;
+  i64 leaf_count;  // full MAPPED_CHUNK_SIZE leaves, the tail is linked in last
+  Summary *leaf_summaries;
+  std::atomic<i64> leaves_ready{0};
+
+  std::atomic<i32> references{2};  // the worker, and each copy that is still loading
+};
+
+void release_load(BackgroundLoad *load)
+{
+  if (load->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    delete[] load->leaf_summaries;
+    delete load;
+  }
+}
+
+void summarize_leaves(BackgroundLoad *load)
+{
+  set_profile_thread_name("loader");
+  PROFILE_FUNCTION();
+
+  Summarizer summarizer = {};
+  summarizer.original   = load->file.data;
+
+  for (i64 i = 0; i < load->leaf_count; i++) {
+    Chunk chunk             = {ORIGINAL_TEXT_BIT + i * MAPPED_CHUNK_SIZE, MAPPED_CHUNK_SIZE};
+    load->leaf_summaries[i] = summarizer.summarize(chunk);
+    load->leaves_ready.store(i + 1, std::memory_order_release);
+
+    if ((i + 1) % LOAD_SLICE_LEAVES == 0) {
+      i64 slice_size = LOAD_SLICE_LEAVES * MAPPED_CHUNK_SIZE;
+      release_mapped_pages(load->file, (i + 1) * MAPPED_CHUNK_SIZE - slice_size,
+                           (i + 1) * MAPPED_CHUNK_SIZE);
+    }
+  }
+  release_load(load);
+}
+
+// the text is only ever appended to. once it has grown well past what the leaves still
+// use, the live runs of it are copied into a fresh arena a step at a time on idle frames,
+// and every leaf is pointed at its new place in one pass at the end
+const i64 COMPACTION_MIN_SIZE   = 1 * MB;
+const i64 COMPACTION_STEP_BYTES = 4 * MB;
+
+// a range of the text used by leaves, copied as a whole so leaves that were contiguous
+// stay that way
+struct TextRun {
+  i64 start;
+  i64 end;
+  i64 new_start;
+};
+
+struct TextCompaction {
+  DynamicArray<TextRun> runs = DynamicArray<TextRun>(&system_allocator);
+  SegmentedArray<u8> *arena  = nullptr;  // set while a pass is copying
+  i64 run                    = 0;
+  i64 run_copied             = 0;
+  i64 text_size              = 0;  // runs only cover the text up to here
+  i64 next_size              = COMPACTION_MIN_SIZE;
+
+  i64 live_bytes      = 0;
+  i64 passes          = 0;
+  i64 reclaimed_bytes = 0;
+
+  // finishing a pass rewrites leaves in place, so none can start or finish while any
+  // snapshot is out
+  std::atomic<i32> snapshots{0};
+};
+
+struct FileSearchResults;
+
 struct RopeBuffer {
   struct Iterator {
     NodeRef current = NodeRef::invalid();
@@ -73,60 +200,150 @@ struct RopeBuffer {
     i64 column() { return summary.last_line_chars; }
   };
 
-  Rope rope;
+  BufferRope rope;
   RopeBuffer::Iterator last_edit;
-  DynamicArray<u8> *text;
+  SegmentedArray<u8> *text;
+  MappedFile original = {};
   Summarizer summarizer;
 
+  // set until every leaf of the mapped file is in this copy's rope
+  BackgroundLoad *load = nullptr;
+  i64 leaves_loaded    = 0;
+
+  // shared by every copy of the buffer, like the text
+  TextCompaction *compaction;
+
+  // set on the buffer find in files writes to, each copy takes in the results it hasn't
+  // yet, see file_search.hpp
+  FileSearchResults *file_results = nullptr;
+  i64 results_generation          = 0;
+  i64 results_taken               = 0;
+  i32 results_copy                = -1;  // where the results keep track of this copy
+
   std::optional<String> filename = std::nullopt;
 };
 
 void fill_rope(RopeBuffer *buffer, String contents)
 {
-  Rope rope = create_rope(buffer->summarizer);
-  buffer->text->resize(contents.size);
-  memcpy(buffer->text->data, contents.data, contents.size);
+  buffer->text->clear();
+  buffer->rope = buffer_rope_of(buffer->summarizer, contents);
+}
 
-  i64 next_position = 0;
-  while (next_position < contents.size) {
-    Chunk chunk;
-    chunk.index  = next_position;
-    chunk.size   = std::min(contents.size - next_position, CHUNK_MAX_SIZE);
-    NodeRef leaf = new_leaf(rope, chunk);
+// starts building the rope straight over the mapped file, edits go to the text once it
+// has finished loading
+void load_in_background(RopeBuffer *buffer, MappedFile original)
+{
+  buffer->text->clear();
+  buffer->original            = original;
+  buffer->summarizer.original = original.data;
+  buffer->rope                = buffer_rope_of(buffer->summarizer, "");
+
+  BackgroundLoad *load = new BackgroundLoad();
+  load->file           = original;
+  load->leaf_count     = original.data.size / MAPPED_CHUNK_SIZE;
+  load->leaf_summaries = new Summary[load->leaf_count];
+
+  buffer->load          = load;
+  buffer->leaves_loaded = 0;
+  std::thread(summarize_leaves, load).detach();
+}
 
-    if (!rope.root.is_valid()) {
-      rope.root = leaf;
-      rope      = commit_builder(rope);
-    } else {
-      Rope new_rope = insert_right(rope, leaf);
-      release(rope);
-      rope = new_rope;
-    }
+// a copy of the buffer that's edited and goes on loading by itself. it holds its own
+// reference on the root and its own share of the load
+RopeBuffer copy_buffer(RopeBuffer *buffer)
+{
+  increment_ref_count(buffer->rope, buffer->rope.root);
+  if (buffer->load) {
+    buffer->load->references.fetch_add(1, std::memory_order_relaxed);
+  }
+  return *buffer;
+}
+
+// a copy that's dropped before it has finished loading lets go of its share
+void stop_loading(RopeBuffer *buffer)
+{
+  if (buffer->load) {
+    release_load(buffer->load);
+    buffer->load = nullptr;
+  }
+}
 
-    next_position += chunk.size;
+bool is_loading(RopeBuffer buffer) { return buffer.load != nullptr; }
+
+f32 loading_progress(RopeBuffer buffer)
+{
+  if (!buffer.load || buffer.load->leaf_count == 0) return 1.f;
+  return (f32)buffer.leaves_loaded / buffer.load->leaf_count;
+}
+
+void append_original(RopeBuffer *buffer, i64 start, i64 end, Summary *leaf_summaries)
+{
+  BufferRope slice = buffer->rope;
+  slice.root = build_over(buffer->rope, ORIGINAL_TEXT_BIT + start, ORIGINAL_TEXT_BIT + end,
+                          MAPPED_CHUNK_SIZE, leaf_summaries);
+
+  BufferRope joined = concatanate(buffer->rope, slice);
+  release(buffer->rope);
+  release(slice);
+  buffer->rope = joined;
+}
+
+// links the leaves the worker has finished onto the end of the rope, at most a slice per
+// call. returns whether the buffer is still loading
+bool continue_loading(RopeBuffer *buffer)
+{
+  BackgroundLoad *load = buffer->load;
+  if (!load) {
+    return false;
+  }
+  PROFILE_FUNCTION();
+
+  i64 ready = std::min(load->leaves_ready.load(std::memory_order_acquire),
+                       buffer->leaves_loaded + LOAD_SLICE_LEAVES);
+  if (ready > buffer->leaves_loaded) {
+    append_original(buffer, buffer->leaves_loaded * MAPPED_CHUNK_SIZE,
+                    ready * MAPPED_CHUNK_SIZE,
+                    load->leaf_summaries + buffer->leaves_loaded);
+    buffer->leaves_loaded = ready;
   }
 
-  buffer->rope = rope;
+  if (buffer->leaves_loaded < load->leaf_count) {
+    return true;
+  }
+
+  append_original(buffer, load->leaf_count * MAPPED_CHUNK_SIZE, load->file.data.size,
+                  nullptr);
+  release_mapped_pages(load->file, 0, load->file.data.size);
+  stop_loading(buffer);
+  return false;
 }
 
 RopeBuffer create_rope_buffer()
 {
   RopeBuffer buffer;
-  buffer.text       = new DynamicArray<u8>(&system_allocator);
+  buffer.text       = new SegmentedArray<u8>(&system_allocator);
   buffer.summarizer = Summarizer{buffer.text};
+  buffer.compaction = new TextCompaction();
   return buffer;
 }
 
 RopeBuffer load_rope_buffer(std::optional<String> filename)
 {
+  PROFILE_FUNCTION();
+
   RopeBuffer buffer = create_rope_buffer();
 
   if (filename) {
     buffer.filename = filename->copy(&system_allocator);
 
-    File file;
-    if (read_file(filename.value(), &tmp_allocator, &file)) {
-      fill_rope(&buffer, file.data);
+    MappedFile file;
+    if (map_file(filename.value(), &file)) {
+      if (file.data.size >= MAPPED_FILE_MIN_SIZE) {
+        load_in_background(&buffer, file);
+      } else {
+        fill_rope(&buffer, file.data);
+        unmap_file(&file);
+      }
       return buffer;
     }
   }
@@ -142,13 +359,13 @@ i64 count_lines(RopeBuffer buffer)
 
 u8 char_at(RopeBuffer buffer, RopeBuffer::Iterator it)
 {
-  Node *current_val = buffer.rope.get(it.current);
-  return (*buffer.text)[current_val->data.index + it.node_index];
+  BufferNode *current_val = buffer.rope.get(it.current);
+  return buffer.summarizer.chunk_data(current_val->data)[it.node_index];
 }
 
 bool is_valid(RopeBuffer buffer, RopeBuffer::Iterator it)
 {
-  Node *current_val = buffer.rope.get(it.current);
+  BufferNode *current_val = buffer.rope.get(it.current);
   return it.current.is_valid() && it.node_index >= 0 &&
          it.node_index < current_val->data.size;
 }
@@ -158,172 +375,389 @@ bool is_eof(RopeBuffer buffer, RopeBuffer::Cursor c)
   return c.current.is_valid() && c.index == buffer.rope.get_summary_or_empty().size;
 }
 
-RopeBuffer::Cursor cursor_at(RopeBuffer buffer, NodeRef root, i64 index,
-                             Summary accumulator)
+RopeBuffer::Cursor cursor_in_leaf(RopeBuffer buffer, NodeRef leaf, i64 node_index,
+                                  Summary before)
 {
-  Node *root_val = buffer.rope.get(root);
-  if (root_val->type == Node::Type::LEAF) {
-    Summary summary = buffer.summarizer.summarize(
-        accumulator, buffer.summarizer.summarize(root_val->data, index));
-
-    RopeBuffer::Cursor cursor;
-    cursor.current    = root;
-    cursor.index      = summary.size;
-    cursor.node_index = index;
-    cursor.summary    = summary;
-    return cursor;
-  }
+  Summary summary = buffer.summarizer.summarize(
+      before, buffer.summarizer.summarize(buffer.rope.get(leaf)->data, node_index));
+
+  RopeBuffer::Cursor cursor;
+  cursor.current    = leaf;
+  cursor.index      = summary.size;
+  cursor.node_index = node_index;
+  cursor.summary    = summary;
+  return cursor;
+}
 
-  Node *left    = buffer.rope.get(root_val->children.left);
-  i64 left_size = left->summary.size;
-  if (index < left_size) {
-    return cursor_at(buffer, root_val->children.left, index, accumulator);
-  }
-  return cursor_at(buffer, root_val->children.right, index - left_size,
-                   buffer.summarizer.summarize(accumulator, left->summary));
+RopeBuffer::Cursor empty_cursor()
+{
+  RopeBuffer::Cursor cursor;
+  cursor.current    = NodeRef::invalid();
+  cursor.index      = 0;
+  cursor.node_index = 0;
+  cursor.summary    = {};
+  return cursor;
 }
+
 RopeBuffer::Cursor cursor_at(RopeBuffer buffer, i64 index)
 {
   if (!buffer.rope.root.is_valid()) {
-    RopeBuffer::Cursor cursor;
-    cursor.current    = NodeRef::invalid();
-    cursor.index      = 0;
-    cursor.node_index = 0;
-    cursor.summary    = {};
-    return cursor;
+    return empty_cursor();
   }
-  index = std::clamp(index, 0ll, buffer.rope.get_summary_or_empty().size);
-  return cursor_at(buffer, buffer.rope.root, index, {});
+  index = std::clamp(index, (i64)0, buffer.rope.get_summary_or_empty().size);
+
+  Summary before = {};
+  NodeRef leaf   = leaf_at_index(buffer.rope, &index, false, &before);
+  return cursor_in_leaf(buffer, leaf, index, before);
 }
 
-RopeBuffer::Cursor cursor_at_point(RopeBuffer buffer, NodeRef root, i64 want_line,
-                                   i64 want_column, Summary accumulator)
+RopeBuffer::Cursor cursor_at_point(RopeBuffer buffer, i64 want_line, i64 want_column)
 {
-  Node *root_val = buffer.rope.get(root);
-  if (root_val->type == Node::Type::LEAF) {
-    i64 line   = 0;
-    i64 column = 0;
-    i64 index  = 0;
-    while (index < root_val->data.size) {
-      if (line == want_line && column == want_column) {
+  if (!buffer.rope.root.is_valid()) {
+    return empty_cursor();
+  }
+
+  want_line =
+      std::min(std::max(want_line, (i64)0), buffer.rope.get_summary_or_empty().newlines);
+
+  Summary before = {};
+  NodeRef leaf   = leaf_at_point(buffer.rope, &want_line, &want_column, &before);
+
+  Chunk chunk = buffer.rope.get(leaf)->data;
+  u8 *data    = buffer.summarizer.chunk_data(chunk);
+  i64 line    = 0;
+  i64 column  = 0;
+  i64 index   = 0;
+  while (index < chunk.size) {
+    if (line == want_line && column == want_column) {
+      break;
+    }
+
+    if (data[index] == '\n') {
+      if (line == want_line) {
         break;
       }
+      line++;
+      column = -1;
+    }
 
-      if ((*buffer.text)[root_val->data.index + index] == '\n') {
-        if (line == want_line) {
-          break;
-        }
-        line++;
-        column = -1;
-      }
+    column++;
+    index++;
+  }
+
+  return cursor_in_leaf(buffer, leaf, index, before);
+}
+
+RopeBuffer::Cursor insert_position(RopeBuffer buffer, i64 index)
+{
+  if (!buffer.rope.root.is_valid()) {
+    return empty_cursor();
+  }
+  index = std::clamp(index, (i64)0, buffer.rope.get_summary_or_empty().size);
 
-      column++;
-      index++;
+  Summary before = {};
+  NodeRef leaf   = leaf_at_index(buffer.rope, &index, true, &before);
+  return cursor_in_leaf(buffer, leaf, index, before);
+}
+
+String leaf_string(RopeBuffer buffer, BufferLeafIterator it)
+{
+  Chunk chunk = it.leaf()->data;
+  return String(buffer.summarizer.chunk_data(chunk), chunk.size);
+}
+
+// appends the spans of lines [first_line, last_line], returns the index just past the
+// last one. finding the first line and skipping the rest of a cut off line are lookups in
+// the tree, so this is O(log n) per line plus the bytes it returns, wherever the lines are
+i64 visible_lines(RopeBuffer buffer, i64 first_line, i64 last_line, i64 max_line_bytes,
+                  DynamicArray<LineSpan> *spans)
+{
+  PROFILE_FUNCTION();
+
+  Summary summary          = buffer.rope.get_summary_or_empty();
+  RopeBuffer::Cursor start = cursor_at_point(buffer, first_line, 0);
+  i64 index                = start.index;
+  i64 line                 = start.line();
+  i64 line_bytes           = 0;
+  i64 end                  = index;
+
+  BufferLeafIterator leaves = leaf_iterator_at(buffer.rope, index);
+  while (line <= last_line && index < summary.size) {
+    String leaf = leaf_string(buffer, leaves);
+    i64 offset  = index - leaves.start;
+    if (offset >= leaf.size) {
+      next_leaf(&leaves);
+      continue;
     }
 
-    Summary summary = buffer.summarizer.summarize(
-        accumulator, buffer.summarizer.summarize(root_val->data, index));
+    String rest = leaf.sub(offset, leaf.size);
+    u8 *newline = (u8 *)memchr(rest.data, '\n', rest.size);
+    i64 length  = newline ? newline - rest.data + 1 : rest.size;
+    i64 room    = max_line_bytes - line_bytes;
+    if (length > room) {
+      // the rest of the line is out of view, jump to where the next one starts
+      if (room > 0) {
+        spans->push_back({rest.sub(0, room), index, line});
+        end = index + room;
+      }
 
-    RopeBuffer::Cursor cursor;
-    cursor.current    = root;
-    cursor.index      = summary.size;
-    cursor.node_index = index;
-    cursor.summary    = summary;
-    return cursor;
-  }
+      line++;
+      if (line > last_line || line > summary.newlines) break;
+      index      = cursor_at_point(buffer, line, 0).index;
+      leaves     = leaf_iterator_at(buffer.rope, index);
+      line_bytes = 0;
+      continue;
+    }
 
-  Node *left       = buffer.rope.get(root_val->children.left);
-  i64 left_lines   = left->summary.newlines;
-  i64 left_columns = left->summary.last_line_chars;
-  if (want_line == left_lines && want_column >= left_columns) {
-    accumulator = buffer.summarizer.summarize(accumulator, left->summary);
-    return cursor_at_point(buffer, root_val->children.right, want_line - left_lines,
-                           want_column - left_columns, accumulator);
-  }
-  if (want_line <= left_lines) {
-    return cursor_at_point(buffer, root_val->children.left, want_line, want_column,
-                           accumulator);
+    spans->push_back({rest.sub(0, length), index, line});
+    index += length;
+    end = index;
+    line_bytes += length;
+    if (newline) {
+      line++;
+      line_bytes = 0;
+    }
   }
-  accumulator = buffer.summarizer.summarize(accumulator, left->summary);
-  return cursor_at_point(buffer, root_val->children.right, want_line - left_lines,
-                         want_column, accumulator);
+  return end;
 }
-RopeBuffer::Cursor cursor_at_point(RopeBuffer buffer, i64 want_line, i64 want_column)
+
+String buffer_to_string(RopeBuffer buffer, DynamicArray<u8> *builder)
 {
-  if (!buffer.rope.root.is_valid()) {
-    RopeBuffer::Cursor cursor;
-    cursor.current    = NodeRef::invalid();
-    cursor.index      = 0;
-    cursor.node_index = 0;
-    cursor.summary    = {};
-    return cursor;
+  i64 written = builder->size;
+  builder->resize(written + buffer.rope.get_summary_or_empty().size);
+
+  BufferLeafIterator it = leaf_iterator_at(buffer.rope, 0);
+  while (it.is_valid()) {
+    // an empty buffer's one leaf has no text to point at
+    String span = leaf_string(buffer, it);
+    if (span.size > 0) memcpy(builder->data + written, span.data, span.size);
+    written += span.size;
+
+    if (!next_leaf(&it)) break;
   }
 
-  want_line =
-      std::min(std::max(want_line, 0ll), buffer.rope.get_summary_or_empty().newlines);
-  return cursor_at_point(buffer, buffer.rope.root, want_line, want_column, {});
+  String string;
+  string.data = builder->data;
+  string.size = builder->size;
+  return string;
 }
 
-RopeBuffer::Cursor insert_position(RopeBuffer buffer, NodeRef root, i64 index,
-                                   Summary accumulator)
+// Finding text streams the leaves through the find kernels in text.hpp. A match can
+// straddle leaves, so the last needle.size - 1 bytes of what has been searched are kept
+// in a seam and searched again with the start of the next leaf before the leaf itself.
+// Returns where the first match starting at from or later begins, or -1.
+i64 find_next(RopeBuffer buffer, i64 from, String needle)
 {
-  Node *root_val = buffer.rope.get(root);
-  if (root_val->type == Node::Type::LEAF) {
-    Summary summary = buffer.summarizer.summarize(
-        accumulator, buffer.summarizer.summarize(root_val->data, index));
+  PROFILE_FUNCTION();
 
-    RopeBuffer::Cursor cursor;
-    cursor.current    = root;
-    cursor.index      = summary.size;
-    cursor.node_index = index;
-    cursor.summary    = summary;
-    return cursor;
+  i64 size = buffer.rope.get_summary_or_empty().size;
+  from     = std::max(from, (i64)0);
+  if (needle.size == 0 || from + needle.size > size) {
+    return -1;
   }
 
-  Node *left    = buffer.rope.get(root_val->children.left);
-  i64 left_size = left->summary.size;
-  if (index <= left_size) {
-    return insert_position(buffer, root_val->children.left, index, accumulator);
+  Temp tmp;
+  i64 keep = needle.size - 1;
+  DynamicArray<u8> seam(&tmp);
+  seam.set_capacity(keep * 2 + 1);
+  i64 seam_start = from;
+
+  BufferLeafIterator it = leaf_iterator_at(buffer.rope, from);
+  while (it.is_valid()) {
+    String leaf    = leaf_string(buffer, it);
+    i64 offset     = std::max(from - it.start, (i64)0);
+    String rest    = leaf.sub(offset, leaf.size);
+    i64 rest_start = it.start + offset;
+
+    // anything found here starts in the seam, the leaf alone is shorter than the needle
+    i64 head = std::min(keep, rest.size);
+    if (seam.size > 0) {
+      i64 seam_size = seam.size;
+      seam.resize(seam_size + head);
+      memcpy(seam.data + seam_size, rest.data, head);
+      i64 found = find({seam.data, seam.size}, needle);
+      if (found != -1) return seam_start + found;
+      seam.resize(seam_size);
+    }
+
+    i64 found = find(rest, needle);
+    if (found != -1) return rest_start + found;
+
+    if (rest.size >= keep) {
+      seam.resize(keep);
+      memcpy(seam.data, rest.data + rest.size - keep, keep);
+      seam_start = rest_start + rest.size - keep;
+    } else {
+      i64 seam_size = seam.size;
+      seam.resize(seam_size + rest.size);
+      memcpy(seam.data + seam_size, rest.data, rest.size);
+      i64 drop = std::max(seam.size - keep, (i64)0);
+      memmove(seam.data, seam.data + drop, seam.size - drop);
+      seam.resize(seam.size - drop);
+      seam_start = rest_start + rest.size - seam.size;
+    }
+
+    if (!next_leaf(&it)) break;
   }
-  return insert_position(buffer, root_val->children.right, index - left_size,
-                         buffer.summarizer.summarize(accumulator, left->summary));
+  return -1;
 }
-RopeBuffer::Cursor insert_position(RopeBuffer buffer, i64 index)
+
+// the last match starting before before, it may run on past it. the same as find_next
+// walking the leaves backwards, the seam holds the first needle.size - 1 bytes after the
+// leaf being searched
+i64 find_previous(RopeBuffer buffer, i64 before, String needle)
 {
-  if (!buffer.rope.root.is_valid()) {
-    RopeBuffer::Cursor cursor;
-    cursor.current    = NodeRef::invalid();
-    cursor.index      = 0;
-    cursor.node_index = 0;
-    cursor.summary    = {};
-    return cursor;
+  PROFILE_FUNCTION();
+
+  i64 size = buffer.rope.get_summary_or_empty().size;
+  before   = std::min(before, size - needle.size + 1);
+  if (needle.size == 0 || before <= 0) {
+    return -1;
+  }
+
+  Temp tmp;
+  i64 keep = needle.size - 1;
+  DynamicArray<u8> seam(&tmp);
+  seam.set_capacity(keep * 2 + 1);
+
+  // the bytes a match starting just before before runs on into
+  BufferLeafIterator after = leaf_iterator_at(buffer.rope, before);
+  while (after.is_valid() && seam.size < keep) {
+    String leaf = leaf_string(buffer, after);
+    i64 offset  = std::max(before - after.start, (i64)0);
+    i64 take    = std::min(leaf.size - offset, keep - seam.size);
+    i64 written = seam.size;
+    seam.resize(written + take);
+    memcpy(seam.data + written, leaf.data + offset, take);
+    if (!next_leaf(&after)) break;
+  }
+
+  BufferLeafIterator it = leaf_iterator_at(buffer.rope, before - 1);
+  while (it.is_valid()) {
+    String leaf = leaf_string(buffer, it);
+    String rest = leaf.sub(0, std::min(leaf.size, before - it.start));
+
+    // a match that starts in the last bytes of the leaf and ends in the seam comes after
+    // any that fit in the leaf
+    i64 tail_size = std::min(keep, rest.size);
+    if (seam.size > 0 && tail_size > 0) {
+      i64 seam_size = seam.size;
+      seam.resize(seam_size + tail_size);
+      memmove(seam.data + tail_size, seam.data, seam_size);
+      memcpy(seam.data, rest.data + rest.size - tail_size, tail_size);
+      i64 found = find_last({seam.data, seam.size}, needle);
+      if (found != -1) return it.start + rest.size - tail_size + found;
+      memmove(seam.data, seam.data + tail_size, seam_size);
+      seam.resize(seam_size);
+    }
+
+    i64 found = find_last(rest, needle);
+    if (found != -1) return it.start + found;
+
+    if (rest.size >= keep) {
+      seam.resize(keep);
+      memcpy(seam.data, rest.data, keep);
+    } else {
+      i64 seam_size = seam.size;
+      seam.resize(seam_size + rest.size);
+      memmove(seam.data + rest.size, seam.data, seam_size);
+      memcpy(seam.data, rest.data, rest.size);
+      seam.resize(std::min(seam.size, keep));
+    }
+
+    if (!previous_leaf(&it)) break;
   }
-  index = std::clamp(index, 0ll, buffer.rope.get_summary_or_empty().size);
-  return insert_position(buffer, buffer.rope.root, index, {});
+  return -1;
 }
 
-String buffer_to_string(RopeBuffer buffer, DynamicArray<u8> *builder)
+// calls found with where each match starting in [from, to) begins, in order, overlapping
+// ones included. the same seam as find_next, kept going past every match
+template <typename F>
+void for_each_match(RopeBuffer buffer, i64 from, i64 to, String needle, F found)
 {
-  // TODO iterate through tree properly
+  PROFILE_FUNCTION();
+
+  // no match can use a byte past end
   i64 size = buffer.rope.get_summary_or_empty().size;
-  for (i64 i = 0; i < size; i++) {
-    RopeBuffer::Cursor cursor = cursor_at(buffer, i);
-    builder->push_back(char_at(buffer, cursor));
+  from     = std::max(from, (i64)0);
+  i64 end  = std::min(to + needle.size - 1, size);
+  if (needle.size == 0 || from + needle.size > end) {
+    return;
   }
 
-  String string;
-  string.data = builder->data;
-  string.size = builder->size;
-  return string;
+  Temp tmp;
+  i64 keep = needle.size - 1;
+  DynamicArray<u8> seam(&tmp);
+  seam.set_capacity(keep * 2 + 1);
+  i64 seam_start = from;
+
+  BufferLeafIterator it = leaf_iterator_at(buffer.rope, from);
+  while (it.is_valid() && it.start < end) {
+    String leaf    = leaf_string(buffer, it);
+    i64 offset     = std::max(from - it.start, (i64)0);
+    String rest    = leaf.sub(offset, std::min(leaf.size, end - it.start));
+    i64 rest_start = it.start + offset;
+
+    // the seam is shorter than the needle, so whatever starts in it ends in the leaf
+    i64 head = std::min(keep, rest.size);
+    if (seam.size > 0 && head > 0) {
+      i64 seam_size = seam.size;
+      seam.resize(seam_size + head);
+      memcpy(seam.data + seam_size, rest.data, head);
+      for (i64 i = 0;;) {
+        i64 at = find({seam.data + i, seam.size - i}, needle);
+        if (at == -1 || i + at >= seam_size) break;
+        found(seam_start + i + at);
+        i += at + 1;
+      }
+      seam.resize(seam_size);
+    }
+
+    for (i64 i = 0;;) {
+      i64 at = find(rest.sub(i, rest.size), needle);
+      if (at == -1) break;
+      found(rest_start + i + at);
+      i += at + 1;
+    }
+
+    if (rest.size >= keep) {
+      seam.resize(keep);
+      memcpy(seam.data, rest.data + rest.size - keep, keep);
+      seam_start = rest_start + rest.size - keep;
+    } else {
+      i64 seam_size = seam.size;
+      seam.resize(seam_size + rest.size);
+      memcpy(seam.data + seam_size, rest.data, rest.size);
+      i64 drop = std::max(seam.size - keep, (i64)0);
+      memmove(seam.data, seam.data + drop, seam.size - drop);
+      seam.resize(seam.size - drop);
+      seam_start = rest_start + rest.size - seam.size;
+    }
+
+    if (!next_leaf(&it)) break;
+  }
 }
 
 void write_to_disk(RopeBuffer buffer)
 {
-  if (buffer.filename) {
-    DynamicArray<u8> file_content_builder(&system_allocator);
-    String contents = buffer_to_string(buffer, &file_content_builder);
-    write_file(buffer.filename.value(), contents);
+  PROFILE_FUNCTION();
+
+  if (!buffer.filename || is_loading(buffer)) {
+    return;
+  }
+
+  // stream the leaves out, the buffer may be backed by the file being replaced
+  FileReplacement replacement;
+  if (!begin_replacement(buffer.filename.value(), &replacement)) {
+    return;
   }
+
+  BufferLeafIterator it = leaf_iterator_at(buffer.rope, 0);
+  while (it.is_valid()) {
+    write(&replacement, leaf_string(buffer, it));
+    if (!next_leaf(&it)) break;
+  }
+  commit_replacement(&replacement);
 }
 
 // RopeBuffer::Cursor move_forward(RopeBuffer::Cursor c)
@@ -423,60 +857,95 @@ void write_to_disk(RopeBuffer buffer)
 //   return current;
 // }
 
+// a leaf can grow in place when the insert lands on its end, its chunk is the last thing
+// that was appended to the text with room after it and no other rope (like an undo
+// snapshot) shares its path
+bool can_append_to_leaf(RopeBuffer buffer, RopeBuffer::Cursor position)
+{
+  Chunk chunk = buffer.rope.get(position.current)->data;
+  return chunk.index != 0 && chunk.size < BUFFER_CHUNK_MAX_SIZE &&
+         position.node_index == chunk.size &&
+         chunk.index + chunk.size == buffer.text->size && buffer.text->can_extend(1) &&
+         is_uniquely_owned(buffer.rope, position.index - position.node_index);
+}
+
+// appends the span to the text once and splices a balanced subtree of its leaves in
+// with one split and two concatenations, O(log n + k)
 RopeBuffer::Cursor buffer_insert(RopeBuffer &buffer, RopeBuffer::Cursor cursor,
-                                 u8 character)
+                                 String span)
 {
-  NodeRef editing_leaf = insert_position(buffer, cursor.index).current;
-  if (!editing_leaf.is_valid() || cursor != buffer.last_edit ||
-      buffer.rope.get(editing_leaf)->data.size == CHUNK_MAX_SIZE ||
-      buffer.rope.get(editing_leaf)->data.index == 0) {
-    Chunk new_chunk;
-    new_chunk.index = buffer.text->size;
-    new_chunk.size  = 1;
-    buffer.text->push_back(character);
-
-    Rope split_left;
-    Rope split_right;
-    split_left = split(buffer.rope, cursor.index, &split_right);
-    release(buffer.rope);
-
-    NodeRef editing_leaf = new_leaf(buffer.rope, new_chunk);
-    Rope inserted        = insert_right(split_left, editing_leaf);
-    release(split_left);
-
-    Rope new_rope = concatanate(inserted, split_right);
-    release(inserted);
-    release(split_right);
-
-    buffer.rope       = new_rope;
-    cursor.current    = editing_leaf;
-    cursor.node_index = 1;
-  } else {
-    buffer.text->push_back(character);
+  PROFILE_FUNCTION();
+
+  if (span.size == 0) {
+    return cursor;
+  }
+
+  i64 start = buffer.text->append(span.data, span.size);
 
-    Node *leaf_val = buffer.rope.get(editing_leaf);
-    Chunk *chunk   = &leaf_val->data;
-    chunk->size++;
-    leaf_val->summary = buffer.summarizer.summarize(leaf_val->data);
-    restat_for_index(buffer.rope, cursor.index - (chunk->size - 1));
+  BufferRope inserted = buffer.rope;
+  inserted.root =
+      build_over(buffer.rope, start, start + span.size, BUFFER_CHUNK_MAX_SIZE);
+
+  BufferRope split_left;
+  BufferRope split_right;
+  split_left = split(buffer.rope, cursor.index, &split_right);
+  release(buffer.rope);
+
+  BufferRope joined = concatanate(split_left, inserted);
+  release(split_left);
+  release(inserted);
+
+  buffer.rope = concatanate(joined, split_right);
+  release(joined);
+  release(split_right);
+
+  cursor           = cursor_at(buffer, cursor.index + span.size);
+  buffer.last_edit = cursor;
+  return cursor;
+}
+
+RopeBuffer::Cursor buffer_insert(RopeBuffer &buffer, RopeBuffer::Cursor cursor,
+                                 u8 character)
+{
+  RopeBuffer::Cursor position = insert_position(buffer, cursor.index);
+  if (!position.current.is_valid() || cursor != buffer.last_edit ||
+      !can_append_to_leaf(buffer, position)) {
+    return buffer_insert(buffer, cursor, String(&character, 1));
   }
 
+  buffer.text->push_back(character);
+
+  BufferNode *leaf_val = buffer.rope.get(position.current);
+  Chunk *chunk         = &leaf_val->data;
+  chunk->size++;
+  leaf_val->summary = buffer.summarizer.summarize(leaf_val->data);
+  restat_for_index(buffer.rope, cursor.index - (chunk->size - 1));
+
   cursor           = cursor_at(buffer, cursor.index + 1);
   buffer.last_edit = cursor;
   return cursor;
 }
 
-RopeBuffer::Cursor buffer_remove(RopeBuffer &buffer, RopeBuffer::Cursor cursor)
+// cuts [from, to) out with two splits and one concatenation, O(log n) for any range
+RopeBuffer::Cursor buffer_remove_range(RopeBuffer &buffer, i64 from, i64 to)
 {
-  if (cursor.index <= 0) {
-    return cursor;
+  PROFILE_FUNCTION();
+
+  i64 size = buffer.rope.get_summary_or_empty().size;
+  from     = std::clamp(from, (i64)0, size);
+  to       = std::clamp(to, from, size);
+  if (from == to) {
+    return cursor_at(buffer, from);
   }
 
-  Rope splits[4];
-  splits[0] = split(buffer.rope, cursor.index - 1, &splits[1]);
-  splits[2] = split(splits[1], 1, &splits[3]);
+  BufferRope left;
+  BufferRope rest;
+  BufferRope removed;
+  BufferRope right;
+  left    = split(buffer.rope, from, &rest);
+  removed = split(rest, to - from, &right);
 
-  Rope new_rope = merge(splits[0], splits[3]);
+  BufferRope new_rope = concatanate(left, right);
   if (!new_rope.root.is_valid()) {
     Chunk new_chunk;
     new_chunk.index = 0;
@@ -486,19 +955,658 @@ RopeBuffer::Cursor buffer_remove(RopeBuffer &buffer, RopeBuffer::Cursor cursor)
   }
 
   release(buffer.rope);
-  release(splits[0]);
-  release(splits[1]);
-  release(splits[2]);
-  release(splits[3]);
+  release(left);
+  release(rest);
+  release(removed);
+  release(right);
 
   buffer.rope = new_rope;
-  return cursor_at(buffer, cursor.index - 1);
+  return cursor_at(buffer, from);
+}
+
+RopeBuffer::Cursor buffer_remove(RopeBuffer &buffer, RopeBuffer::Cursor cursor)
+{
+  if (cursor.index <= 0) {
+    return cursor;
+  }
+  return buffer_remove_range(buffer, cursor.index - 1, cursor.index);
 }
 
 bool is_valid(RopeBuffer buffer) { return buffer.rope.root.is_valid(); }
 
+//////////////////////////////////////////////
+
+// undo keeps whole rope roots. they share every untouched node with the current rope
+// through the ref counts, so a snapshot is O(1) and each edit only keeps its own O(log n)
+// new path alive
+struct UndoState {
+  NodeRef root;
+  i64 cursor_index;
+};
+
+enum struct EditKind {
+  NONE,
+  INSERT,
+  REMOVE,
+};
+
+struct UndoHistory {
+  DynamicArray<UndoState> undo = DynamicArray<UndoState>(&system_allocator);
+  DynamicArray<UndoState> redo = DynamicArray<UndoState>(&system_allocator);
+
+  // a run of edits of the same kind that each start where the last one ended is one step
+  EditKind last_kind = EditKind::NONE;
+  i64 last_index     = -1;
+};
+
+void clear_redo(UndoHistory *history, RopeBuffer &buffer)
+{
+  for (i64 i = 0; i < history->redo.size; i++) {
+    release(buffer.rope, history->redo[i].root);
+  }
+  history->redo.clear();
+}
+
+// call before editing at cursor_index, snapshots the buffer unless the edit continues the
+// last one
+void begin_edit(UndoHistory *history, RopeBuffer &buffer, i64 cursor_index, EditKind kind)
+{
+  clear_redo(history, buffer);
+  if (kind != EditKind::NONE && kind == history->last_kind &&
+      cursor_index == history->last_index) {
+    return;
+  }
+
+  increment_ref_count(buffer.rope, buffer.rope.root);
+  history->undo.push_back({buffer.rope.root, cursor_index});
+}
+void end_edit(UndoHistory *history, i64 cursor_index, EditKind kind)
+{
+  history->last_kind  = kind;
+  history->last_index = cursor_index;
+}
+
+// the current root moves to the other stack with the reference the buffer held on it
+bool step_history(DynamicArray<UndoState> *from, DynamicArray<UndoState> *to,
+                  UndoHistory *history, RopeBuffer &buffer, i64 *cursor_index)
+{
+  if (from->size == 0) {
+    return false;
+  }
+
+  UndoState state = (*from)[from->size - 1];
+  from->size--;
+  to->push_back({buffer.rope.root, *cursor_index});
+
+  buffer.rope.root   = state.root;
+  buffer.last_edit   = {};
+  *cursor_index      = state.cursor_index;
+  history->last_kind = EditKind::NONE;
+  return true;
+}
+bool undo(UndoHistory *history, RopeBuffer &buffer, i64 *cursor_index)
+{
+  return step_history(&history->undo, &history->redo, history, buffer, cursor_index);
+}
+bool redo(UndoHistory *history, RopeBuffer &buffer, i64 *cursor_index)
+{
+  return step_history(&history->redo, &history->undo, history, buffer, cursor_index);
+}
+
+//////////////////////////////////////////////
+
+// a copy of the buffer holding its own reference on the root, for reading on another
+// thread while this one keeps editing. nodes and text never move and edits never change
+// a node that is shared, so the snapshot stays as it was. release it from whichever thread
+// is done with it
+RopeBuffer take_snapshot(RopeBuffer buffer)
+{
+  increment_ref_count(buffer.rope, buffer.rope.root);
+  buffer.compaction->snapshots.fetch_add(1, std::memory_order_relaxed);
+  return buffer;
+}
+void release_snapshot(RopeBuffer snapshot)
+{
+  release(snapshot.rope);
+  snapshot.compaction->snapshots.fetch_sub(1, std::memory_order_release);
+}
+
+//////////////////////////////////////////////
+
+// every leaf that any rope over the buffer's pool still holds on to, found by skipping the
+// slots on the pool's free list
+void collect_live_leaves(RopeBuffer buffer, DynamicArray<BufferNode *> *leaves)
+{
+  Pool<BufferNode> *pool = buffer.rope.node_pool;
+
+  DynamicArray<b8> is_free(&system_allocator);
+  is_free.resize(pool->capacity);
+  memset(is_free.data, 0, pool->capacity * sizeof(b8));
+  pool->mark_free(is_free.data);
+
+  for (i64 i = 0; i < pool->capacity; i++) {
+    BufferNode *node = &(*pool)[i];
+    if (!is_free[i] && node->type == Node::Type::LEAF) {
+      leaves->push_back(node);
+    }
+  }
+  system_allocator.free(is_free.allocation);
+}
+
+void start_compaction(RopeBuffer buffer)
+{
+  PROFILE_FUNCTION();
+
+  TextCompaction *compaction = buffer.compaction;
+  compaction->runs.clear();
+
+  DynamicArray<BufferNode *> leaves(&system_allocator);
+  collect_live_leaves(buffer, &leaves);
+  for (i64 i = 0; i < leaves.size; i++) {
+    Chunk chunk = leaves[i]->data;
+    if (chunk.size > 0 && !(chunk.index & ORIGINAL_TEXT_BIT)) {
+      compaction->runs.push_back({chunk.index, chunk.index + chunk.size, 0});
+    }
+  }
+  system_allocator.free(leaves.allocation);
+
+  DynamicArray<TextRun> &runs = compaction->runs;
+  std::sort(runs.data, runs.data + runs.size,
+            [](const TextRun &a, const TextRun &b) { return a.start < b.start; });
+
+  i64 run_count  = 0;
+  i64 live_bytes = 0;
+  for (i64 i = 0; i < runs.size; i++) {
+    if (run_count > 0 && runs[i].start <= runs[run_count - 1].end) {
+      runs[run_count - 1].end = std::max(runs[run_count - 1].end, runs[i].end);
+    } else {
+      runs[run_count++] = runs[i];
+    }
+  }
+  runs.resize(run_count);
+  for (i64 i = 0; i < runs.size; i++) {
+    runs[i].new_start = live_bytes;
+    live_bytes += runs[i].end - runs[i].start;
+  }
+
+  compaction->live_bytes = live_bytes;
+  compaction->text_size  = buffer.text->size;
+  compaction->next_size  = std::max(COMPACTION_MIN_SIZE, buffer.text->size * 2);
+
+  // not worth copying everything to get back less than a quarter
+  if (live_bytes * 4 > buffer.text->size * 3) {
+    return;
+  }
+
+  // sized so every run lands in its first segment, the runs stay contiguous
+  compaction->arena = new SegmentedArray<u8>(&system_allocator, live_bytes);
+  compaction->arena->append_space(live_bytes);
+  compaction->run        = 0;
+  compaction->run_copied = 0;
+}
+
+void finish_compaction(RopeBuffer buffer)
+{
+  TextCompaction *compaction  = buffer.compaction;
+  DynamicArray<TextRun> &runs = compaction->runs;
+
+  DynamicArray<BufferNode *> leaves(&system_allocator);
+  collect_live_leaves(buffer, &leaves);
+  for (i64 i = 0; i < leaves.size; i++) {
+    Chunk *chunk = &leaves[i]->data;
+    if (chunk->size == 0) {
+      chunk->index = 0;
+      continue;
+    }
+    if (chunk->index & ORIGINAL_TEXT_BIT) {
+      continue;
+    }
+
+    // last run starting at or before the chunk
+    i64 low  = 0;
+    i64 high = runs.size - 1;
+    while (low < high) {
+      i64 middle = (low + high + 1) / 2;
+      if (runs[middle].start <= chunk->index) {
+        low = middle;
+      } else {
+        high = middle - 1;
+      }
+    }
+    assert(chunk->index + chunk->size <= runs[low].end);
+    chunk->index = runs[low].new_start + (chunk->index - runs[low].start);
+  }
+  system_allocator.free(leaves.allocation);
+
+  // swap the contents so every copy of the buffer and its summarizer see the new text
+  SegmentedArray<u8> old_text = *buffer.text;
+  *buffer.text                = *compaction->arena;
+  compaction->reclaimed_bytes += old_text.size - buffer.text->size;
+  compaction->passes++;
+  old_text.free_segments();
+  delete compaction->arena;
+  compaction->arena = nullptr;
+
+  compaction->next_size = std::max(COMPACTION_MIN_SIZE, buffer.text->size * 2);
+}
+
+void abort_compaction(RopeBuffer buffer)
+{
+  TextCompaction *compaction = buffer.compaction;
+  compaction->arena->free_segments();
+  delete compaction->arena;
+  compaction->arena = nullptr;
+}
+
+// does a bounded step of compaction, meant to be called on idle frames. returns whether a
+// pass is still in progress
+bool continue_compaction(RopeBuffer buffer)
+{
+  TextCompaction *compaction = buffer.compaction;
+  if (compaction->snapshots.load(std::memory_order_acquire) > 0) {
+    return compaction->arena != nullptr;
+  }
+  if (!compaction->arena) {
+    if (is_loading(buffer) || buffer.text->size < compaction->next_size) {
+      return false;
+    }
+    start_compaction(buffer);
+    return compaction->arena != nullptr;
+  }
+
+  // whatever was appended since the pass started isn't covered by the runs, so start over
+  if (buffer.text->size != compaction->text_size) {
+    abort_compaction(buffer);
+    return false;
+  }
+  PROFILE_ZONE("compaction step");
+
+  DynamicArray<TextRun> &runs = compaction->runs;
+  i64 budget                  = COMPACTION_STEP_BYTES;
+  while (compaction->run < runs.size && budget > 0) {
+    TextRun run = runs[compaction->run];
+    i64 from    = run.start + compaction->run_copied;
+
+    // leaves that were next to each other can still straddle two segments of the text
+    i64 size = std::min(run.end - from, budget);
+    size     = std::min(size, buffer.text->contiguous_from(from));
+    memcpy(compaction->arena->at(run.new_start + compaction->run_copied),
+           buffer.text->at(from), size);
+
+    budget -= size;
+    compaction->run_copied += size;
+    if (compaction->run_copied == run.end - run.start) {
+      compaction->run++;
+      compaction->run_copied = 0;
+    }
+  }
+
+  if (compaction->run < runs.size) {
+    return true;
+  }
+  finish_compaction(buffer);
+  return false;
+}
+
+struct TextStats {
+  i64 live_bytes;  // as of the last pass
+  i64 arena_bytes;
+  i64 passes;
+  i64 reclaimed_bytes;
+};
+
+TextStats text_stats(RopeBuffer buffer)
+{
+  TextStats stats;
+  stats.live_bytes      = buffer.compaction->live_bytes;
+  stats.arena_bytes     = buffer.text->size;
+  stats.passes          = buffer.compaction->passes;
+  stats.reclaimed_bytes = buffer.compaction->reclaimed_bytes;
+  return stats;
+}
+
 // tests
 
+i64 count_live_nodes(RopeBuffer buffer)
+{
+  Pool<BufferNode> *pool = buffer.rope.node_pool;
+  return pool->capacity - pool->count_free();
+}
+
+String repeat_line(DynamicArray<u8> *contents, String line, i64 size)
+{
+  while (contents->size < size) {
+    i64 start = contents->size;
+    contents->resize(start + line.size);
+    memcpy(contents->data + start, line.data, line.size);
+  }
+  return {contents->data, contents->size};
+}
+
+void undo_tests()
+{
+  DynamicArray<u8> contents(&system_allocator);
+  String text =
+      repeat_line(&contents, "the quick brown fox jumps over the lazy dog\n", 256 * KB);
+
+  RopeBuffer buffer = create_rope_buffer();
+  fill_rope(&buffer, text);
+  UndoHistory history;
+
+  // scattered edits, so each one is its own step and keeps its own path alive
+  i64 edit_count   = 2000;
+  i64 nodes_before = count_live_nodes(buffer);
+  for (i64 i = 0; i < edit_count; i++) {
+    i64 index                 = (i * 7919) % text.size;
+    RopeBuffer::Cursor cursor = cursor_at(buffer, index);
+    begin_edit(&history, buffer, index, EditKind::INSERT);
+    cursor = buffer_insert(buffer, cursor, 'x');
+    end_edit(&history, cursor.index, EditKind::INSERT);
+  }
+  assert(history.undo.size == edit_count);
+
+  i64 depth = 64 - __builtin_clzll(text.size / BUFFER_CHUNK_MAX_SIZE);
+  i64 nodes_per_edit = (count_live_nodes(buffer) - nodes_before) / edit_count;
+  assert(nodes_per_edit <= 4 * depth);
+
+  i64 cursor_index = 0;
+  while (undo(&history, buffer, &cursor_index)) {
+  }
+  DynamicArray<u8> builder(&system_allocator);
+  assert(buffer_to_string(buffer, &builder) == text);
+
+  while (redo(&history, buffer, &cursor_index)) {
+  }
+  assert(buffer.rope.get_summary_or_empty().size == text.size + edit_count);
+
+  // a typing burst is one step
+  RopeBuffer::Cursor cursor = cursor_at(buffer, 10);
+  for (i32 i = 0; i < 100; i++) {
+    begin_edit(&history, buffer, cursor.index, EditKind::INSERT);
+    cursor = buffer_insert(buffer, cursor, 'y');
+    end_edit(&history, cursor.index, EditKind::INSERT);
+  }
+  assert(undo(&history, buffer, &cursor_index));
+  assert(cursor_index == 10);
+  assert(buffer.rope.get_summary_or_empty().size == text.size + edit_count);
+
+  system_allocator.free(builder.allocation);
+  system_allocator.free(contents.allocation);
+}
+
+// walks every leaf of the snapshot and checks it adds up to the root's summary
+void check_snapshot(RopeBuffer snapshot)
+{
+  Summary counted       = {};
+  BufferLeafIterator it = leaf_iterator_at(snapshot.rope, 0);
+  while (it.is_valid()) {
+    String span = leaf_string(snapshot, it);
+    assert(it.leaf()->summary.size == span.size);
+    for (i64 i = 0; i < span.size; i++) {
+      accumulate(&counted, span[i]);
+    }
+
+    if (!next_leaf(&it)) break;
+  }
+
+  Summary summary = snapshot.rope.get_summary_or_empty();
+  assert(summary.size == counted.size);
+  assert(summary.newlines == counted.newlines);
+}
+
+// one thread edits while readers check snapshots of it and release them on their own
+// threads, racing the writer on the pool's free list and the nodes' ref counts
+void snapshot_tests()
+{
+  DynamicArray<u8> contents(&system_allocator);
+  String text = repeat_line(&contents, "all work and no play\n", 64 * KB);
+
+  RopeBuffer buffer = create_rope_buffer();
+  fill_rope(&buffer, text);
+
+  // every check reads the whole snapshot, so the text is kept small
+  i64 edit_count = 1000;
+  String span    = "abc\ndefghij\nklmn\n";
+
+  const i32 READER_COUNT = 4;
+  RopeBuffer shared      = buffer;
+  std::atomic<i64> slots[READER_COUNT];  // a root handed to each reader, or -1
+  std::atomic<bool> done{false};
+  std::atomic<i64> checked{0};
+
+  std::thread readers[READER_COUNT];
+  for (i32 r = 0; r < READER_COUNT; r++) {
+    slots[r].store(-1);
+    readers[r] = std::thread([&, r]() {
+      while (true) {
+        i64 root = slots[r].exchange(-1, std::memory_order_acquire);
+        if (root == -1) {
+          if (done.load(std::memory_order_acquire)) return;
+          std::this_thread::yield();
+          continue;
+        }
+
+        RopeBuffer snapshot = shared;
+        snapshot.rope.root  = root;
+        check_snapshot(snapshot);
+        release_snapshot(snapshot);
+        checked.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+  }
+
+  u64 seed = 1;
+  for (i64 i = 0; i < edit_count; i++) {
+    seed      = seed * 6364136223846793005ull + 1442695040888963407ull;
+    i64 size  = buffer.rope.get_summary_or_empty().size;
+    i64 index = (seed >> 33) % (size + 1);
+    if ((seed >> 20) & 1 && index < size) {
+      i64 to = std::min(size, index + 1 + (i64)((seed >> 24) % 32));
+      buffer_remove_range(buffer, index, to);
+    } else {
+      String inserted = {span.data, 1 + (i64)((seed >> 24) % span.size)};
+      buffer_insert(buffer, cursor_at(buffer, index), inserted);
+    }
+
+    for (i32 r = 0; r < READER_COUNT; r++) {
+      if (slots[r].load(std::memory_order_relaxed) == -1) {
+        slots[r].store(take_snapshot(buffer).rope.root.index, std::memory_order_release);
+      }
+    }
+  }
+
+  done.store(true, std::memory_order_release);
+  for (i32 r = 0; r < READER_COUNT; r++) {
+    readers[r].join();
+
+    i64 root = slots[r].load();
+    if (root != -1) {
+      RopeBuffer snapshot = shared;
+      snapshot.rope.root  = root;
+      release_snapshot(snapshot);
+    }
+  }
+  assert(checked.load() > 0);
+  assert(buffer.compaction->snapshots.load() == 0);
+
+  // every reference the readers took was dropped exactly once
+  check_snapshot(buffer);
+  release(buffer.rope);
+  assert(count_live_nodes(buffer) == 0);
+
+  system_allocator.free(contents.allocation);
+}
+
+// checks the spans of lines [first_line, last_line] against the lines of text
+void check_visible_lines(String text, DynamicArray<LineSpan> *spans, i64 first_line,
+                         i64 last_line, i64 max_line_bytes)
+{
+  i64 line  = 0;
+  i64 start = 0;
+  while (line < first_line && start < text.size) {
+    if (text.data[start] == '\n') line++;
+    start++;
+  }
+
+  i64 span = 0;
+  for (; line <= last_line && start < text.size; line++) {
+    u8 *newline = (u8 *)memchr(text.data + start, '\n', text.size - start);
+    i64 length  = newline ? newline - (text.data + start) + 1 : text.size - start;
+
+    i64 seen = 0;
+    while (span < spans->size && (*spans)[span].line == line) {
+      LineSpan piece = (*spans)[span];
+      assert(piece.index == start + seen);
+      assert(memcmp(piece.text.data, text.data + piece.index, piece.text.size) == 0);
+      seen += piece.text.size;
+      span++;
+    }
+    assert(seen == std::min(length, max_line_bytes));
+    start += length;
+  }
+  assert(span == spans->size);
+}
+
+void text_growth_tests()
+{
+  DynamicArray<u8> contents(&system_allocator);
+  String text =
+      repeat_line(&contents, "the quick brown fox jumps over the lazy dog\n", 64 * KB);
+
+  RopeBuffer buffer = create_rope_buffer();
+  fill_rope(&buffer, text);
+
+  // scattered edits copy the leaves they cut up together with a neighbour, so the leaves
+  // stay in bounds instead of the tree filling with slivers
+  for (i64 i = 0; i < 1000; i++) {
+    buffer_insert(buffer, cursor_at(buffer, (i * 7919) % text.size), 'x');
+  }
+  for (i64 i = 0; i < 500; i++) {
+    buffer_remove(buffer, cursor_at(buffer, 1 + (i * 7919) % text.size));
+  }
+  i64 size              = buffer.rope.get_summary_or_empty().size;
+  BufferLeafIterator it = leaf_iterator_at(buffer.rope, 0);
+  while (it.is_valid()) {
+    i64 leaf_size = it.leaf()->data.size;
+    assert(leaf_size > 0 && leaf_size <= BUFFER_CHUNK_MAX_SIZE);
+#if USE_BTREE_ROPE
+    assert(leaf_size >= BTREE_CHUNK_MIN_SIZE || leaf_size == size);
+#endif
+    if (!next_leaf(&it)) break;
+  }
+
+  // and the text they leave behind is given back by a compaction pass
+  DynamicArray<u8> before(&system_allocator);
+  String edited = buffer_to_string(buffer, &before);
+  i64 written   = buffer.text->size;
+  assert(written > size);
+
+  buffer.compaction->next_size = 0;
+  for (i32 steps = 0; continue_compaction(buffer); steps++) assert(steps < 16);
+  TextStats stats = text_stats(buffer);
+  assert(stats.passes == 1 && stats.reclaimed_bytes == written - size);
+  assert(buffer.text->size == size);
+
+  DynamicArray<u8> after(&system_allocator);
+  String compacted = buffer_to_string(buffer, &after);
+  assert(compacted.size == size && memcmp(compacted.data, edited.data, size) == 0);
+
+  release(buffer.rope);
+  system_allocator.free(contents.allocation);
+  system_allocator.free(before.allocation);
+  system_allocator.free(after.allocation);
+}
+
+void viewport_tests()
+{
+  // lines of every length from empty to a few times the view width
+  DynamicArray<u8> contents(&system_allocator);
+  for (i64 i = 0; contents.size < 1 * MB; i++) {
+    i64 length = (i * 37) % 300;
+    i64 start  = contents.size;
+    contents.resize(start + length + 1);
+    memset(contents.data + start, 'a' + i % 26, length);
+    contents.data[start + length] = '\n';
+  }
+  String text = {contents.data, contents.size - 1};  // no newline at the end
+
+  RopeBuffer buffer = create_rope_buffer();
+  fill_rope(&buffer, text);
+  BasicBuffer basic = create_buffer();
+  fill_buffer(&basic, text);
+  move_gap(&basic, text.size / 2);  // so the gap splits a line in the middle
+
+  i64 line_count = buffer.rope.get_summary_or_empty().newlines + 1;
+  i64 tops[]     = {0, 1, line_count / 2, line_count - 10, line_count - 1};
+  for (i64 top : tops) {
+    Temp tmp;
+    DynamicArray<LineSpan> buffer_spans(&tmp);
+    DynamicArray<LineSpan> basic_spans(&tmp);
+
+    i64 end = visible_lines(buffer, top, top + 50, 120, &buffer_spans);
+    check_visible_lines(text, &buffer_spans, top, top + 50, 120);
+    assert(end == visible_lines(&basic, top, top + 50, 120, &basic_spans));
+    check_visible_lines(text, &basic_spans, top, top + 50, 120);
+  }
+
+  release(buffer.rope);
+}
+
+void find_tests()
+{
+  // short random spans inserted all over, so matches straddle many leaves
+  RopeBuffer buffer = create_rope_buffer();
+  fill_rope(&buffer, "");
+  u64 random = 7;
+  u8 span[16];
+  for (i32 i = 0; i < 1000; i++) {
+    random = random * 6364136223846793005ull + 1442695040888963407ull;
+    i64 size  = (random >> 40) % 16 + 1;
+    i64 index = (random >> 20) % (buffer.rope.get_summary_or_empty().size + 1);
+    for (i64 c = 0; c < size; c++) span[c] = 'a' + (random >> (c * 2)) % 3;
+    buffer_insert(buffer, cursor_at(buffer, index), String(span, size));
+  }
+
+  DynamicArray<u8> contents(&system_allocator);
+  String text = buffer_to_string(buffer, &contents);
+  // each check scans the whole text for the expected answer, so the strides are coarse
+  for (i64 needle_size : {1, 5, 17, 40}) {
+    for (i64 start = 0; start + needle_size <= text.size; start += 2999) {
+      String needle = text.sub(start, start + needle_size);
+      for (i64 from = 0; from <= text.size + 1; from += 331) {
+        i64 forward = -1;
+        if (from <= text.size) {
+          forward = find_scalar(text.data + from, text.size - from, needle.data, needle.size);
+          if (forward != -1) forward += from;
+        }
+        assert(find_next(buffer, from, needle) == forward);
+
+        i64 searched = std::min(text.size, from + needle.size - 1);
+        i64 backward = find_last_scalar(text.data, searched, needle.data, needle.size);
+        assert(find_previous(buffer, from, needle) == backward);
+      }
+    }
+  }
+  for (i64 needle_size : {1, 3, 17, 40}) {
+    String needle = text.sub(500, 500 + needle_size);
+    for (i64 from = 0; from < text.size; from += 1931) {
+      i64 to       = from + 2477;
+      i64 expected = from - 1;
+      for_each_match(buffer, from, to, needle, [&](i64 at) {
+        expected = find_next(buffer, expected + 1, needle);
+        assert(at == expected && at < to);
+      });
+      i64 after = find_next(buffer, expected + 1, needle);
+      assert(after == -1 || after >= to);
+    }
+  }
+  assert(find_next(buffer, 0, "z") == -1 && find_previous(buffer, text.size, "z") == -1);
+  assert(find_next(buffer, 0, "") == -1);
+
+  system_allocator.free(contents.allocation);
+  release(buffer.rope);
+}
+
 void rope_buffer_tests()
 {
   File test_file;
@@ -512,4 +1620,10 @@ void rope_buffer_tests()
   // }
 
   // error(to_string(buffer.rope, &system_allocator));
+
+  undo_tests();
+  snapshot_tests();
+  text_growth_tests();
+  viewport_tests();
+  find_tests();
 }
\ No newline at end of file
@@ -4,28 +4,86 @@
 
 #include "actions.hpp"
 #include "containers/rope.hpp"
-#include "draw.hpp"
-#include "font.hpp"
-#include "gpu/metal/texture.hpp"
 #include "input.hpp"
-#include "platform.hpp"
+#include "latency.hpp"
+#include "regex.hpp"
 #include "rope_buffer.hpp"
-#include "settings.hpp"
+#include "search_session.hpp"
+
+// HEADLESS builds the editor core without a window, see build_bench.sh
+#if HEADLESS
+#include "platform_headless.hpp"
+#else
+#include "platform.hpp"
+#endif
 
 struct RopeEditor {
   RopeBuffer buffer;
+  UndoHistory history;
 
   RopeBuffer::Cursor cursor = {};
   RopeBuffer::Cursor anchor = {};
   i64 want_column           = 0.f;
 
   f64 scroll = 0.f;
+
+  SearchSession search;  // of the find query, told about every edit made here
 };
 
+// moves the cursor to the start of the next match of query after it, or of the last one
+// before it, wrapping around the ends of the buffer
+bool jump_to_match(RopeEditor *editor, String query, bool forward)
+{
+  i64 size  = editor->buffer.rope.get_summary_or_empty().size;
+  i64 found = forward ? find_next(editor->buffer, editor->cursor.index + 1, query)
+                      : find_previous(editor->buffer, editor->cursor.index, query);
+  if (found == -1) {
+    found = forward ? find_next(editor->buffer, 0, query)
+                    : find_previous(editor->buffer, size, query);
+  }
+  if (found == -1) {
+    return false;
+  }
+
+  editor->cursor      = cursor_at(editor->buffer, found);
+  editor->want_column = editor->cursor.column();
+  return true;
+}
+
+// the same for a pattern, a pattern that doesn't compile doesn't move the cursor
+bool jump_to_regex_match(RopeEditor *editor, String pattern, bool forward)
+{
+  PROFILE_FUNCTION();
+
+  Regex regex;
+  if (!compile_regex(&regex, pattern)) {
+    free_regex(&regex);
+    return false;
+  }
+
+  i64 size         = editor->buffer.rope.get_summary_or_empty().size;
+  RegexMatch found = forward
+                         ? regex_find_next(&regex, editor->buffer, editor->cursor.index + 1)
+                         : regex_find_previous(&regex, editor->buffer, editor->cursor.index);
+  if (found.start == -1) {
+    found = forward ? regex_find_next(&regex, editor->buffer, 0)
+                    : regex_find_previous(&regex, editor->buffer, size);
+  }
+  free_regex(&regex);
+  if (found.start == -1) {
+    return false;
+  }
+
+  editor->cursor      = cursor_at(editor->buffer, found.start);
+  editor->want_column = editor->cursor.column();
+  return true;
+}
+
 void process(RopeEditor *editor, Actions *actions)
 {
   for (i32 i = 0; i < actions->size; i++) {
     Action *action = &actions->operator[](i);
+    LatencyScope latency_scope(action);
 
     if (eat(action, Command::BUFFER_CHANGE_MODE)) {
       if (mode == Mode::INSERT) {
@@ -46,13 +104,6 @@ void process(RopeEditor *editor, Actions *actions)
     //   copy_str.size = end - start + 1;
     //   Platform::set_clipboard(copy_str);
     // }
-    // if (eat(action, Command::BUFFER_PASTE)) {
-    //   String paste_str = Platform::get_clipboard();
-    //   for (i32 i = 0; i < paste_str.size; i++) {
-    //     editor->cursor = buffer_insert(editor->buffer, editor->cursor,
-    //     paste_str.data[i]);
-    //   }
-    // }
 
     if (eat(action, Command::NAV_LINE_DOWN)) {
       editor->cursor =
@@ -123,80 +174,74 @@ void process(RopeEditor *editor, Actions *actions)
     //   editor->cursor = next;
     // }
 
+    // the buffer is read only until its whole file is in the rope
+    if (is_loading(editor->buffer)) {
+      continue;
+    }
+
+    if (eat(action, Command::BUFFER_UNDO)) {
+      i64 cursor_index = editor->cursor.index;
+      i64 size         = editor->buffer.rope.get_summary_or_empty().size;
+      if (undo(&editor->history, editor->buffer, &cursor_index)) {
+        // the history doesn't know what changed, so everything did
+        i64 new_size = editor->buffer.rope.get_summary_or_empty().size;
+        note_edit(&editor->search, 0, size, new_size);
+        editor->cursor      = cursor_at(editor->buffer, cursor_index);
+        editor->want_column = editor->cursor.column();
+      }
+    }
+    if (eat(action, Command::BUFFER_REDO)) {
+      i64 cursor_index = editor->cursor.index;
+      i64 size         = editor->buffer.rope.get_summary_or_empty().size;
+      if (redo(&editor->history, editor->buffer, &cursor_index)) {
+        // the history doesn't know what changed, so everything did
+        i64 new_size = editor->buffer.rope.get_summary_or_empty().size;
+        note_edit(&editor->search, 0, size, new_size);
+        editor->cursor      = cursor_at(editor->buffer, cursor_index);
+        editor->want_column = editor->cursor.column();
+      }
+    }
+
+    if (eat(action, Command::BUFFER_PASTE)) {
+      String paste_str = Platform::get_clipboard();
+      begin_edit(&editor->history, editor->buffer, editor->cursor.index, EditKind::NONE);
+      note_edit(&editor->search, editor->cursor.index, 0, paste_str.size);
+      editor->cursor = buffer_insert(editor->buffer, editor->cursor, paste_str);
+      end_edit(&editor->history, editor->cursor.index, EditKind::NONE);
+      editor->want_column = editor->cursor.column();
+    }
     if (eat(action, Command::INPUT_NEWLINE)) {
-      buffer_insert(editor->buffer, editor->cursor, '\n');
-      editor->cursor = cursor_at(editor->buffer, editor->cursor.index + 1);
+      begin_edit(&editor->history, editor->buffer, editor->cursor.index, EditKind::INSERT);
+      note_edit(&editor->search, editor->cursor.index, 0, 1);
+      editor->cursor = buffer_insert(editor->buffer, editor->cursor, '\n');
+      end_edit(&editor->history, editor->cursor.index, EditKind::INSERT);
     }
     if (eat(action, Command::INPUT_TAB)) {
+      begin_edit(&editor->history, editor->buffer, editor->cursor.index, EditKind::INSERT);
+      note_edit(&editor->search, editor->cursor.index, 0, 2);
       for (i32 i = 0; i < 2; i++) {
         editor->cursor = buffer_insert(editor->buffer, editor->cursor, ' ');
       }
+      end_edit(&editor->history, editor->cursor.index, EditKind::INSERT);
     }
     if (eat(action, Command::INPUT_BACKSPACE)) {
-      String text_contents;
-      text_contents.data = editor->buffer.text->data;
-      text_contents.size = editor->buffer.text->size;
-
+      begin_edit(&editor->history, editor->buffer, editor->cursor.index, EditKind::REMOVE);
+      if (editor->cursor.index > 0) {
+        note_edit(&editor->search, editor->cursor.index - 1, 1, 0);
+      }
       editor->cursor = buffer_remove(editor->buffer, editor->cursor);
+      end_edit(&editor->history, editor->cursor.index, EditKind::REMOVE);
     }
     if (eat(action, Command::INPUT_TEXT)) {
+      begin_edit(&editor->history, editor->buffer, editor->cursor.index, EditKind::INSERT);
+      note_edit(&editor->search, editor->cursor.index, 0, 1);
       editor->cursor = buffer_insert(editor->buffer, editor->cursor, action->character);
+      end_edit(&editor->history, editor->cursor.index, EditKind::INSERT);
       editor->want_column = editor->cursor.column();
     }
   }
 }
 
-void draw_editor(RopeEditor &editor, Draw::List *dl, Rect4f target_rect,
-                 ViewRange view_range, bool focused)
-{
-  RopeBuffer buffer = editor.buffer;
-  Font &font        = dl->font;
-  f32 space_width   = font.glyphs_zero[' '].advance.x;
-
-  Vec2f pos = {
-      target_rect.x + view_range.text_offset.x * space_width,
-      target_rect.y + view_range.text_offset.y * font.height,
-  };
-  RopeBuffer::Cursor iterator = cursor_at_point(buffer, view_range.top_line, 0);
-  while ((is_valid(iterator) || is_eof(editor.buffer, iterator)) &&
-         iterator.line() < view_range.last_line) {
-    Color cursor_color = focused ? settings.activated_color : settings.deactivated_color;
-    if (iterator.index == editor.anchor.index) {
-      Rect4f fill_rect   = {pos.x, pos.y - font.descent, space_width, font.height};
-      Rect4f border_rect = inset(fill_rect, -2.f);
-      Draw::push_rounded_rect(dl, 0, border_rect, 3, cursor_color);
-      Draw::push_rounded_rect(dl, 0, fill_rect, 3, Color(40, 44, 52));
-    }
-    if (iterator.index == editor.cursor.index) {
-      Rect4f cursor_rect = {pos.x, pos.y - font.descent, space_width, font.height};
-      Draw::push_rounded_rect(dl, 0, cursor_rect, 1, cursor_color);
-    }
-
-    if (iterator.index >= buffer.rope.get_summary_or_empty().size) {
-      break;
-    }
-
-    u8 c = char_at(buffer, iterator);
-    if (c == '\n') {
-      pos.y += font.height;
-      pos.x = target_rect.x;
-    } else if (c == '\t') {
-      pos.x += 2 * space_width;
-    } else if (c == ' ') {
-      pos.x += space_width;
-    } else {
-      if ((i32)c >= font.glyphs_zero.size) {
-        c = 0;
-      }
-      Color color = (iterator.index == editor.cursor.index) ? Color(34, 36, 43)
-                                                            : settings.text_color;
-      pos         = Draw::draw_char(dl, dl->font, color, c, pos);
-    }
-
-    iterator = cursor_at(buffer, iterator.index + 1);
-  }
-}
-
 void clear_and_reset(RopeEditor *editor)
 {
   // editor->buffer->size = 0;
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "draw.hpp"
+#include "editor.hpp"
+#include "font.hpp"
+#include "rope_editor.hpp"
+#include "settings.hpp"
+
+void draw_editor(RopeEditor &editor, Draw::List *dl, Rect4f target_rect,
+                 ViewRange view_range, bool focused)
+{
+  RopeBuffer buffer = editor.buffer;
+  Font &font        = dl->font;
+  f32 space_width   = font.glyphs_zero[' '].advance.x;
+
+  Vec2f origin = {
+      target_rect.x + view_range.text_offset.x * space_width,
+      target_rect.y + view_range.text_offset.y * font.height,
+  };
+  Color cursor_color = focused ? settings.activated_color : settings.deactivated_color;
+  auto draw_marks    = [&](i64 index, Vec2f pos) {
+    if (index == editor.anchor.index) {
+      Rect4f fill_rect   = {pos.x, pos.y - font.descent, space_width, font.height};
+      Rect4f border_rect = inset(fill_rect, -2.f);
+      Draw::push_rounded_rect(dl, 0, border_rect, 3, cursor_color);
+      Draw::push_rounded_rect(dl, 0, fill_rect, 3, Color(40, 44, 52));
+    }
+    if (index == editor.cursor.index) {
+      Rect4f cursor_rect = {pos.x, pos.y - font.descent, space_width, font.height};
+      Draw::push_rounded_rect(dl, 0, cursor_rect, 1, cursor_color);
+    }
+  };
+
+  Temp tmp;
+  DynamicArray<LineSpan> spans(&tmp);
+  i64 end = visible_lines(buffer, view_range.top_line, view_range.last_line,
+                          view_range.num_columns, &spans);
+
+  // the matches of the find query behind the text, the spans only go forward so one
+  // lookup finds the first
+  SearchSession *search = &editor.search;
+  i64 query_size        = search->query.size;
+  i64 matches           = match_count(search);
+  i64 next_match =
+      spans.size > 0 ? first_match_after(search, spans[0].index - query_size + 1) : 0;
+
+  Vec2f pos      = origin;
+  i64 first_line = spans.size > 0 ? spans[0].line : 0;
+  for (i64 i = 0; i < spans.size; i++) {
+    LineSpan span = spans[i];
+    if (i > 0 && span.line != spans[i - 1].line) {
+      pos = {origin.x, origin.y + (span.line - first_line) * font.height};
+    }
+
+    for (i64 j = 0; j < span.text.size; j++) {
+      i64 index = span.index + j;
+      u8 c      = span.text.data[j];
+      while (next_match < matches && match_at(search, next_match) + query_size <= index) {
+        next_match++;
+      }
+      if (next_match < matches && match_at(search, next_match) <= index && c != '\n') {
+        f32 width         = (c == '\t' ? 2 : 1) * space_width;
+        Rect4f match_rect = {pos.x, pos.y - font.descent, width, font.height};
+        Draw::push_rect(dl, 0, match_rect, settings.match_color);
+      }
+      draw_marks(index, pos);
+
+      if (c == '\n') {
+        pos.y += font.height;
+        pos.x = origin.x;
+      } else if (c == '\t') {
+        pos.x += 2 * space_width;
+      } else if (c == ' ') {
+        pos.x += space_width;
+      } else {
+        if ((i32)c >= font.glyphs_zero.size) {
+          c = 0;
+        }
+        Color color =
+            (index == editor.cursor.index) ? Color(34, 36, 43) : settings.text_color;
+        pos = Draw::draw_char(dl, dl->font, color, c, pos);
+      }
+    }
+  }
+  if (end == buffer.rope.get_summary_or_empty().size) {
+    draw_marks(end, pos);
+  }
+}
@@ -0,0 +1,471 @@
+#pragma once
+
+#include <algorithm>
+
+#include "containers/dynamic_array.hpp"
+#include "memory.hpp"
+#include "parallel_search.hpp"
+#include "profiler.hpp"
+#include "rope_buffer.hpp"
+#include "string.hpp"
+#include "types.hpp"
+
+// The matches of the find query in one buffer, kept up to date while the query is typed
+// and the buffer is edited, so the count and the highlights don't search the whole buffer
+// on every key.
+//
+// A match is every place the query occurs, overlapping ones too. That makes the matches
+// of a longer query a subset of the matches of its prefix, so typing on only checks the
+// new bytes at each match. Any other change to the query searches everything again.
+//
+// Edits are noted as they're made. The matches an edit cuts into are dropped, the ones
+// after it move by what it inserted minus what it removed, and the bytes it touched are
+// kept as a dirty range that's mapped through the edits after it. The next update only
+// searches around the dirty ranges.
+//
+// A big buffer is searched from scratch on the workers. The session holds on to the
+// search and looks at it on every update, so the editor isn't held up, and the edits made
+// while it runs are noted once it's done. The partitions' matches are taken over as they
+// are, which keeps the matches in runs, each in order and before the next, with offsets
+// saying where each run starts in the whole list.
+
+struct SearchRange {
+  i64 start;
+  i64 end;
+};
+
+struct SearchEdit {
+  i64 start;
+  i64 removed;
+  i64 inserted;
+};
+
+struct SearchSession {
+  DynamicArray<u8> query = DynamicArray<u8>(&system_allocator);
+  DynamicArray<DynamicArray<i64>> runs =
+      DynamicArray<DynamicArray<i64>>(&system_allocator);  // starts, in order
+  DynamicArray<i64> offsets = DynamicArray<i64>(&system_allocator);  // and the count last
+  DynamicArray<SearchRange> dirty = DynamicArray<SearchRange>(&system_allocator);
+
+  ParallelSearch *running = nullptr;  // for query, over the buffer as it was
+  DynamicArray<SearchEdit> edits =
+      DynamicArray<SearchEdit>(&system_allocator);  // made since it started
+
+  i64 background_size = 2 * PARALLEL_PARTITION_MIN_SIZE;  // searched on the workers from
+  i64 partition_size  = 0;  // of a search on the workers, 0 lets it pick
+
+  bool searched      = false;  // matches are for query, less the dirty ranges
+  i64 searched_bytes = 0;      // by the last update, how much it had to look at
+};
+
+String search_query(SearchSession *session)
+{
+  return String(session->query.data, session->query.size);
+}
+
+i64 match_count(SearchSession *session)
+{
+  i64 *offsets = session->offsets.data;
+  return session->offsets.size > 0 ? offsets[session->offsets.size - 1] : 0;
+}
+
+// the ith match in the whole buffer
+i64 match_at(SearchSession *session, i64 i)
+{
+  i64 *offsets = session->offsets.data;
+  i64 run      = std::upper_bound(offsets, offsets + session->offsets.size, i) - offsets;
+  run--;
+  return session->runs.data[run].data[i - offsets[run]];
+}
+
+// what the find prompt shows, the ones found so far while it's searching on the workers
+i64 found_count(SearchSession *session)
+{
+  if (session->running) {
+    return session->running->match_count.load(std::memory_order_relaxed);
+  }
+  return match_count(session);
+}
+
+// after the runs change size
+void update_offsets(SearchSession *session)
+{
+  session->offsets.clear();
+  session->offsets.push_back(0);
+  for (i64 i = 0; i < session->runs.size; i++) {
+    session->offsets.push_back(session->offsets.data[i] + session->runs.data[i].size);
+  }
+}
+
+void reset_search(SearchSession *session)
+{
+  if (session->running) {
+    cancel_parallel_search(session->running);
+    session->running = nullptr;
+  }
+  for (i64 i = 0; i < session->runs.size; i++) {
+    system_allocator.free(session->runs.data[i].allocation);
+  }
+  session->query.clear();
+  session->runs.clear();
+  session->offsets.clear();
+  session->dirty.clear();
+  session->edits.clear();
+  session->searched = false;
+}
+
+void free_search(SearchSession *session)
+{
+  reset_search(session);
+  system_allocator.free(session->query.allocation);
+  system_allocator.free(session->runs.allocation);
+  system_allocator.free(session->offsets.allocation);
+  system_allocator.free(session->dirty.allocation);
+  system_allocator.free(session->edits.allocation);
+}
+
+// where index ends up after removed bytes at start are replaced with inserted ones, an
+// index in what was removed goes to where it was
+i64 map_through_edit(i64 index, i64 start, i64 removed, i64 inserted)
+{
+  if (index <= start) return index;
+  if (index >= start + removed) return index - removed + inserted;
+  return start;
+}
+
+// the index of the first match at or after index, match_count if there's none
+i64 first_match_after(SearchSession *session, i64 index)
+{
+  for (i64 r = 0; r < session->runs.size; r++) {
+    DynamicArray<i64> *run = &session->runs.data[r];
+    if (run->size == 0 || run->data[run->size - 1] < index) continue;
+
+    i64 *found = std::lower_bound(run->data, run->data + run->size, index);
+    return session->offsets.data[r] + (found - run->data);
+  }
+  return match_count(session);
+}
+
+void set_query(SearchSession *session, String query)
+{
+  session->query.resize(query.size);
+  memcpy(session->query.data, query.data, query.size);
+}
+
+// call with every edit made to the buffer, removed bytes at start replaced by inserted
+// ones
+void note_edit(SearchSession *session, i64 start, i64 removed, i64 inserted)
+{
+  if (removed == 0 && inserted == 0) {
+    return;
+  }
+  if (session->running) {
+    session->edits.push_back({start, removed, inserted});
+    return;
+  }
+  if (!session->searched) {
+    return;
+  }
+
+  // a match survives if it ends by the edit or starts after what it removed
+  i64 first = start - session->query.size + 1;
+  for (i64 r = 0; r < session->runs.size; r++) {
+    DynamicArray<i64> *run = &session->runs.data[r];
+    if (run->size == 0 || run->data[run->size - 1] < first) continue;
+
+    i64 *matches = run->data;
+    i64 kept     = std::lower_bound(matches, matches + run->size, first) - matches;
+    for (i64 i = kept; i < run->size; i++) {
+      if (matches[i] < start + removed) continue;
+      matches[kept++] = matches[i] - removed + inserted;
+    }
+    run->resize(kept);
+  }
+  update_offsets(session);
+
+  for (i64 i = 0; i < session->dirty.size; i++) {
+    SearchRange *range = &session->dirty.data[i];
+    range->start       = map_through_edit(range->start, start, removed, inserted);
+    range->end         = map_through_edit(range->end, start, removed, inserted);
+  }
+  session->dirty.push_back({start, start + inserted});
+}
+
+// keeps the matches that go on with the bytes query has past the session's query. the
+// matches are in order, so it goes leaf by leaf checking all the matches in each
+void filter_matches(SearchSession *session, RopeBuffer buffer, String query)
+{
+  PROFILE_FUNCTION();
+
+  i64 old_size = session->query.size;
+  String added = query.sub(old_size, query.size);
+  i64 size     = buffer.rope.get_summary_or_empty().size;
+
+  BufferLeafIterator it = leaf_iterator_at(buffer.rope, 0);
+  String leaf           = match_count(session) > 0 ? leaf_string(buffer, it) : String();
+  for (i64 r = 0; r < session->runs.size; r++) {
+    i64 *matches = session->runs.data[r].data;
+    i64 count    = session->runs.data[r].size;
+    i64 kept     = 0;
+    i64 i        = 0;
+    while (i < count && matches[i] + query.size <= size) {
+      // step to the leaf with the next match's new bytes, or look it up when it's far off
+      i64 index = matches[i] + old_size;
+      for (i32 steps = 0; index >= it.start + leaf.size; steps++) {
+        if (steps == 16) {
+          it = leaf_iterator_at(buffer.rope, index);
+        } else {
+          next_leaf(&it);
+        }
+        leaf = leaf_string(buffer, it);
+      }
+
+      i64 leaf_end = it.start + leaf.size;
+      for (; i < count; i++) {
+        i64 at = matches[i] + old_size;
+        if (at + added.size > leaf_end) break;
+        if (memcmp(leaf.data + at - it.start, added.data, added.size) == 0) {
+          matches[kept++] = matches[i];
+        }
+      }
+
+      // one that runs on into the next leaves
+      if (i < count && matches[i] + old_size < leaf_end &&
+          matches[i] + query.size <= size) {
+        BufferLeafIterator at = it;
+        String bytes          = leaf;
+        index                 = matches[i] + old_size;
+        bool same             = true;
+        for (i64 j = 0; j < added.size && same; j++) {
+          while (index + j >= at.start + bytes.size) {
+            next_leaf(&at);
+            bytes = leaf_string(buffer, at);
+          }
+          same = bytes.data[index + j - at.start] == added.data[j];
+        }
+        if (same) matches[kept++] = matches[i];
+        i++;
+      }
+    }
+    session->searched_bytes += i * added.size;
+    session->runs.data[r].resize(kept);
+  }
+  update_offsets(session);
+}
+
+// takes over the matches of the search on the workers, once it's done, and notes the
+// edits made while it ran
+void take_background_search(SearchSession *session)
+{
+  ParallelSearch *search = session->running;
+  for (i64 i = 0; i < search->partitions.size; i++) {
+    SearchPartition *partition = &search->partitions.data[i];
+    session->runs.push_back(partition->matches);
+    partition->matches = DynamicArray<i64>(&system_allocator);
+  }
+  update_offsets(session);
+  session->searched_bytes += search->partitions.data[search->partitions.size - 1].end;
+  release_parallel_search(search);
+  session->running  = nullptr;
+  session->searched = true;
+
+  for (i64 i = 0; i < session->edits.size; i++) {
+    SearchEdit edit = session->edits.data[i];
+    note_edit(session, edit.start, edit.removed, edit.inserted);
+  }
+  session->edits.clear();
+}
+
+// returns once a search on the workers is done, for the next update to take it
+void wait_for_search(SearchSession *session)
+{
+  if (session->running) {
+    wait_for_parallel_search(session->running);
+  }
+}
+
+// brings the matches up to date with query and the buffer as it is now. a search on the
+// workers is looked at and left to run, it's only taken once it's done
+void update_search(SearchSession *session, RopeBuffer buffer, String query)
+{
+  PROFILE_FUNCTION();
+
+  session->searched_bytes = 0;
+  if (query.size == 0) {
+    reset_search(session);
+    return;
+  }
+
+  // one on the workers still counts while the query goes on from what it's searching for
+  if (session->running) {
+    String current = search_query(session);
+    bool prefix    = query.size >= current.size &&
+                  memcmp(query.data, current.data, current.size) == 0;
+    if (!prefix) {
+      reset_search(session);
+    } else if (!session->running->finished.load(std::memory_order_acquire)) {
+      return;
+    } else {
+      take_background_search(session);
+    }
+  }
+
+  String current = search_query(session);
+  bool extended  = session->searched && query.size >= current.size &&
+                  memcmp(query.data, current.data, current.size) == 0;
+  if (!extended) {
+    reset_search(session);
+    set_query(session, query);
+    i64 size = buffer.rope.get_summary_or_empty().size;
+    if (size >= session->background_size) {
+      session->running =
+          start_parallel_search(buffer, query, worker_count(), session->partition_size);
+      return;
+    }
+
+    DynamicArray<i64> run(&system_allocator);
+    for_each_match(buffer, 0, size, query, [&](i64 at) { run.push_back(at); });
+    session->runs.push_back(run);
+    update_offsets(session);
+    session->searched_bytes = size;
+    session->searched       = true;
+    return;
+  }
+
+  if (session->dirty.size > 0) {
+    Temp tmp;
+
+    // a new match has a byte in a dirty range, or bytes either side of an empty one
+    // where something was removed
+    std::sort(session->dirty.data, session->dirty.data + session->dirty.size,
+              [](SearchRange a, SearchRange b) { return a.start < b.start; });
+    // not in tmp, it grows under the temp memory for_each_match takes and rolls back
+    DynamicArray<i64> found(&system_allocator);
+    i64 searched_to = 0;
+    for (i64 i = 0; i < session->dirty.size; i++) {
+      SearchRange range = session->dirty.data[i];
+      i64 from          = std::max(range.start - current.size + 1, searched_to);
+      i64 to            = range.end;
+      if (from >= to) continue;
+
+      for_each_match(buffer, from, to, current, [&](i64 at) { found.push_back(at); });
+      session->searched_bytes += to - from + current.size - 1;
+      searched_to = to;
+    }
+    session->dirty.clear();
+
+    // each run takes the new matches from its first on, the first run any before that
+    i64 *found_end = found.data + found.size;
+    for (i64 r = session->runs.size - 1; r >= 0 && found_end > found.data; r--) {
+      DynamicArray<i64> *run = &session->runs.data[r];
+      if (run->size == 0 && r > 0) continue;
+
+      i64 *from = found.data;
+      if (r > 0) from = std::lower_bound(found.data, found_end, run->data[0]);
+      if (from == found_end) continue;
+
+      DynamicArray<i64> merged(&tmp);
+      merged.resize(run->size + (found_end - from));
+      i64 *end = std::set_union(run->data, run->data + run->size, from, found_end,
+                                merged.data);
+      run->resize(end - merged.data);
+      memcpy(run->data, merged.data, run->size * sizeof(i64));
+      found_end = from;
+    }
+    update_offsets(session);
+    system_allocator.free(found.allocation);
+  }
+
+  if (query.size > current.size) {
+    filter_matches(session, buffer, query);
+    set_query(session, query);
+  }
+}
+
+void search_session_tests()
+{
+  // edits of a few bytes all over a buffer of a, b and c, so matches come and go. it's
+  // searched on the workers in small partitions once it's past a few hundred bytes, and
+  // the search is left running into the next edits every other time
+  RopeBuffer buffer = create_rope_buffer();
+  fill_rope(&buffer, "");
+  SearchSession session;
+  session.background_size = 256;
+  session.partition_size  = 64;
+  u64 random = 5;
+  auto next  = [&]() {
+    random = random * 6364136223846793005ull + 1442695040888963407ull;
+    return random >> 33;
+  };
+
+  const char *queries[2][4] = {{"a", "ab", "abc", "abca"}, {"b", "bc", "bcb", "bcbc"}};
+  i64 chain                 = 0;
+  i64 typed                 = 0;
+  for (i32 round = 0; round < 60; round++) {
+    i64 size = buffer.rope.get_summary_or_empty().size;
+    if (next() % 3 == 0 && size > 0) {
+      i64 from = next() % size;
+      i64 to   = std::min(size, from + (i64)(next() % 8) + 1);
+      buffer_remove_range(buffer, from, to);
+      note_edit(&session, from, to - from, 0);
+    } else {
+      u8 span[64];
+      i64 count = next() % (round < 20 ? 64 : 6) + 1;
+      for (i64 c = 0; c < count; c++) span[c] = 'a' + next() % 3;
+      i64 at = next() % (size + 1);
+      buffer_insert(buffer, cursor_at(buffer, at), String(span, count));
+      note_edit(&session, at, 0, count);
+    }
+
+    // the query is typed on now and then, or replaced, or the prompt is closed and opened
+    // again
+    if (next() % 4 == 0) {
+      typed = std::min(typed + 1, (i64)3);
+      if (next() % 3 == 0) {
+        chain = next() % 2;
+        typed = next() % 4;
+      }
+    } else if (next() % 3 == 0) {
+      reset_search(&session);
+    }
+    const char *q = queries[chain][typed];
+    String query  = {(u8 *)q, (i64)strlen(q)};
+    update_search(&session, buffer, query);
+    if (next() % 2 == 0) {
+      wait_for_search(&session);
+      update_search(&session, buffer, query);
+    }
+    if (session.running) continue;
+
+    i64 expected = 0;
+    size         = buffer.rope.get_summary_or_empty().size;
+    for_each_match(buffer, 0, size, query, [&](i64 at) {
+      assert(expected < match_count(&session) && match_at(&session, expected) == at);
+      expected++;
+    });
+    assert(expected == match_count(&session));
+    for (i64 i = 0; i < expected; i++) {
+      assert(first_match_after(&session, match_at(&session, i)) == i);
+    }
+  }
+
+  // typing on only looks at the new bytes, an edit only near itself
+  reset_search(&session);
+  session.background_size = 2 * PARALLEL_PARTITION_MIN_SIZE;
+  session.partition_size  = 0;
+  fill_rope(&buffer, "");
+  for (i32 i = 0; i < 400; i++) buffer_insert(buffer, cursor_at(buffer, 0), "abcabd ");
+  update_search(&session, buffer, "ab");
+  assert(match_count(&session) == 800);
+  update_search(&session, buffer, "abc");
+  assert(match_count(&session) == 400 && session.searched_bytes == 800);
+
+  buffer_insert(buffer, cursor_at(buffer, 14), "abc");
+  note_edit(&session, 14, 0, 3);
+  update_search(&session, buffer, "abc");
+  assert(match_count(&session) == 401 && session.searched_bytes < 16);
+  assert(first_match_after(&session, 14) == 2 && match_at(&session, 3) == 17);
+
+  free_search(&session);
+  release(buffer.rope);
+}
@@ -11,6 +11,7 @@ struct Settings {
   Color foreground_color  = Color(28, 30, 35);
   Color activated_color   = Color(33, 162, 234);
   Color deactivated_color = Color(91, 98, 104);
+  Color match_color       = Color(62, 68, 81);
 
   // window
   f32 margin          = 12;
@@ -35,13 +35,13 @@ Tester create_tester(String filename)
     Span span;
     span.input_position = 0;
     span.start          = position;
-    span.size           = std::min(250 + rand() % 500LL, tester.file.size - position);
+    span.size           = std::min((i64)(250 + rand() % 500), tester.file.size - position);
     unordered.push_back(span);
 
     position += span.size;
   }
 
-  error("ASHBDGAYSFV ", unordered.size());
+  info("Tester: ", unordered.size(), " spans");
 
   while (unordered.size() > 0) {
     i64 index = 0; //std::rand() % unordered.size();
@@ -58,7 +58,7 @@ Tester create_tester(String filename)
 
 void add_actions(Tester *tester, RopeEditor *editor, Actions *actions)
 {
-  const i32 actions_per_frame = 200;
+  const i32 actions_per_frame = Actions::MAX_SIZE;
   if (tester->spans.size() == 0) return;
 
   Span &next_span = tester->spans[0];
@@ -1 +1,437 @@
 #pragma once
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define TEXT_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define TEXT_NEON 1
+#endif
+
+#include <string.h>
+
+#include "containers/array.hpp"
+#include "string.hpp"
+#include "types.hpp"
+
+// Newline counting for chunk summaries. Each kernel returns the number of '\n'
+// bytes in data and writes the position of the last one (or -1) to last_newline.
+typedef i64 (*CountNewlinesFn)(const u8 *data, i64 size, i64 *last_newline);
+
+i64 count_newlines_scalar(const u8 *data, i64 size, i64 *last_newline)
+{
+  i64 count = 0;
+  i64 last  = -1;
+  for (i64 i = 0; i < size; i++) {
+    if (data[i] == '\n') {
+      count++;
+      last = i;
+    }
+  }
+
+  *last_newline = last;
+  return count;
+}
+
+#if TEXT_X86
+i64 count_newlines_sse2(const u8 *data, i64 size, i64 *last_newline)
+{
+  __m128i newline = _mm_set1_epi8('\n');
+
+  i64 count = 0;
+  i64 last  = -1;
+  i64 i     = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(data + i));
+    u32 mask      = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+    if (mask) {
+      count += __builtin_popcount(mask);
+      last = i + 31 - __builtin_clz(mask);
+    }
+  }
+
+  i64 tail_last;
+  i64 tail_count = count_newlines_scalar(data + i, size - i, &tail_last);
+  if (tail_count > 0) last = i + tail_last;
+
+  *last_newline = last;
+  return count + tail_count;
+}
+
+__attribute__((target("avx2"))) i64 count_newlines_avx2(const u8 *data, i64 size,
+                                                         i64 *last_newline)
+{
+  __m256i newline = _mm256_set1_epi8('\n');
+
+  i64 count = 0;
+  i64 last  = -1;
+  i64 i     = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(data + i));
+    u32 mask      = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+    if (mask) {
+      count += __builtin_popcount(mask);
+      last = i + 31 - __builtin_clz(mask);
+    }
+  }
+
+  i64 tail_last;
+  i64 tail_count = count_newlines_sse2(data + i, size - i, &tail_last);
+  if (tail_count > 0) last = i + tail_last;
+
+  *last_newline = last;
+  return count + tail_count;
+}
+#endif
+
+#if TEXT_NEON
+i64 count_newlines_neon(const u8 *data, i64 size, i64 *last_newline)
+{
+  uint8x16_t newline = vdupq_n_u8('\n');
+
+  i64 count = 0;
+  i64 last  = -1;
+  i64 i     = 0;
+  for (; i + 16 <= size; i += 16) {
+    uint8x16_t matches = vceqq_u8(vld1q_u8(data + i), newline);
+    // narrow each byte of the comparison to a nibble to get a 64 bit mask
+    u64 mask = vget_lane_u64(
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+    if (mask) {
+      count += __builtin_popcountll(mask) / 4;
+      last = i + (63 - __builtin_clzll(mask)) / 4;
+    }
+  }
+
+  i64 tail_last;
+  i64 tail_count = count_newlines_scalar(data + i, size - i, &tail_last);
+  if (tail_count > 0) last = i + tail_last;
+
+  *last_newline = last;
+  return count + tail_count;
+}
+#endif
+
+CountNewlinesFn select_count_newlines()
+{
+#if TEXT_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return count_newlines_avx2;
+  return count_newlines_sse2;
+#elif TEXT_NEON
+  return count_newlines_neon;
+#else
+  return count_newlines_scalar;
+#endif
+}
+CountNewlinesFn count_newlines_impl = select_count_newlines();
+
+i64 count_newlines(String text, i64 *last_newline)
+{
+  return count_newlines_impl(text.data, text.size, last_newline);
+}
+
+// Substring search for the find prompt. Each kernel returns where the first (or for the
+// find_last kernels the last) occurrence of needle in data starts, or -1. The vector
+// kernels compare a block of positions against the needle's first byte and the block
+// needle.size - 1 further on against its last byte, and only compare the whole needle
+// where both match, so text that rarely has both bytes that far apart is skipped a block
+// at a time.
+typedef i64 (*FindFn)(const u8 *data, i64 size, const u8 *needle, i64 needle_size);
+
+i64 find_scalar(const u8 *data, i64 size, const u8 *needle, i64 needle_size)
+{
+  for (i64 i = 0; i + needle_size <= size; i++) {
+    i64 matched = 0;
+    while (matched < needle_size && data[i + matched] == needle[matched]) matched++;
+    if (matched == needle_size) return i;
+  }
+  return -1;
+}
+
+i64 find_last_scalar(const u8 *data, i64 size, const u8 *needle, i64 needle_size)
+{
+  for (i64 i = size - needle_size; i >= 0; i--) {
+    i64 matched = 0;
+    while (matched < needle_size && data[i + matched] == needle[matched]) matched++;
+    if (matched == needle_size) return i;
+  }
+  return -1;
+}
+
+#if TEXT_X86
+i64 find_sse2(const u8 *data, i64 size, const u8 *needle, i64 needle_size)
+{
+  if (needle_size == 0 || needle_size > size) return needle_size == 0 ? 0 : -1;
+
+  __m128i first = _mm_set1_epi8(needle[0]);
+  __m128i last  = _mm_set1_epi8(needle[needle_size - 1]);
+  i64 end       = needle_size - 1;
+
+  i64 starts = size - needle_size + 1;
+  i64 i      = 0;
+  for (; i + 16 <= starts; i += 16) {
+    __m128i block_first = _mm_loadu_si128((const __m128i *)(data + i));
+    __m128i block_last  = _mm_loadu_si128((const __m128i *)(data + i + end));
+    __m128i both        = _mm_and_si128(_mm_cmpeq_epi8(block_first, first),
+                                        _mm_cmpeq_epi8(block_last, last));
+    u32 mask            = _mm_movemask_epi8(both);
+    while (mask) {
+      i64 candidate = i + __builtin_ctz(mask);
+      if (memcmp(data + candidate, needle, needle_size) == 0) return candidate;
+      mask &= mask - 1;
+    }
+  }
+
+  i64 tail = find_scalar(data + i, size - i, needle, needle_size);
+  return tail == -1 ? -1 : i + tail;
+}
+
+i64 find_last_sse2(const u8 *data, i64 size, const u8 *needle, i64 needle_size)
+{
+  if (needle_size == 0 || needle_size > size) return needle_size == 0 ? size : -1;
+
+  __m128i first = _mm_set1_epi8(needle[0]);
+  __m128i last  = _mm_set1_epi8(needle[needle_size - 1]);
+  i64 end       = needle_size - 1;
+
+  i64 starts = size - needle_size + 1;
+  for (; starts >= 16; starts -= 16) {
+    i64 i               = starts - 16;
+    __m128i block_first = _mm_loadu_si128((const __m128i *)(data + i));
+    __m128i block_last  = _mm_loadu_si128((const __m128i *)(data + i + end));
+    __m128i both        = _mm_and_si128(_mm_cmpeq_epi8(block_first, first),
+                                        _mm_cmpeq_epi8(block_last, last));
+    u32 mask            = _mm_movemask_epi8(both);
+    while (mask) {
+      i64 candidate = i + 31 - __builtin_clz(mask);
+      if (memcmp(data + candidate, needle, needle_size) == 0) return candidate;
+      mask &= ~(1u << (candidate - i));
+    }
+  }
+
+  return find_last_scalar(data, starts + needle_size - 1, needle, needle_size);
+}
+
+__attribute__((target("avx2"))) i64 find_avx2(const u8 *data, i64 size, const u8 *needle,
+                                              i64 needle_size)
+{
+  if (needle_size == 0 || needle_size > size) return needle_size == 0 ? 0 : -1;
+
+  __m256i first = _mm256_set1_epi8(needle[0]);
+  __m256i last  = _mm256_set1_epi8(needle[needle_size - 1]);
+  i64 end       = needle_size - 1;
+
+  i64 starts = size - needle_size + 1;
+  i64 i      = 0;
+  for (; i + 32 <= starts; i += 32) {
+    __m256i block_first = _mm256_loadu_si256((const __m256i *)(data + i));
+    __m256i block_last  = _mm256_loadu_si256((const __m256i *)(data + i + end));
+    __m256i both        = _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first),
+                                           _mm256_cmpeq_epi8(block_last, last));
+    u32 mask            = _mm256_movemask_epi8(both);
+    while (mask) {
+      i64 candidate = i + __builtin_ctz(mask);
+      if (memcmp(data + candidate, needle, needle_size) == 0) return candidate;
+      mask &= mask - 1;
+    }
+  }
+
+  i64 tail = find_sse2(data + i, size - i, needle, needle_size);
+  return tail == -1 ? -1 : i + tail;
+}
+
+__attribute__((target("avx2"))) i64 find_last_avx2(const u8 *data, i64 size,
+                                                   const u8 *needle, i64 needle_size)
+{
+  if (needle_size == 0 || needle_size > size) return needle_size == 0 ? size : -1;
+
+  __m256i first = _mm256_set1_epi8(needle[0]);
+  __m256i last  = _mm256_set1_epi8(needle[needle_size - 1]);
+  i64 end       = needle_size - 1;
+
+  i64 starts = size - needle_size + 1;
+  for (; starts >= 32; starts -= 32) {
+    i64 i               = starts - 32;
+    __m256i block_first = _mm256_loadu_si256((const __m256i *)(data + i));
+    __m256i block_last  = _mm256_loadu_si256((const __m256i *)(data + i + end));
+    __m256i both        = _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first),
+                                           _mm256_cmpeq_epi8(block_last, last));
+    u32 mask            = _mm256_movemask_epi8(both);
+    while (mask) {
+      i64 candidate = i + 31 - __builtin_clz(mask);
+      if (memcmp(data + candidate, needle, needle_size) == 0) return candidate;
+      mask &= ~(1u << (candidate - i));
+    }
+  }
+
+  return find_last_sse2(data, starts + needle_size - 1, needle, needle_size);
+}
+#endif
+
+#if TEXT_NEON
+// a nibble per byte of a comparison, like count_newlines_neon
+u64 neon_match_mask(uint8x16_t matches)
+{
+  return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)),
+                       0);
+}
+
+i64 find_neon(const u8 *data, i64 size, const u8 *needle, i64 needle_size)
+{
+  if (needle_size == 0 || needle_size > size) return needle_size == 0 ? 0 : -1;
+
+  uint8x16_t first = vdupq_n_u8(needle[0]);
+  uint8x16_t last  = vdupq_n_u8(needle[needle_size - 1]);
+  i64 end          = needle_size - 1;
+
+  i64 starts = size - needle_size + 1;
+  i64 i      = 0;
+  for (; i + 16 <= starts; i += 16) {
+    uint8x16_t matches = vandq_u8(vceqq_u8(vld1q_u8(data + i), first),
+                                  vceqq_u8(vld1q_u8(data + i + end), last));
+    u64 mask           = neon_match_mask(matches);
+    while (mask) {
+      i64 candidate = i + __builtin_ctzll(mask) / 4;
+      if (memcmp(data + candidate, needle, needle_size) == 0) return candidate;
+      mask &= ~(0xfull << ((candidate - i) * 4));
+    }
+  }
+
+  i64 tail = find_scalar(data + i, size - i, needle, needle_size);
+  return tail == -1 ? -1 : i + tail;
+}
+
+i64 find_last_neon(const u8 *data, i64 size, const u8 *needle, i64 needle_size)
+{
+  if (needle_size == 0 || needle_size > size) return needle_size == 0 ? size : -1;
+
+  uint8x16_t first = vdupq_n_u8(needle[0]);
+  uint8x16_t last  = vdupq_n_u8(needle[needle_size - 1]);
+  i64 end          = needle_size - 1;
+
+  i64 starts = size - needle_size + 1;
+  for (; starts >= 16; starts -= 16) {
+    i64 i              = starts - 16;
+    uint8x16_t matches = vandq_u8(vceqq_u8(vld1q_u8(data + i), first),
+                                  vceqq_u8(vld1q_u8(data + i + end), last));
+    u64 mask           = neon_match_mask(matches);
+    while (mask) {
+      i64 candidate = i + (63 - __builtin_clzll(mask)) / 4;
+      if (memcmp(data + candidate, needle, needle_size) == 0) return candidate;
+      mask &= ~(0xfull << ((candidate - i) * 4));
+    }
+  }
+
+  return find_last_scalar(data, starts + needle_size - 1, needle, needle_size);
+}
+#endif
+
+FindFn select_find()
+{
+#if TEXT_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return find_avx2;
+  return find_sse2;
+#elif TEXT_NEON
+  return find_neon;
+#else
+  return find_scalar;
+#endif
+}
+FindFn select_find_last()
+{
+#if TEXT_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return find_last_avx2;
+  return find_last_sse2;
+#elif TEXT_NEON
+  return find_last_neon;
+#else
+  return find_last_scalar;
+#endif
+}
+FindFn find_impl      = select_find();
+FindFn find_last_impl = select_find_last();
+
+i64 find(String text, String needle)
+{
+  return find_impl(text.data, text.size, needle.data, needle.size);
+}
+i64 find_last(String text, String needle)
+{
+  return find_last_impl(text.data, text.size, needle.data, needle.size);
+}
+
+// tests
+
+void text_tests()
+{
+  Array<CountNewlinesFn, 4> impls = {count_newlines_scalar};
+#if TEXT_X86
+  impls.push_back(count_newlines_sse2);
+  if (__builtin_cpu_supports("avx2")) impls.push_back(count_newlines_avx2);
+#endif
+#if TEXT_NEON
+  impls.push_back(count_newlines_neon);
+#endif
+
+  u8 data[300];
+  for (i32 i = 0; i < 300; i++) {
+    data[i] = (i * 7 + i / 13) % 11 == 0 ? '\n' : 'a' + i % 26;
+  }
+
+  for (i64 start = 0; start < 32; start++) {
+    for (i64 size = 0; start + size <= 300; size += 7) {
+      i64 want_last;
+      i64 want = count_newlines_scalar(data + start, size, &want_last);
+      for (u32 i = 0; i < impls.size; i++) {
+        i64 last;
+        assert(impls[i](data + start, size, &last) == want);
+        assert(last == want_last);
+      }
+    }
+  }
+
+  Array<FindFn, 4> finds      = {find_scalar};
+  Array<FindFn, 4> find_lasts = {find_last_scalar};
+#if TEXT_X86
+  finds.push_back(find_sse2);
+  find_lasts.push_back(find_last_sse2);
+  if (__builtin_cpu_supports("avx2")) {
+    finds.push_back(find_avx2);
+    find_lasts.push_back(find_last_avx2);
+  }
+#endif
+#if TEXT_NEON
+  finds.push_back(find_neon);
+  find_lasts.push_back(find_last_neon);
+#endif
+
+  // few letters, so needles show up often and first and last bytes match often without
+  // the middle matching
+  u8 text[300];
+  for (i32 i = 0; i < 300; i++) {
+    text[i] = 'a' + (i * 7 + i / 5) % 3;
+  }
+  for (i64 needle_size = 0; needle_size < 40; needle_size += 3) {
+    for (i64 start = 0; start < 300 - 40; start += 11) {
+      // the same needle and one that differs in the middle only
+      u8 altered[40];
+      memcpy(altered, text + start, needle_size);
+      if (needle_size > 2) altered[needle_size / 2] = 'z';
+
+      for (const u8 *needle : {(const u8 *)text + start, (const u8 *)altered}) {
+        for (i64 size = 0; size <= 300; size += 17) {
+          i64 want      = find_scalar(text, size, needle, needle_size);
+          i64 want_last = find_last_scalar(text, size, needle, needle_size);
+          assert(needle_size > 0 || (want == 0 && want_last == size));
+          for (u32 i = 0; i < finds.size; i++) {
+            assert(finds[i](text, size, needle, needle_size) == want);
+            assert(find_lasts[i](text, size, needle, needle_size) == want_last);
+          }
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <chrono>
+
+#include "types.hpp"
+
+// a monotonic clock for measuring how long things take
+u64 now_ns()
+{
+  auto since_start = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(since_start).count();
+}
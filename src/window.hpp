@@ -5,11 +5,13 @@
 #include "actions.hpp"
 #include "buffer.hpp"
 #include "draw.hpp"
+#include "file_search.hpp"
 #include "find_prompt.hpp"
 #include "font.hpp"
 #include "input.hpp"
+#include "latency.hpp"
 #include "platform.hpp"
-#include "rope_editor.hpp"
+#include "rope_editor_view.hpp"
 #include "settings.hpp"
 
 struct Window {
@@ -58,6 +60,18 @@ void draw_info_bar(Window window, Draw::List *dl, bool is_focused)
   cursor = Draw::draw_string(dl, font_manager.editor_font, settings.text_color, filename,
                              cursor);
 
+  if (window.active_editor && is_loading(window.active_editor->buffer)) {
+    cursor.x += settings.margin;
+    String loading_percentage_str =
+        StaticString<4>::from_i32(loading_progress(window.active_editor->buffer) * 100);
+    cursor = Draw::draw_string(dl, font_manager.editor_font, settings.text_color,
+                               "loading ", cursor);
+    cursor = Draw::draw_string(dl, font_manager.editor_font, settings.text_color,
+                               loading_percentage_str, cursor);
+    cursor = Draw::draw_char(dl, font_manager.editor_font, settings.text_color,
+                             '%', cursor);
+  }
+
   cursor.x += settings.margin;
   String line   = window.active_editor
                       ? StaticString<32>::from_i32(window.active_editor->cursor.line())
@@ -140,7 +154,10 @@ void open_editor(Window *window, RopeBuffer *buffer)
   window->active_editor = window->editors.get(buffer);
   if (!window->active_editor) {
     RopeEditor new_editor;
-    new_editor.buffer     = *buffer;
+    new_editor.buffer     = copy_buffer(buffer);
+    if (buffer->file_results) {
+      share_file_results(&new_editor.buffer, buffer->file_results);
+    }
     new_editor.cursor     = cursor_at_point(*buffer, 0, 0);
     new_editor.anchor     = new_editor.cursor;
     window->active_editor = window->editors.put(buffer, new_editor);
@@ -216,20 +233,68 @@ void open_editor(Window *window, RopeBuffer *buffer)
 //   }
 // }
 
+bool jump_to_find_match(Window *window, bool forward)
+{
+  String query = find_query(&window->find);
+  if (window->find.regex) {
+    return jump_to_regex_match(window->active_editor, query, forward);
+  }
+  return jump_to_match(window->active_editor, query, forward);
+}
+
+// every open copy goes on loading and taking in results, not only the one that's shown
+void update_editors(Window *window)
+{
+  for (i64 i = 0; i < window->editors.capacity; i++) {
+    if (window->editors.data[i].distance == 0) continue;
+    RopeEditor *editor = &window->editors.data[i].value;
+
+    // the leaves that finished loading are an insert at the end, as far as the matches go
+    i64 loaded = editor->buffer.rope.get_summary_or_empty().size;
+    continue_loading(&editor->buffer);
+    note_edit(&editor->search, loaded, 0,
+              editor->buffer.rope.get_summary_or_empty().size - loaded);
+
+    take_file_results(editor);
+  }
+}
+
 void process(Window *window, Actions *actions, bool focused)
 {
+  update_editors(window);
   if (!window->active_editor) {
     return;
   }
 
+  if (actions->size == 0) {
+    continue_compaction(window->active_editor->buffer);
+  }
+
+  RopeBuffer::Cursor previous_cursor = window->active_editor->cursor;
   for (i32 i = 0; i < actions->size; i++) {
     Action *action = &actions->operator[](i);
-
-    // if (window->find.focused) {
-    //   if (handle_action(&window->find, action)) {
-    //     return;
-    //   }
-    // }
+    LatencyScope latency_scope(action);
+
+    if (window->find.focused) {
+      // enter jumps to the first match and leaves the prompt open to jump on from there
+      if (eat(action, Command::INPUT_NEWLINE)) {
+        window->find.focused = false;
+        jump_to_find_match(window, true);
+        continue;
+      }
+      if (handle_action(&window->find, action)) {
+        continue;
+      }
+    }
+    if (eat(action, Command::JUMP_TO_NEXT)) {
+      jump_to_find_match(window, true);
+    }
+    if (eat(action, Command::JUMP_TO_PREVIOUS)) {
+      jump_to_find_match(window, false);
+    }
+    if (eat(action, Command::TOGGLE_FIND_REGEX)) {
+      window->find.regex = !window->find.regex;
+    }
 
     if (eat(action, Command::TOGGLE_FIND)) {
       window->find.open    = true;
@@ -266,8 +331,15 @@ void process(Window *window, Actions *actions, bool focused)
     }
   }
 
-  RopeBuffer::Cursor previous_cursor = window->active_editor->cursor;
   process(window->active_editor, actions);
+
+  // matches are kept while the prompt is open, for the count and the highlights
+  if (window->find.open && !window->find.regex) {
+    update_search(&window->active_editor->search, window->active_editor->buffer,
+                  find_query(&window->find));
+  } else {
+    reset_search(&window->active_editor->search);
+  }
   if (window->active_editor->cursor != previous_cursor) {
     ViewRange view_range = get_view_range(*window, font_manager.editor_font);
     if (window->active_editor->cursor.line() < view_range.top_line + 3) {
@@ -302,7 +374,10 @@ void draw_window(Window &window, Draw::List *dl, bool focused)
   }
 
   if (window.find.open) {
-    draw_find_prompt(window.find, dl, focused);
+    i64 match_count = window.active_editor && !window.find.regex
+                          ? found_count(&window.active_editor->search)
+                          : -1;
+    draw_find_prompt(window.find, dl, focused, match_count);
   }
   draw_info_bar(window, dl, focused);
 
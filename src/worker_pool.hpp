@@ -0,0 +1,67 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "containers/dynamic_array.hpp"
+#include "memory.hpp"
+#include "profiler.hpp"
+#include "types.hpp"
+
+// Threads that run tasks from one queue, for work that's been cut into pieces that can
+// run on any thread in any order. They're started the first time there's work for them
+// and live as long as the program. A task can't be taken back once it's queued, so
+// whatever its data points at has to outlive it, see ParallelSearch's references.
+
+struct WorkerTask {
+  void (*run)(void *data, i64 index);
+  void *data;
+  i64 index;
+};
+
+struct WorkerPool {
+  std::mutex mutex;
+  std::condition_variable wake;
+  DynamicArray<WorkerTask> tasks = DynamicArray<WorkerTask>(&system_allocator);
+  i64 next_task                  = 0;  // the ones before it have been taken
+  i32 thread_count               = 0;
+};
+// never destroyed, its threads are still waiting on it when the program exits
+WorkerPool &worker_pool = *new WorkerPool();
+
+void run_worker()
+{
+  set_profile_thread_name("worker");
+  while (true) {
+    WorkerTask task;
+    {
+      std::unique_lock<std::mutex> lock(worker_pool.mutex);
+      worker_pool.wake.wait(
+          lock, [] { return worker_pool.next_task < worker_pool.tasks.size; });
+      task = worker_pool.tasks.data[worker_pool.next_task++];
+      if (worker_pool.next_task == worker_pool.tasks.size) {
+        worker_pool.tasks.clear();
+        worker_pool.next_task = 0;
+      }
+    }
+    task.run(task.data, task.index);
+  }
+}
+
+// one per core
+i32 worker_count() { return std::max((i32)std::thread::hardware_concurrency(), 1); }
+
+// queues run(data, i) for every i in [0, count), with at least count threads to run them
+void run_on_workers(void (*run)(void *data, i64 index), void *data, i64 count)
+{
+  std::lock_guard<std::mutex> lock(worker_pool.mutex);
+  for (; worker_pool.thread_count < count; worker_pool.thread_count++) {
+    std::thread(run_worker).detach();
+  }
+  for (i64 i = 0; i < count; i++) {
+    worker_pool.tasks.push_back({run, data, i});
+  }
+  worker_pool.wake.notify_all();
+}